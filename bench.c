@@ -0,0 +1,962 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stddef.h>
+#include <unistd.h>
+#include "channel.h"
+#include "pool.h"
+#include "sharded_channel.h"
+#include "broadcast.h"
+
+/*
+ * Micro-benchmarks for the channel library. Run all of them with ./channel_bench, or a single one by name,
+ * e.g. ./channel_bench bench_select_fairness. `make bench` writes the results to bench_output.txt.
+ */
+
+typedef void (*bench_fn_t)(void);
+typedef struct {
+    char* name;
+    bench_fn_t bench;
+} bench_t;
+
+/*
+ * The benchmark binary is linked with --wrap=malloc and --wrap=free, so every call the channel library (and
+ * this file) makes to them lands here and is counted.
+ */
+atomic_size_t allocations;
+atomic_size_t deallocations;
+
+void* __real_malloc(size_t size);
+void __real_free(void* ptr);
+
+void* __wrap_malloc(size_t size)
+{
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __real_malloc(size);
+}
+
+void __wrap_free(void* ptr)
+{
+    if (ptr != NULL) {
+        atomic_fetch_add_explicit(&deallocations, 1, memory_order_relaxed);
+    }
+    __real_free(ptr);
+}
+
+uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+int compare_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Sorts values and returns the given percentile (0-100) of them
+uint64_t percentile(uint64_t* values, size_t count, double pct)
+{
+    if (count == 0) {
+        return 0;
+    }
+    qsort(values, count, sizeof(uint64_t), compare_u64);
+    size_t index = (size_t)(pct / 100.0 * (double)(count - 1));
+    return values[index];
+}
+
+#define FAIRNESS_BRANCHES 8
+#define FAIRNESS_ROUNDS 200000
+
+/*
+ * Every branch of the select is a RECV on a buffered channel that is refilled right after each receive,
+ * so all branches are always ready. For each branch we record the time between two consecutive selections
+ * of that branch; a starved branch has no samples at all.
+ */
+void run_select_fairness(const char* label, enum channel_status (*select_fn)(select_t*, size_t, size_t*))
+{
+    channel_t* channels[FAIRNESS_BRANCHES];
+    select_t list[FAIRNESS_BRANCHES];
+    uint64_t* gaps[FAIRNESS_BRANCHES];
+    size_t counts[FAIRNESS_BRANCHES];
+    uint64_t last[FAIRNESS_BRANCHES];
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < FAIRNESS_BRANCHES; i++) {
+        channels[i] = channel_create(1);
+        channel_send(channels[i], (void*)i);
+        list[i].channel = channels[i];
+        list[i].dir = RECV;
+        list[i].data = NULL;
+        gaps[i] = malloc(sizeof(uint64_t) * FAIRNESS_ROUNDS);
+        counts[i] = 0;
+        last[i] = start;
+    }
+    for (size_t round = 0; round < FAIRNESS_ROUNDS; round++) {
+        size_t index;
+        select_fn(list, FAIRNESS_BRANCHES, &index);
+        uint64_t t = now_ns();
+        gaps[index][counts[index]++] = t - last[index];
+        last[index] = t;
+        channel_send(channels[index], list[index].data);
+    }
+    printf("%s (%d branches, %d selects, gap between selections of a branch in ns)\n", label, FAIRNESS_BRANCHES, FAIRNESS_ROUNDS);
+    printf("  branch   selected        p50        p99     p99.99        max\n");
+    for (size_t i = 0; i < FAIRNESS_BRANCHES; i++) {
+        if (counts[i] == 0) {
+            printf("  %6zu %10zu    starved\n", i, counts[i]);
+        } else {
+            uint64_t p50 = percentile(gaps[i], counts[i], 50);
+            uint64_t p99 = percentile(gaps[i], counts[i], 99);
+            uint64_t p9999 = percentile(gaps[i], counts[i], 99.99);
+            uint64_t max = percentile(gaps[i], counts[i], 100);
+            printf("  %6zu %10zu %10lu %10lu %10lu %10lu\n", i, counts[i], p50, p99, p9999, max);
+        }
+        channel_close(channels[i]);
+        channel_destroy(channels[i]);
+        free(gaps[i]);
+    }
+}
+
+void bench_select_fairness(void)
+{
+    run_select_fairness("channel_select", channel_select);
+    run_select_fairness("channel_select_fair", channel_select_fair);
+}
+
+#define ALLOC_CASES 8
+#define ALLOC_ROUNDS 100000
+
+typedef struct {
+    channel_t** channels;
+    size_t rounds;
+} alloc_sender_args;
+
+/* Sends round r on channel r % ALLOC_CASES, so that the selecting thread mostly finds nothing ready and parks */
+void* alloc_sender(void* arg)
+{
+    alloc_sender_args* args = arg;
+    for (size_t r = 0; r < args->rounds; r++) {
+        channel_send(args->channels[r % ALLOC_CASES], (void*)r);
+    }
+    return NULL;
+}
+
+/*
+ * Counts heap allocations of steady-state selects over ALLOC_CASES unbuffered RECV cases that are fed one
+ * message at a time by another thread, once with channel_select and once with a select set.
+ */
+void bench_select_allocations(void)
+{
+    channel_t* channels[ALLOC_CASES];
+    select_t list[ALLOC_CASES];
+    for (size_t i = 0; i < ALLOC_CASES; i++) {
+        channels[i] = channel_create(0);
+        list[i].channel = channels[i];
+        list[i].dir = RECV;
+        list[i].data = NULL;
+    }
+    select_set_t* set = select_set_create(list, ALLOC_CASES);
+    for (size_t use_set = 0; use_set < 2; use_set++) {
+        alloc_sender_args args = {channels, ALLOC_ROUNDS};
+        pthread_t sender;
+        pthread_create(&sender, NULL, alloc_sender, &args);
+        size_t allocated = atomic_load(&allocations);
+        size_t freed = atomic_load(&deallocations);
+        uint64_t start = now_ns();
+        for (size_t r = 0; r < ALLOC_ROUNDS; r++) {
+            size_t index;
+            if (use_set) {
+                select_set_wait(set, &index);
+            } else {
+                channel_select(list, ALLOC_CASES, &index);
+            }
+        }
+        uint64_t elapsed = now_ns() - start;
+        allocated = atomic_load(&allocations) - allocated;
+        freed = atomic_load(&deallocations) - freed;
+        pthread_join(sender, NULL);
+        printf("%-15s %d cases, %d selects: %zu mallocs, %zu frees (%.2f per select), %.0f ns per select\n",
+               use_set ? "select_set_wait" : "channel_select", ALLOC_CASES, ALLOC_ROUNDS, allocated, freed,
+               (double)allocated / ALLOC_ROUNDS, (double)elapsed / ALLOC_ROUNDS);
+    }
+    select_set_destroy(set);
+    for (size_t i = 0; i < ALLOC_CASES; i++) {
+        channel_close(channels[i]);
+        channel_destroy(channels[i]);
+    }
+}
+
+typedef struct {
+    channel_t* shared;
+    channel_t* own;
+} pile_selector_args;
+
+/* Parks in a select on its own channel and, unless shared is NULL, on the shared channel that never gets a message */
+void* pile_selector(void* arg)
+{
+    pile_selector_args* args = arg;
+    select_t list[2] = {{args->own, RECV, NULL}, {args->shared, RECV, NULL}};
+    size_t index;
+    channel_select(list, args->shared ? 2 : 1, &index);
+    return NULL;
+}
+
+/* Parks count selectors, on shared as well if it is not NULL, and returns the time per select to complete them */
+double run_select_cleanup(size_t count, channel_t* shared, const pthread_attr_t* attr)
+{
+    pile_selector_args* args = malloc(sizeof(pile_selector_args) * count);
+    pthread_t* threads = malloc(sizeof(pthread_t) * count);
+    for (size_t i = 0; i < count; i++) {
+        args[i].shared = shared;
+        args[i].own = channel_create(0);
+        pthread_create(&threads[i], attr, pile_selector, &args[i]);
+        /* Wait for it to park so that the queue order is known */
+        while (true) {
+            pthread_mutex_lock(&args[i].own->mutex);
+            size_t parked = args[i].own->recvq->count;
+            pthread_mutex_unlock(&args[i].own->mutex);
+            if (parked == 1) {
+                break;
+            }
+            sched_yield();
+        }
+    }
+    uint64_t start = now_ns();
+    for (size_t i = count; i > 0; i--) {
+        channel_send(args[i - 1].own, NULL);
+        pthread_join(threads[i - 1], NULL);
+    }
+    uint64_t elapsed = now_ns() - start;
+    for (size_t i = 0; i < count; i++) {
+        channel_close(args[i].own);
+        channel_destroy(args[i].own);
+    }
+    free(args);
+    free(threads);
+    return (double)elapsed / (double)count;
+}
+
+static const size_t pile_sizes[] = {16, 256, 1024, 4096};
+
+/*
+ * Piles selectors onto one shared channel, then completes them one at a time through their own channels in
+ * the order they queued, newest first. Every completed select takes its waiter back off the shared channel's
+ * queue, which holds all selectors that are still parked, so the time per select shows how that cleanup
+ * scales with the length of the queue. The same selectors without the shared channel are the baseline for
+ * what thread wakeup and join cost at that thread count.
+ */
+void bench_select_cleanup(void)
+{
+    printf("selectors parked on one channel, completed newest first (ns per select)\n");
+    printf("  selectors    shared  baseline\n");
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, 64 * 1024);
+    for (size_t s = 0; s < sizeof(pile_sizes) / sizeof(pile_sizes[0]); s++) {
+        channel_t* shared = channel_create(0);
+        double with_shared = run_select_cleanup(pile_sizes[s], shared, &attr);
+        double baseline = run_select_cleanup(pile_sizes[s], NULL, &attr);
+        printf("  %9zu %9.0f %9.0f\n", pile_sizes[s], with_shared, baseline);
+        channel_close(shared);
+        channel_destroy(shared);
+    }
+    pthread_attr_destroy(&attr);
+}
+
+#define POOL_ROOTS 20000
+#define POOL_WORK 100
+
+typedef struct {
+    channel_t* channel;
+    pool_t* pool;
+    size_t fanout;
+    atomic_size_t remaining;
+    channel_t* done;
+} pool_bench_args;
+
+/* Stands in for the handling of a task; a few hundred ns of arithmetic that touches no shared memory */
+void busy_work(size_t seed)
+{
+    volatile size_t x = seed;
+    for (size_t i = 0; i < POOL_WORK; i++) {
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    }
+}
+
+/* Every root task submits fanout children, through the pool when there is one and the shared channel otherwise */
+void pool_bench_handler(void* task, void* context)
+{
+    pool_bench_args* args = context;
+    size_t value = (size_t)task;
+    if (value <= POOL_ROOTS) {
+        for (size_t i = 1; i <= args->fanout; i++) {
+            void* child = (void*)(value + i * POOL_ROOTS);
+            if (args->pool != NULL) {
+                pool_submit(args->pool, child);
+            } else {
+                channel_send(args->channel, child);
+            }
+        }
+    }
+    busy_work(value);
+    if (atomic_fetch_sub(&args->remaining, 1) == 1) {
+        channel_send(args->done, NULL);
+    }
+}
+
+/* The pattern the pool replaces: every worker loops on channel_receive from the one shared channel */
+void* shared_channel_worker(void* arg)
+{
+    pool_bench_args* args = arg;
+    void* task;
+    while (channel_receive(args->channel, &task) == SUCCESS) {
+        pool_bench_handler(task, args);
+    }
+    return NULL;
+}
+
+/* Sends POOL_ROOTS tasks from this thread and returns the ns per task, children included, until all ran */
+double run_pool_bench(size_t workers, size_t fanout, bool use_pool)
+{
+    size_t total = POOL_ROOTS * (fanout + 1);
+    pool_bench_args args = {.fanout = fanout, .pool = NULL};
+    /* Large enough that the shared-channel workers never block sending children to themselves */
+    args.channel = channel_create(total);
+    args.done = channel_create(1);
+    atomic_init(&args.remaining, total);
+    pthread_t* threads = malloc(sizeof(pthread_t) * workers);
+    if (use_pool) {
+        args.pool = pool_create(args.channel, workers, pool_bench_handler, &args);
+    } else {
+        for (size_t i = 0; i < workers; i++) {
+            pthread_create(&threads[i], NULL, shared_channel_worker, &args);
+        }
+    }
+    uint64_t start = now_ns();
+    for (size_t i = 1; i <= POOL_ROOTS; i++) {
+        channel_send(args.channel, (void*)i);
+    }
+    void* data;
+    channel_receive(args.done, &data);
+    uint64_t elapsed = now_ns() - start;
+    if (use_pool) {
+        pool_destroy(args.pool);
+    } else {
+        channel_close(args.channel);
+        for (size_t i = 0; i < workers; i++) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    channel_destroy(args.channel);
+    channel_close(args.done);
+    channel_destroy(args.done);
+    free(threads);
+    return (double)elapsed / (double)total;
+}
+
+static const size_t pool_workers[] = {1, 2, 4, 8, 16};
+
+/*
+ * Compares the work-stealing pool with worker threads that all receive from one shared channel, once with
+ * tasks that only come from the feeding thread, and once with every task submitting 16 children.
+ */
+void bench_pool(void)
+{
+    static const size_t fanouts[] = {0, 16};
+    for (size_t f = 0; f < sizeof(fanouts) / sizeof(fanouts[0]); f++) {
+        printf("%d tasks fed through a channel, %zu children each (ns per task)\n", POOL_ROOTS, fanouts[f]);
+        printf("    workers    shared      pool\n");
+        for (size_t w = 0; w < sizeof(pool_workers) / sizeof(pool_workers[0]); w++) {
+            double shared = run_pool_bench(pool_workers[w], fanouts[f], false);
+            double pooled = run_pool_bench(pool_workers[w], fanouts[f], true);
+            printf("  %9zu %9.0f %9.0f\n", pool_workers[w], shared, pooled);
+        }
+    }
+}
+
+#define FAN_IN_MESSAGES 256000
+#define FAN_IN_CAPACITY 256
+
+typedef struct {
+    channel_t* channel;
+    sharded_channel_t* sharded;
+    size_t messages;
+} fan_in_args;
+
+void* fan_in_producer(void* arg)
+{
+    fan_in_args* args = arg;
+    for (size_t i = 1; i <= args->messages; i++) {
+        if (args->sharded != NULL) {
+            sharded_channel_send(args->sharded, (void*)i);
+        } else {
+            channel_send(args->channel, (void*)i);
+        }
+    }
+    return NULL;
+}
+
+/* Returns the ns per message for producers threads sending FAN_IN_MESSAGES in total to this thread */
+double run_fan_in(size_t producers, size_t lanes)
+{
+    fan_in_args args = {NULL, NULL, FAN_IN_MESSAGES / producers};
+    if (lanes == 0) {
+        args.channel = channel_create(FAN_IN_CAPACITY);
+    } else {
+        args.sharded = sharded_channel_create(lanes, FAN_IN_CAPACITY);
+    }
+    pthread_t* threads = malloc(sizeof(pthread_t) * producers);
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < producers; i++) {
+        pthread_create(&threads[i], NULL, fan_in_producer, &args);
+    }
+    void* data;
+    for (size_t n = 0; n < args.messages * producers; n++) {
+        if (args.sharded != NULL) {
+            sharded_channel_receive(args.sharded, &data);
+        } else {
+            channel_receive(args.channel, &data);
+        }
+    }
+    uint64_t elapsed = now_ns() - start;
+    for (size_t i = 0; i < producers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    if (args.sharded != NULL) {
+        sharded_channel_close(args.sharded);
+        sharded_channel_destroy(args.sharded);
+    } else {
+        channel_close(args.channel);
+        channel_destroy(args.channel);
+    }
+    free(threads);
+    return (double)elapsed / (double)(args.messages * producers);
+}
+
+static const size_t fan_in_producers[] = {1, 2, 4, 8, 16, 32, 64};
+
+/*
+ * Scaling curve of many producers feeding one consumer, through one channel and through sharded channels of
+ * 8 and 32 lanes, each lane as large as the single channel.
+ */
+void bench_sharded_fan_in(void)
+{
+    printf("%d messages from N producers to one consumer (ns per message)\n", FAN_IN_MESSAGES);
+    printf("  producers   channel  8 lanes 32 lanes\n");
+    for (size_t p = 0; p < sizeof(fan_in_producers) / sizeof(fan_in_producers[0]); p++) {
+        double single = run_fan_in(fan_in_producers[p], 0);
+        double lanes8 = run_fan_in(fan_in_producers[p], 8);
+        double lanes32 = run_fan_in(fan_in_producers[p], 32);
+        printf("  %9zu %9.0f %8.0f %8.0f\n", fan_in_producers[p], single, lanes8, lanes32);
+    }
+}
+
+#define FAN_OUT_MESSAGES 20000
+#define FAN_OUT_CAPACITY 64
+
+typedef struct {
+    channel_t* channel;
+    broadcast_sub_t* sub;
+} fan_out_args;
+
+void* fan_out_subscriber(void* arg)
+{
+    fan_out_args* args = arg;
+    void* data;
+    for (size_t i = 0; i < FAN_OUT_MESSAGES; i++) {
+        if (args->sub != NULL) {
+            broadcast_receive(args->sub, &data);
+        } else {
+            channel_receive(args->channel, &data);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Returns the ns per message, and the ns the publishing thread spent per message in publish, for
+ * FAN_OUT_MESSAGES messages delivered to every one of subscribers threads, either through one channel per
+ * subscriber that the publisher sends to in turn, or through one broadcast channel.
+ */
+double run_fan_out(size_t subscribers, bool use_broadcast, double* publish_ns)
+{
+    fan_out_args* args = malloc(sizeof(fan_out_args) * subscribers);
+    pthread_t* threads = malloc(sizeof(pthread_t) * subscribers);
+    broadcast_t* broadcast = use_broadcast ? broadcast_create(FAN_OUT_CAPACITY, BROADCAST_BLOCK) : NULL;
+    for (size_t i = 0; i < subscribers; i++) {
+        args[i].channel = use_broadcast ? NULL : channel_create(FAN_OUT_CAPACITY);
+        args[i].sub = use_broadcast ? broadcast_subscribe(broadcast) : NULL;
+        pthread_create(&threads[i], NULL, fan_out_subscriber, &args[i]);
+    }
+    uint64_t publishing = 0;
+    uint64_t start = now_ns();
+    for (size_t n = 1; n <= FAN_OUT_MESSAGES; n++) {
+        uint64_t before = now_ns();
+        if (use_broadcast) {
+            broadcast_publish(broadcast, (void*)n);
+        } else {
+            for (size_t i = 0; i < subscribers; i++) {
+                channel_send(args[i].channel, (void*)n);
+            }
+        }
+        publishing += now_ns() - before;
+    }
+    for (size_t i = 0; i < subscribers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    uint64_t elapsed = now_ns() - start;
+    for (size_t i = 0; i < subscribers; i++) {
+        if (use_broadcast) {
+            broadcast_unsubscribe(args[i].sub);
+        } else {
+            channel_close(args[i].channel);
+            channel_destroy(args[i].channel);
+        }
+    }
+    if (use_broadcast) {
+        broadcast_close(broadcast);
+        broadcast_destroy(broadcast);
+    }
+    free(args);
+    free(threads);
+    *publish_ns = (double)publishing / FAN_OUT_MESSAGES;
+    return (double)elapsed / FAN_OUT_MESSAGES;
+}
+
+static const size_t fan_out_subscribers[] = {1, 4, 16, 64};
+
+/* Fan-out of one publisher to N subscribers, per-subscriber channels against one broadcast channel */
+void bench_broadcast(void)
+{
+    printf("%d messages to each of N subscribers (ns per message: until all delivered / spent publishing)\n", FAN_OUT_MESSAGES);
+    printf("  subscribers      channels     broadcast\n");
+    for (size_t s = 0; s < sizeof(fan_out_subscribers) / sizeof(fan_out_subscribers[0]); s++) {
+        double channels_publish, broadcast_publish_ns;
+        double channels_total = run_fan_out(fan_out_subscribers[s], false, &channels_publish);
+        double broadcast_total = run_fan_out(fan_out_subscribers[s], true, &broadcast_publish_ns);
+        printf("  %11zu %6.0f/%6.0f %6.0f/%6.0f\n", fan_out_subscribers[s], channels_total, channels_publish,
+               broadcast_total, broadcast_publish_ns);
+    }
+}
+
+#define VALUE_MESSAGES 500000
+#define VALUE_CAPACITY 256
+
+/* A small message, like the distance updates of a graph search */
+typedef struct {
+    size_t node;
+    double distance;
+} value_update_t;
+
+void* value_producer(void* arg)
+{
+    channel_t* channel = arg;
+    for (size_t i = 0; i < VALUE_MESSAGES; i++) {
+        value_update_t update = {i, (double)i};
+        if (channel->elem_size != 0) {
+            channel_send_value(channel, &update);
+        } else {
+            value_update_t* boxed = malloc(sizeof(value_update_t));
+            *boxed = update;
+            channel_send(channel, boxed);
+        }
+    }
+    return NULL;
+}
+
+/* Returns the ns per message for one producer sending VALUE_MESSAGES updates to this thread */
+double run_values(bool typed, double* allocs_per_message)
+{
+    channel_t* channel = typed ? channel_create_typed(sizeof(value_update_t), VALUE_CAPACITY) : channel_create(VALUE_CAPACITY);
+    size_t allocs_before = atomic_load(&allocations);
+    pthread_t producer;
+    double sum = 0;
+    uint64_t start = now_ns();
+    pthread_create(&producer, NULL, value_producer, channel);
+    for (size_t n = 0; n < VALUE_MESSAGES; n++) {
+        value_update_t update;
+        if (typed) {
+            channel_receive_value(channel, &update);
+        } else {
+            void* data;
+            channel_receive(channel, &data);
+            update = *(value_update_t*)data;
+            free(data);
+        }
+        sum += update.distance;
+    }
+    uint64_t elapsed = now_ns() - start;
+    pthread_join(producer, NULL);
+    *allocs_per_message = (double)(atomic_load(&allocations) - allocs_before) / VALUE_MESSAGES;
+    channel_close(channel);
+    channel_destroy(channel);
+    if (sum < 0) {
+        printf("unreachable\n");
+    }
+    return (double)elapsed / VALUE_MESSAGES;
+}
+
+/* Small values sent as heap-allocated void* messages against a typed channel that copies them inline */
+void bench_typed_values(void)
+{
+    printf("%d %zu-byte values from one producer to one consumer\n", VALUE_MESSAGES, sizeof(value_update_t));
+    printf("              ns/message  mallocs/message\n");
+    double allocs;
+    double boxed = run_values(false, &allocs);
+    printf("  void*       %10.0f %16.2f\n", boxed, allocs);
+    double typed = run_values(true, &allocs);
+    printf("  typed       %10.0f %16.2f\n", typed, allocs);
+}
+
+#define ZERO_COPY_MESSAGES 100000
+#define ZERO_COPY_QUEUED 64
+
+static const size_t zero_copy_sizes[] = {64, 1024, 16384};
+
+typedef struct {
+    channel_t* channel;
+    size_t size;
+} zero_copy_args;
+
+/* Builds each message in place in a byte channel, or in a local buffer that is then copied to the heap and sent */
+void* zero_copy_producer(void* arg)
+{
+    zero_copy_args* args = arg;
+    char* local = args->channel->buffer->bytes ? NULL : malloc(args->size);
+    for (size_t i = 0; i < ZERO_COPY_MESSAGES; i++) {
+        if (local == NULL) {
+            channel_slot_t slot;
+            channel_reserve(args->channel, args->size, &slot);
+            memset(slot.data, (int)(i & 0xff), args->size);
+            channel_commit(args->channel, slot);
+        } else {
+            memset(local, (int)(i & 0xff), args->size);
+            char* message = malloc(args->size);
+            memcpy(message, local, args->size);
+            channel_send(args->channel, message);
+        }
+    }
+    free(local);
+    return NULL;
+}
+
+/* Returns the ns per message for one producer sending ZERO_COPY_MESSAGES messages of size bytes to this thread */
+double run_zero_copy(size_t size, bool zero_copy)
+{
+    zero_copy_args args = {NULL, size};
+    /* Both channels hold up to ZERO_COPY_QUEUED messages, the byte channel counting each record's header */
+    args.channel = zero_copy ? channel_create_bytes(ZERO_COPY_QUEUED * (size + BUFFER_RECORD_ALIGN)) : channel_create(ZERO_COPY_QUEUED);
+    pthread_t producer;
+    uint64_t sum = 0;
+    uint64_t start = now_ns();
+    pthread_create(&producer, NULL, zero_copy_producer, &args);
+    for (size_t n = 0; n < ZERO_COPY_MESSAGES; n++) {
+        channel_slot_t slot = {NULL, size};
+        if (zero_copy) {
+            channel_peek(args.channel, &slot);
+        } else {
+            channel_receive(args.channel, &slot.data);
+        }
+        for (size_t b = 0; b < size; b += sizeof(uint64_t)) {
+            sum += *(uint64_t*)((char*)slot.data + b);
+        }
+        if (zero_copy) {
+            channel_release(args.channel, slot);
+        } else {
+            free(slot.data);
+        }
+    }
+    uint64_t elapsed = now_ns() - start;
+    pthread_join(producer, NULL);
+    channel_close(args.channel);
+    channel_destroy(args.channel);
+    if (sum == 1) {
+        printf("unreachable\n");
+    }
+    return (double)elapsed / ZERO_COPY_MESSAGES;
+}
+
+/*
+ * Messages built by the producer and read by the consumer, either copied into a heap block whose pointer is
+ * sent, or written and read in place in a byte channel with reserve/commit and peek/release.
+ */
+void bench_zero_copy(void)
+{
+    printf("%d messages from one producer to one consumer (ns per message)\n", ZERO_COPY_MESSAGES);
+    printf("       size  malloc+copy  zero-copy\n");
+    for (size_t i = 0; i < sizeof(zero_copy_sizes) / sizeof(zero_copy_sizes[0]); i++) {
+        double copied = run_zero_copy(zero_copy_sizes[i], false);
+        double in_place = run_zero_copy(zero_copy_sizes[i], true);
+        printf("  %9zu %12.0f %10.0f\n", zero_copy_sizes[i], copied, in_place);
+    }
+}
+
+/* A field of channel_t or buffer_t, and which threads write it once the channel is in use */
+typedef struct {
+    const char* name;
+    size_t offset;
+    const char* writers;
+} layout_field_t;
+
+#define LAYOUT_FIELD(type, field, writers) {#field, offsetof(type, field), writers}
+
+static const layout_field_t channel_fields[] = {
+    LAYOUT_FIELD(channel_t, buffer, "none"),
+    LAYOUT_FIELD(channel_t, closed, "close"),
+    LAYOUT_FIELD(channel_t, attr, "none"),
+    LAYOUT_FIELD(channel_t, mutex, "both, under mutex"),
+    LAYOUT_FIELD(channel_t, sendq, "both, under mutex"),
+    LAYOUT_FIELD(channel_t, recvq, "both, under mutex"),
+    LAYOUT_FIELD(channel_t, full, "receivers parking"),
+    LAYOUT_FIELD(channel_t, recv_waiting, "receivers parking"),
+    LAYOUT_FIELD(channel_t, empty, "senders parking"),
+    LAYOUT_FIELD(channel_t, send_waiting, "senders parking"),
+    LAYOUT_FIELD(channel_t, wait_spin, "both, after a wait"),
+};
+
+static const layout_field_t buffer_fields[] = {
+    LAYOUT_FIELD(buffer_t, capacity, "none"),
+    LAYOUT_FIELD(buffer_t, data, "none"),
+    LAYOUT_FIELD(buffer_t, seq, "none"),
+    LAYOUT_FIELD(buffer_t, reserved, "both, under mutex"),
+    LAYOUT_FIELD(buffer_t, released, "both, under mutex"),
+    LAYOUT_FIELD(buffer_t, head, "receivers"),
+    LAYOUT_FIELD(buffer_t, tail, "senders"),
+};
+
+void print_layout(const char* type, const layout_field_t* fields, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        printf("  %-9s %-13s %6zu %5zu  %s\n", i == 0 ? type : "", fields[i].name, fields[i].offset,
+               fields[i].offset / 64, fields[i].writers);
+    }
+}
+
+#ifdef CHANNEL_PACKED_LAYOUT
+#define LAYOUT_NAME "packed"
+#else
+#define LAYOUT_NAME "padded"
+#endif
+
+#define LAYOUT_MESSAGES 1000000
+#define LAYOUT_CAPACITY 1024
+#define LAYOUT_RUNS 3
+
+void* layout_producer(void* arg)
+{
+    for (size_t i = 0; i < LAYOUT_MESSAGES; i++) {
+        channel_send(arg, (void*)(i + 1));
+    }
+    return NULL;
+}
+
+/* Returns the best ns per message of LAYOUT_RUNS runs in which one thread sends to another through a new channel */
+double run_layout(channel_t* (*create)(size_t))
+{
+    double best = 0;
+    for (int run = 0; run < LAYOUT_RUNS; run++) {
+        channel_t* channel = create(LAYOUT_CAPACITY);
+        pthread_t producer;
+        uintptr_t sum = 0;
+        uint64_t start = now_ns();
+        pthread_create(&producer, NULL, layout_producer, channel);
+        for (size_t n = 0; n < LAYOUT_MESSAGES; n++) {
+            void* data;
+            channel_receive(channel, &data);
+            sum += (uintptr_t)data;
+        }
+        double ns = (double)(now_ns() - start) / LAYOUT_MESSAGES;
+        pthread_join(producer, NULL);
+        channel_close(channel);
+        channel_destroy(channel);
+        if (sum != (uintptr_t)LAYOUT_MESSAGES * (LAYOUT_MESSAGES + 1) / 2) {
+            printf("  lost messages\n");
+        }
+        if (run == 0 || ns < best) {
+            best = ns;
+        }
+    }
+    return best;
+}
+
+/*
+ * Where the hot fields of channel_t and buffer_t sit, which threads write them, and what a message costs
+ * between one producer and one consumer with that layout. `make bench` runs this in channel_bench and in
+ * channel_bench_packed, the same code built without CACHE_LINE_ALIGNED, where head and tail, the mutex and the
+ * parking counters of both sides share lines again; the difference between the two rows is the false sharing.
+ * This stands in for `perf c2c`, which is not available everywhere: a field whose line is also written by the
+ * other side is what c2c would report as HITM loads. The layouts only differ in time when the producer and the
+ * consumer run on different cores.
+ */
+void bench_cache_lines(void)
+{
+    printf("Field layout (offset and 64-byte line) of the %s build; the channel's buffer follows it in the same "
+           "allocation\n", LAYOUT_NAME);
+    printf("  type      field         offset  line  written by\n");
+    print_layout("channel_t", channel_fields, sizeof(channel_fields) / sizeof(channel_fields[0]));
+    print_layout("buffer_t", buffer_fields, sizeof(buffer_fields) / sizeof(buffer_fields[0]));
+    channel_t* channel = channel_create_spsc(LAYOUT_CAPACITY);
+    printf("  channel at +%zu, buffer_t at +%zu and its slots at +%zu bytes from the start of one allocation\n",
+           (size_t)((char*)channel - (char*)buffer_prefix(channel->buffer)),
+           (size_t)((char*)channel->buffer - (char*)channel),
+           (size_t)((char*)channel->buffer->data - (char*)channel));
+    channel_close(channel);
+    channel_destroy(channel);
+
+    printf("\n%d messages from one producer to one consumer through %d slots (ns per message, best of %d), "
+           "%ld CPUs online\n", LAYOUT_MESSAGES, LAYOUT_CAPACITY, LAYOUT_RUNS, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("  layout    locked    spsc    mpmc\n");
+    double locked = run_layout(channel_create);
+    double spsc = run_layout(channel_create_spsc);
+    double mpmc = run_layout(channel_create_mpmc);
+    printf("  %-8s %7.1f %7.1f %7.1f\n", LAYOUT_NAME, locked, spsc, mpmc);
+}
+
+#define RING_ROUNDS 2000000
+
+static const size_t ring_capacities[] = {100, 128, 1000, 1024};
+
+/* Returns the ns per add+remove pair, keeping the ring half full so that the indices keep wrapping */
+double run_ring(size_t capacity, bool through_channel)
+{
+    channel_t* channel = channel_create(capacity);
+    buffer_t* buffer = channel->buffer;
+    uintptr_t sum = 0;
+    void* data;
+    for (size_t i = 0; i < capacity / 2; i++) {
+        buffer_add(buffer, (void*)(i + 1));
+    }
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < RING_ROUNDS; i++) {
+        if (through_channel) {
+            channel_non_blocking_send(channel, (void*)(i + 1));
+            channel_non_blocking_receive(channel, &data);
+        } else {
+            buffer_add(buffer, (void*)(i + 1));
+            buffer_remove(buffer, &data);
+        }
+        sum += (uintptr_t)data;
+    }
+    uint64_t elapsed = now_ns() - start;
+    while (buffer_remove(buffer, &data) == BUFFER_SUCCESS) {
+    }
+    channel_close(channel);
+    channel_destroy(channel);
+    if (sum == 0) {
+        printf("unreachable\n");
+    }
+    return (double)elapsed / RING_ROUNDS;
+}
+
+/* The locked ring on its own and behind the channel mutex, for capacities that are and are not powers of two */
+void bench_ring_indexing(void)
+{
+    printf("%d add/remove pairs on one thread (ns per pair)\n", RING_ROUNDS);
+    printf("   capacity  buffer  channel\n");
+    for (size_t i = 0; i < sizeof(ring_capacities) / sizeof(ring_capacities[0]); i++) {
+        double ring = run_ring(ring_capacities[i], false);
+        double channel = run_ring(ring_capacities[i], true);
+        printf("  %9zu %7.1f %8.1f\n", ring_capacities[i], ring, channel);
+    }
+}
+
+#define ELASTIC_CHANNELS 1000
+#define ELASTIC_MAX 4096
+#define ELASTIC_MIN 16
+#define ELASTIC_BURST 1024
+#define ELASTIC_TRICKLE 2048
+
+/* Returns the KiB of slots held by all channels */
+double slot_kib(channel_t** channels)
+{
+    size_t slots = 0;
+    for (size_t i = 0; i < ELASTIC_CHANNELS; i++) {
+        slots += buffer_capacity(channels[i]->buffer);
+    }
+    return (double)(slots * sizeof(void*)) / 1024;
+}
+
+/*
+ * Many channels sized for a worst-case burst of ELASTIC_MAX messages: each takes one burst, then a trickle of
+ * single messages. Fixed channels hold their full buffer throughout; elastic ones start at ELASTIC_MIN slots,
+ * grow for the burst and shrink back during the trickle.
+ */
+void bench_elastic(void)
+{
+    printf("%d channels of up to %d messages, one burst of %d then %d single messages each\n", ELASTIC_CHANNELS,
+           ELASTIC_MAX, ELASTIC_BURST, ELASTIC_TRICKLE);
+    printf("             KiB of slots: created  after burst  after trickle  burst ns/msg  mallocs\n");
+    for (int elastic = 0; elastic < 2; elastic++) {
+        channel_t** channels = malloc(ELASTIC_CHANNELS * sizeof(channel_t*));
+        for (size_t i = 0; i < ELASTIC_CHANNELS; i++) {
+            channels[i] = elastic ? channel_create_elastic(ELASTIC_MIN, ELASTIC_MAX) : channel_create(ELASTIC_MAX);
+        }
+        double created = slot_kib(channels);
+        size_t allocs_before = atomic_load(&allocations);
+        void* data;
+        uint64_t start = now_ns();
+        for (size_t i = 0; i < ELASTIC_CHANNELS; i++) {
+            for (size_t n = 0; n < ELASTIC_BURST; n++) {
+                channel_non_blocking_send(channels[i], (void*)(n + 1));
+            }
+        }
+        double burst_ns = (double)(now_ns() - start) / (ELASTIC_CHANNELS * ELASTIC_BURST);
+        double burst = slot_kib(channels);
+        for (size_t i = 0; i < ELASTIC_CHANNELS; i++) {
+            while (channel_non_blocking_receive(channels[i], &data) == SUCCESS) {
+            }
+            for (size_t n = 0; n < ELASTIC_TRICKLE; n++) {
+                channel_non_blocking_send(channels[i], (void*)(n + 1));
+                channel_non_blocking_receive(channels[i], &data);
+            }
+        }
+        double trickle = slot_kib(channels);
+        size_t allocs = atomic_load(&allocations) - allocs_before;
+        printf("  %-11s %21.0f %12.0f %14.0f %13.1f %8zu\n", elastic ? "elastic" : "fixed", created, burst, trickle,
+               burst_ns, allocs);
+        for (size_t i = 0; i < ELASTIC_CHANNELS; i++) {
+            channel_close(channels[i]);
+            channel_destroy(channels[i]);
+        }
+        free(channels);
+    }
+}
+
+bench_t benches[] = {{"bench_select_fairness", bench_select_fairness},
+                     {"bench_select_allocations", bench_select_allocations},
+                     {"bench_select_cleanup", bench_select_cleanup},
+                     {"bench_pool", bench_pool},
+                     {"bench_sharded_fan_in", bench_sharded_fan_in},
+                     {"bench_broadcast", bench_broadcast},
+                     {"bench_typed_values", bench_typed_values},
+                     {"bench_zero_copy", bench_zero_copy},
+                     {"bench_cache_lines", bench_cache_lines},
+                     {"bench_ring_indexing", bench_ring_indexing},
+                     {"bench_elastic", bench_elastic}};
+
+int main(int argc, char** argv)
+{
+    size_t num_benches = sizeof(benches) / sizeof(bench_t);
+    bool found = false;
+    for (size_t i = 0; i < num_benches; i++) {
+        if (argc > 1 && strcmp(argv[1], benches[i].name) != 0) {
+            continue;
+        }
+        found = true;
+        printf("Running benchmark: %s\n", benches[i].name);
+        benches[i].bench();
+        printf("\n");
+    }
+    if (!found) {
+        printf("No benchmark named %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,279 @@
+#include "broadcast.h"
+#include <sched.h>
+#include <stdint.h>
+
+/*
+ * A publish writes one slot and bumps head; a receive reads the slot at the subscriber's cursor and moves the
+ * cursor. With BROADCAST_BLOCK a slot may only be reused once every subscriber that was there when it was
+ * published has read it, which its unread count tracks, so neither side ever looks at the other subscribers.
+ * With BROADCAST_DROP slots are reused regardless, and a subscriber that finds its cursor more than capacity
+ * behind head jumps to the oldest message still in the ring.
+ *
+ * Publishers take mutex, subscribers do not: head is stored with release after the slot is written, so a
+ * subscriber that reads head with acquire can read every slot before it. A BROADCAST_BLOCK slot cannot change
+ * until the subscriber has counted its read; a BROADCAST_DROP one can, so the publisher marks it invalid
+ * before writing data, and the subscriber checks seq before and after reading data, like a seqlock.
+ *
+ * Sleeping goes through mutex, with counts of who waits: waking all subscribers on every publish, or a
+ * blocked publisher on every read, would make each message cost a round of context switches once the ring
+ * runs full. A publisher counts itself in publishers_waiting before checking its slot once more, and a
+ * subscriber reads publishers_waiting after counting its read, all sequentially consistent, so one of them
+ * sees the other. Both sides also yield once before they sleep: when they share a CPU, a publisher that sleeps
+ * as soon as the ring is full is woken by the first read and preempts the subscriber to publish one message,
+ * and subscribers that sleep as soon as they are caught up are all woken by the next publish.
+ */
+
+// Creates a broadcast channel that keeps up to capacity messages
+broadcast_t* broadcast_create(size_t capacity, enum broadcast_policy policy)
+{
+    if(capacity == 0)
+        return NULL;
+    broadcast_t* broadcast = (broadcast_t*) malloc(sizeof(broadcast_t));
+    if(broadcast == NULL)
+        return NULL;
+    broadcast->slots = (broadcast_slot_t*) calloc(capacity, sizeof(broadcast_slot_t));
+    if(broadcast->slots == NULL){
+        free(broadcast);
+        return NULL;
+    }
+    pthread_mutex_init(&broadcast->mutex, NULL);
+    futex_cond_init(&broadcast->published);
+    futex_cond_init(&broadcast->drained);
+    broadcast->capacity = capacity;
+    broadcast->policy = policy;
+    atomic_init(&broadcast->head, 0);
+    atomic_init(&broadcast->closed, false);
+    broadcast->subscribers = 0;
+    broadcast->receivers_waiting = 0;
+    broadcast->wake_generation = 0;
+    atomic_init(&broadcast->publishers_waiting, 0);
+    atomic_init(&broadcast->drain_target, 0);
+    return broadcast;
+}
+
+// Subscribes to the messages published from now on
+broadcast_sub_t* broadcast_subscribe(broadcast_t* broadcast)
+{
+    if(broadcast == NULL)
+        return NULL;
+    broadcast_sub_t* sub = (broadcast_sub_t*) malloc(sizeof(broadcast_sub_t));
+    if(sub == NULL)
+        return NULL;
+    pthread_mutex_lock(&broadcast->mutex);
+    if(atomic_load(&broadcast->closed)){
+        pthread_mutex_unlock(&broadcast->mutex);
+        free(sub);
+        return NULL;
+    }
+    sub->broadcast = broadcast;
+    sub->cursor = atomic_load_explicit(&broadcast->head, memory_order_relaxed);
+    sub->dropped = 0;
+    broadcast->subscribers++;
+    pthread_mutex_unlock(&broadcast->mutex);
+    return sub;
+}
+
+/* Counts a read of message seq; returns true if that read is the one blocked publishers wait for */
+static bool broadcast_slot_read(broadcast_t* broadcast, size_t seq)
+{
+    if(broadcast->policy != BROADCAST_BLOCK)
+        return false;
+    return atomic_fetch_sub(&broadcast->slots[seq % broadcast->capacity].unread, 1) == 1
+        && atomic_load(&broadcast->publishers_waiting) > 0 && seq == atomic_load(&broadcast->drain_target);
+}
+
+// Ends the subscription and frees it
+void broadcast_unsubscribe(broadcast_sub_t* sub)
+{
+    if(sub == NULL)
+        return;
+    broadcast_t* broadcast = sub->broadcast;
+    pthread_mutex_lock(&broadcast->mutex);
+    bool drained = false;
+    size_t head = atomic_load_explicit(&broadcast->head, memory_order_relaxed);
+    for(size_t seq = sub->cursor; seq < head; seq++)
+        drained |= broadcast_slot_read(broadcast, seq);
+    if(drained)
+        futex_cond_broadcast(&broadcast->drained);
+    broadcast->subscribers--;
+    pthread_mutex_unlock(&broadcast->mutex);
+    free(sub);
+}
+
+static enum channel_status broadcast_publish_internal(broadcast_t* broadcast, void* data, bool blocking)
+{
+    if(broadcast == NULL)
+        return GEN_ERROR;
+    bool yielded = false;
+    pthread_mutex_lock(&broadcast->mutex);
+    /* Only publishers write head, and they hold mutex */
+    size_t head = atomic_load_explicit(&broadcast->head, memory_order_relaxed);
+    broadcast_slot_t* slot = &broadcast->slots[head % broadcast->capacity];
+    while(!atomic_load(&broadcast->closed) && broadcast->policy == BROADCAST_BLOCK && atomic_load(&slot->unread) > 0){
+        if(!blocking){
+            pthread_mutex_unlock(&broadcast->mutex);
+            return CHANNEL_FULL;
+        }
+        /* Let subscribers drain the ring before sleeping, or each freed slot costs a wakeup (see above) */
+        if(!yielded){
+            yielded = true;
+            pthread_mutex_unlock(&broadcast->mutex);
+            sched_yield();
+            pthread_mutex_lock(&broadcast->mutex);
+            head = atomic_load_explicit(&broadcast->head, memory_order_relaxed);
+            slot = &broadcast->slots[head % broadcast->capacity];
+            continue;
+        }
+        atomic_store(&broadcast->drain_target, head - broadcast->capacity);
+        atomic_fetch_add(&broadcast->publishers_waiting, 1);
+        if(atomic_load(&slot->unread) > 0)
+            futex_cond_wait(&broadcast->drained, &broadcast->mutex);
+        atomic_fetch_sub(&broadcast->publishers_waiting, 1);
+        head = atomic_load_explicit(&broadcast->head, memory_order_relaxed);
+        slot = &broadcast->slots[head % broadcast->capacity];
+    }
+    if(atomic_load(&broadcast->closed)){
+        pthread_mutex_unlock(&broadcast->mutex);
+        return CLOSED_ERROR;
+    }
+    atomic_store_explicit(&slot->seq, SIZE_MAX, memory_order_relaxed);
+    atomic_store_explicit(&slot->data, data, memory_order_release);
+    atomic_store_explicit(&slot->seq, head, memory_order_release);
+    atomic_store_explicit(&slot->unread, broadcast->subscribers, memory_order_relaxed);
+    atomic_store_explicit(&broadcast->head, head + 1, memory_order_release);
+    if(broadcast->receivers_waiting > 0){
+        broadcast->receivers_waiting = 0;
+        broadcast->wake_generation++;
+        futex_cond_broadcast(&broadcast->published);
+    }
+    pthread_mutex_unlock(&broadcast->mutex);
+    return SUCCESS;
+}
+
+// Publishes data to every subscriber
+enum channel_status broadcast_publish(broadcast_t* broadcast, void* data)
+{
+    return broadcast_publish_internal(broadcast, data, true);
+}
+
+// Non-blocking version of broadcast_publish
+enum channel_status broadcast_non_blocking_publish(broadcast_t* broadcast, void* data)
+{
+    return broadcast_publish_internal(broadcast, data, false);
+}
+
+/* Sleeps until a message after the subscriber's cursor is published or the broadcast channel is closed */
+static void broadcast_wait(broadcast_sub_t* sub)
+{
+    broadcast_t* broadcast = sub->broadcast;
+    pthread_mutex_lock(&broadcast->mutex);
+    if(atomic_load(&broadcast->head) == sub->cursor && !atomic_load(&broadcast->closed)){
+        size_t generation = broadcast->wake_generation;
+        broadcast->receivers_waiting++;
+        futex_cond_wait(&broadcast->published, &broadcast->mutex);
+        /* Not woken by a publish or close, which would have uncounted it */
+        if(broadcast->wake_generation == generation)
+            broadcast->receivers_waiting--;
+    }
+    pthread_mutex_unlock(&broadcast->mutex);
+}
+
+static enum channel_status broadcast_receive_internal(broadcast_sub_t* sub, void** data, bool blocking)
+{
+    if(sub == NULL)
+        return GEN_ERROR;
+    broadcast_t* broadcast = sub->broadcast;
+    bool yielded = false;
+    while(true){
+        size_t head = atomic_load_explicit(&broadcast->head, memory_order_acquire);
+        if(sub->cursor == head){
+            /* Whatever was published before the close is visible once closed is */
+            if(atomic_load(&broadcast->closed)){
+                if(atomic_load(&broadcast->head) == sub->cursor)
+                    return CLOSED_ERROR;
+                continue;
+            }
+            if(!blocking)
+                return CHANNEL_EMPTY;
+            /* Let the publisher fill the ring before sleeping, or each message costs a wakeup (see above) */
+            if(!yielded){
+                yielded = true;
+                sched_yield();
+                continue;
+            }
+            broadcast_wait(sub);
+            yielded = false;
+            continue;
+        }
+        if(head - sub->cursor > broadcast->capacity){
+            sub->dropped += head - broadcast->capacity - sub->cursor;
+            sub->cursor = head - broadcast->capacity;
+        }
+        broadcast_slot_t* slot = &broadcast->slots[sub->cursor % broadcast->capacity];
+        if(broadcast->policy == BROADCAST_DROP){
+            if(atomic_load_explicit(&slot->seq, memory_order_acquire) != sub->cursor){
+                /* Overwritten, or being overwritten by a publisher that has not moved head yet */
+                sched_yield();
+                continue;
+            }
+            *data = atomic_load_explicit(&slot->data, memory_order_acquire);
+            if(atomic_load_explicit(&slot->seq, memory_order_relaxed) != sub->cursor)
+                continue;
+        } else {
+            *data = atomic_load_explicit(&slot->data, memory_order_relaxed);
+        }
+        if(broadcast_slot_read(broadcast, sub->cursor)){
+            pthread_mutex_lock(&broadcast->mutex);
+            futex_cond_broadcast(&broadcast->drained);
+            pthread_mutex_unlock(&broadcast->mutex);
+        }
+        sub->cursor++;
+        return SUCCESS;
+    }
+}
+
+// Receives the subscription's next message into data, blocking until one is published
+enum channel_status broadcast_receive(broadcast_sub_t* sub, void** data)
+{
+    return broadcast_receive_internal(sub, data, true);
+}
+
+// Non-blocking version of broadcast_receive
+enum channel_status broadcast_non_blocking_receive(broadcast_sub_t* sub, void** data)
+{
+    return broadcast_receive_internal(sub, data, false);
+}
+
+// Closes the broadcast channel
+enum channel_status broadcast_close(broadcast_t* broadcast)
+{
+    if(broadcast == NULL)
+        return GEN_ERROR;
+    pthread_mutex_lock(&broadcast->mutex);
+    if(atomic_load(&broadcast->closed)){
+        pthread_mutex_unlock(&broadcast->mutex);
+        return CLOSED_ERROR;
+    }
+    atomic_store(&broadcast->closed, true);
+    broadcast->receivers_waiting = 0;
+    broadcast->wake_generation++;
+    futex_cond_broadcast(&broadcast->published);
+    futex_cond_broadcast(&broadcast->drained);
+    pthread_mutex_unlock(&broadcast->mutex);
+    return SUCCESS;
+}
+
+// Frees the broadcast channel
+enum channel_status broadcast_destroy(broadcast_t* broadcast)
+{
+    if(broadcast == NULL)
+        return GEN_ERROR;
+    if(!atomic_load(&broadcast->closed))
+        return DESTROY_ERROR;
+    if(broadcast->subscribers > 0)
+        return GEN_ERROR;
+    pthread_mutex_destroy(&broadcast->mutex);
+    free(broadcast->slots);
+    free(broadcast);
+    return SUCCESS;
+}
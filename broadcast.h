@@ -0,0 +1,102 @@
+#ifndef BROADCAST_H
+#define BROADCAST_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "channel.h"
+#include "futex.h"
+
+// Defines what a publish does when the ring is full of messages some subscriber has not read yet
+enum broadcast_policy {
+    // Wait for the slowest subscriber (backpressure)
+    BROADCAST_BLOCK,
+    // Overwrite the oldest message; a subscriber that falls behind skips what it missed and counts it in dropped
+    BROADCAST_DROP
+};
+
+// Slot of the ring; seq is the number of the message it holds, and unread counts the subscribers that still
+// have to read it, which is only kept for BROADCAST_BLOCK
+typedef struct {
+    _Atomic(void*) data;
+    atomic_size_t seq;
+    atomic_size_t unread;
+} broadcast_slot_t;
+
+// Defines a broadcast channel: every subscriber receives every message published after it subscribed
+// Messages are stored once in a shared ring and each subscriber keeps its own read cursor into it, so a
+// publish costs the same whatever the number of subscribers, and subscribers only take mutex to sleep
+typedef struct {
+    // mutex serializes publishers, subscriptions and sleeping; published is signalled on a publish when
+    // subscribers wait and on close, drained when message drain_target has been read by everyone
+    pthread_mutex_t mutex;
+    futex_cond_t published;
+    futex_cond_t drained;
+    broadcast_slot_t* slots;
+    size_t capacity;
+    enum broadcast_policy policy;
+    // Sequence number of the next message published; message n lives in slots[n % capacity]
+    atomic_size_t head;
+    atomic_bool closed;
+    // The fields below are protected by mutex
+    size_t subscribers;
+    // Subscribers waiting on published since the last wakeup, which wake_generation counts; a publish only
+    // wakes them if there are any, so publishes until the woken subscribers run cost no system call
+    size_t receivers_waiting;
+    size_t wake_generation;
+    // Publishers waiting on drained, and the message whose slot they wait for, so that only the last read of
+    // that message wakes them; both are read by subscribers without mutex
+    atomic_size_t publishers_waiting;
+    atomic_size_t drain_target;
+} broadcast_t;
+
+// Defines a subscription, which only its owner thread may use
+typedef struct {
+    broadcast_t* broadcast;
+    // Sequence number of the next message to receive
+    size_t cursor;
+    // Number of messages overwritten before this subscriber could receive them (BROADCAST_DROP only)
+    size_t dropped;
+} broadcast_sub_t;
+
+// Creates a broadcast channel that keeps up to capacity messages
+// Returns NULL if capacity is 0 or on any other error
+broadcast_t* broadcast_create(size_t capacity, enum broadcast_policy policy);
+
+// Subscribes to the messages published from now on
+// Returns NULL if the broadcast channel is closed or on any other error
+broadcast_sub_t* broadcast_subscribe(broadcast_t* broadcast);
+
+// Ends the subscription and frees it; with BROADCAST_BLOCK its unread messages no longer hold up publishers
+void broadcast_unsubscribe(broadcast_sub_t* sub);
+
+// Publishes data to every subscriber
+// With BROADCAST_BLOCK this blocks while the ring is full of messages a subscriber has not read yet
+// Returns SUCCESS, CLOSED_ERROR if the broadcast channel is closed, and GEN_ERROR on any other error
+enum channel_status broadcast_publish(broadcast_t* broadcast, void* data);
+
+// Non-blocking version of broadcast_publish
+// Returns CHANNEL_FULL where broadcast_publish would block, otherwise the same values as broadcast_publish
+enum channel_status broadcast_non_blocking_publish(broadcast_t* broadcast, void* data);
+
+// Receives the subscription's next message into data, blocking until one is published
+// Unlike channel_receive, messages published before the close are still delivered
+// Returns SUCCESS, CLOSED_ERROR once the broadcast channel is closed and every message was received, and
+// GEN_ERROR on any other error
+enum channel_status broadcast_receive(broadcast_sub_t* sub, void** data);
+
+// Non-blocking version of broadcast_receive
+// Returns CHANNEL_EMPTY where broadcast_receive would block, otherwise the same values as broadcast_receive
+enum channel_status broadcast_non_blocking_receive(broadcast_sub_t* sub, void** data);
+
+// Closes the broadcast channel; blocked publishers return CLOSED_ERROR, and blocked subscribers too once
+// they have received everything
+// Returns SUCCESS, or CLOSED_ERROR if it is already closed
+enum channel_status broadcast_close(broadcast_t* broadcast);
+
+// Frees the broadcast channel, which must be closed and have no subscriptions left
+// Returns SUCCESS, DESTROY_ERROR if it is not closed, and GEN_ERROR if subscriptions are left
+enum channel_status broadcast_destroy(broadcast_t* broadcast);
+
+#endif // BROADCAST_H
@@ -1,31 +1,326 @@
 #include "buffer.h"
+#include <stddef.h>
+#include <string.h>
+
+/*
+ * A buffer is a single cache-line-aligned allocation: the caller's prefix, the buffer_t, the slots, and for
+ * MPMC rings their sequence numbers, each rounded up to whole cache lines so that none of them shares a line
+ * with the next. The slots of a channel thus sit right after its header instead of wherever malloc put them.
+ */
+static size_t buffer_round_line(size_t bytes)
+{
+    return (bytes + _Alignof(buffer_t) - 1) / _Alignof(buffer_t) * _Alignof(buffer_t);
+}
+
+static size_t buffer_mask(size_t capacity)
+{
+    return capacity > 1 && (capacity & (capacity - 1)) == 0 ? capacity - 1 : 0;
+}
+
+// Creates a buffer, and in front of it prefix bytes of storage for the caller, in one allocation
+buffer_t* buffer_create_prefixed(size_t prefix, enum buffer_mode mode, size_t elem_size, size_t capacity, bool bytes)
+{
+    if (bytes) {
+        capacity = (capacity + BUFFER_RECORD_ALIGN - 1) / BUFFER_RECORD_ALIGN * BUFFER_RECORD_ALIGN;
+    }
+    size_t slot_size = bytes ? 1 : elem_size > 0 ? elem_size : sizeof(void*);
+    size_t header = buffer_round_line(prefix);
+    size_t slots = buffer_round_line(capacity * slot_size);
+    size_t seqs = mode == BUFFER_MPMC ? buffer_round_line(capacity * sizeof(atomic_size_t)) : 0;
+    unsigned char* memory = (unsigned char*) aligned_alloc(_Alignof(buffer_t), header + sizeof(buffer_t) + slots + seqs);
+    if (memory == NULL) {
+        return NULL;
+    }
+    buffer_t* buffer = (buffer_t*)(memory + header);
+    unsigned char* storage = (unsigned char*)(buffer + 1);
+    buffer->capacity = capacity;
+    buffer->mask = buffer_mask(capacity);
+    buffer->min_capacity = capacity;
+    buffer->max_capacity = capacity;
+    buffer->mode = mode;
+    buffer->elem_size = bytes ? 0 : elem_size;
+    buffer->bytes = bytes;
+    buffer->prefix = header;
+    buffer->data = NULL;
+    buffer->values = NULL;
+    buffer->seq = NULL;
+    if (bytes || elem_size > 0) {
+        buffer->values = storage;
+    } else {
+        buffer->data = (void**) storage;
+    }
+    if (mode == BUFFER_MPMC) {
+        buffer->seq = (atomic_size_t*)(storage + slots);
+        for (size_t i = 0; i < capacity; i++) {
+            atomic_init(&buffer->seq[i], 2 * i);
+        }
+    }
+    buffer->reserved = 0;
+    buffer->peeked = 0;
+    buffer->released = 0;
+    buffer->quiet = 0;
+    atomic_init(&buffer->head, 0);
+    atomic_init(&buffer->tail, 0);
+    return buffer;
+}
+
+// Returns the storage in front of a buffer made by buffer_create_prefixed
+void* buffer_prefix(buffer_t* buffer)
+{
+    return (unsigned char*)buffer - buffer->prefix;
+}
+
+/* Returns the slot of the free-running ring index pos; a capacity of 1 has mask 0 but only slot 0 anyway */
+static inline size_t buffer_slot(buffer_t* buffer, size_t pos)
+{
+    return buffer->mask != 0 || buffer->capacity == 1 ? pos & buffer->mask : pos % buffer->capacity;
+}
 
 // Creates a buffer with the given capacity
 buffer_t* buffer_create(size_t capacity)
 {
-    buffer_t* buffer = (buffer_t*) malloc(sizeof(buffer_t));
-    void** data  = (void**) malloc(capacity * sizeof(void*));
-    buffer->size = 0;
-    buffer->next = 0;
-    buffer->capacity = capacity;
-    buffer->data = data;
+    return buffer_create_prefixed(0, BUFFER_LOCKED, 0, capacity, false);
+}
+
+// Creates a buffer like buffer_create that grows when full and shrinks back once it stays mostly empty
+buffer_t* buffer_create_elastic(size_t capacity, size_t max_capacity)
+{
+    buffer_t* buffer = buffer_create(capacity);
+    if (buffer != NULL) {
+        buffer_make_elastic(buffer, max_capacity);
+    }
     return buffer;
 }
 
-// Adds the value into the buffer
+// Makes a buffer created like buffer_create elastic, with its current capacity as the minimum
+void buffer_make_elastic(buffer_t* buffer, size_t max_capacity)
+{
+    buffer->max_capacity = max_capacity > buffer->capacity ? max_capacity : buffer->capacity;
+}
+
+// Creates a single-producer/single-consumer buffer with the given capacity
+// Only buffer_spsc_add and buffer_spsc_remove may be used to access its elements
+buffer_t* buffer_create_spsc(size_t capacity)
+{
+    return buffer_create_prefixed(0, BUFFER_SPSC, 0, capacity, false);
+}
+
+// Creates a multi-producer/multi-consumer buffer with the given capacity
+// Only buffer_mpmc_add and buffer_mpmc_remove may be used to access its elements
+buffer_t* buffer_create_mpmc(size_t capacity)
+{
+    return buffer_create_prefixed(0, BUFFER_MPMC, 0, capacity, false);
+}
+
+// Creates a locked buffer that stores capacity elements of elem_size bytes in one contiguous slab
+// Only buffer_add_value and buffer_remove_value may be used to access its elements
+buffer_t* buffer_create_typed(size_t elem_size, size_t capacity)
+{
+    return buffer_create_prefixed(0, BUFFER_LOCKED, elem_size, capacity, false);
+}
+
+/*
+ * Byte buffers: a record is a buffer_record_t header followed by its payload, rounded up so that the next
+ * header stays aligned, and never wraps around the end of the ring. A reservation that does not fit before
+ * the end is preceded by a padding record that fills the rest of the ring. Records go from reserved to
+ * committed when their producer is done writing, to peeked when a consumer takes them, and to released when
+ * that consumer is done; space is only reclaimed from released (and padding) records at the oldest end.
+ */
+enum {
+    BUFFER_RECORD_RESERVED,
+    BUFFER_RECORD_COMMITTED,
+    BUFFER_RECORD_PEEKED,
+    BUFFER_RECORD_RELEASED,
+    BUFFER_RECORD_PADDING
+};
+
+static size_t buffer_record_length(size_t size)
+{
+    return sizeof(buffer_record_t) + (size + BUFFER_RECORD_ALIGN - 1) / BUFFER_RECORD_ALIGN * BUFFER_RECORD_ALIGN;
+}
+
+static buffer_record_t* buffer_record_at(buffer_t* buffer, size_t offset)
+{
+    return (buffer_record_t*)(buffer->values + buffer_slot(buffer, offset));
+}
+
+static buffer_record_t* buffer_record_of(void* payload)
+{
+    return (buffer_record_t*)payload - 1;
+}
+
+// Creates a locked buffer of capacity bytes that holds variable-sized records
+// Only buffer_reserve, buffer_commit, buffer_peek and buffer_release may be used to access its records
+buffer_t* buffer_create_bytes(size_t capacity)
+{
+    return buffer_create_prefixed(0, BUFFER_LOCKED, 0, capacity, true);
+}
+
+// Returns true if a record with a payload of size bytes can ever fit in the byte buffer
+bool buffer_record_fits(buffer_t* buffer, size_t size)
+{
+    return size <= buffer->capacity && buffer_record_length(size) <= buffer->capacity;
+}
+
+// Reserves a record with a payload of size bytes at the end of a byte buffer
+// Returns the payload, or NULL if there is not enough free space right now
+void* buffer_reserve(buffer_t* buffer, size_t size)
+{
+    size_t length = buffer_record_length(size);
+    if (buffer->released == buffer->reserved) {
+        /* Nothing is held, so the ring restarts at its beginning, where even a record of capacity bytes fits */
+        size_t start = buffer->reserved + (buffer->capacity - buffer_slot(buffer, buffer->reserved)) % buffer->capacity;
+        buffer->reserved = buffer->peeked = buffer->released = start;
+    }
+    size_t free_space = buffer->capacity - (buffer->reserved - buffer->released);
+    size_t before_end = buffer->capacity - buffer_slot(buffer, buffer->reserved);
+    size_t padding = length > before_end ? before_end : 0;
+    if (padding + length > free_space) {
+        return NULL;
+    }
+    if (padding > 0) {
+        buffer_record_t* pad = buffer_record_at(buffer, buffer->reserved);
+        pad->size = padding - sizeof(buffer_record_t);
+        pad->state = BUFFER_RECORD_PADDING;
+        buffer->reserved += padding;
+    }
+    buffer_record_t* record = buffer_record_at(buffer, buffer->reserved);
+    record->size = size;
+    record->state = BUFFER_RECORD_RESERVED;
+    buffer->reserved += length;
+    return record + 1;
+}
+
+// Commits a record returned by buffer_reserve, which makes it available to buffer_peek
+void buffer_commit(buffer_t* buffer, void* payload)
+{
+    (void)buffer;
+    buffer_record_of(payload)->state = BUFFER_RECORD_COMMITTED;
+}
+
+// Takes the oldest record of a byte buffer that was not peeked yet and stores its payload size in size
+// Returns its payload, or NULL if there is no such record or it is not committed yet
+void* buffer_peek(buffer_t* buffer, size_t* size)
+{
+    while (buffer->peeked != buffer->reserved) {
+        buffer_record_t* record = buffer_record_at(buffer, buffer->peeked);
+        if (record->state == BUFFER_RECORD_PADDING) {
+            buffer->peeked += sizeof(buffer_record_t) + record->size;
+            continue;
+        }
+        if (record->state != BUFFER_RECORD_COMMITTED) {
+            return NULL;
+        }
+        record->state = BUFFER_RECORD_PEEKED;
+        buffer->peeked += buffer_record_length(record->size);
+        *size = record->size;
+        return record + 1;
+    }
+    return NULL;
+}
+
+// Releases a record returned by buffer_peek; its space is reused once every older record is released too
+void buffer_release(buffer_t* buffer, void* payload)
+{
+    buffer_record_of(payload)->state = BUFFER_RECORD_RELEASED;
+    while (buffer->released != buffer->peeked) {
+        buffer_record_t* record = buffer_record_at(buffer, buffer->released);
+        if (record->state == BUFFER_RECORD_PADDING) {
+            buffer->released += sizeof(buffer_record_t) + record->size;
+        } else if (record->state == BUFFER_RECORD_RELEASED) {
+            buffer->released += buffer_record_length(record->size);
+        } else {
+            break;
+        }
+    }
+}
+
+/*
+ * Locked rings use the same free-running head and tail as the lock-free ones: an add only writes tail and a
+ * remove only head, so neither has to wrap an index or keep a separate count, and with a power-of-two
+ * capacity a slot is found with a mask. The caller's lock orders every access, so they are all relaxed.
+ */
+static inline size_t buffer_locked_size(buffer_t* buffer)
+{
+    return atomic_load_explicit(&buffer->tail, memory_order_relaxed) - atomic_load_explicit(&buffer->head, memory_order_relaxed);
+}
+
+/*
+ * Elastic buffers: the min_capacity slots allocated with the buffer are used whenever the capacity is back at
+ * its minimum, and larger slot arrays come from malloc. A resize copies the stored elements to the start of
+ * the new slots and restarts head at 0, which is fine since the caller's lock excludes every other access.
+ * Growing doubles and shrinking halves, and a buffer only shrinks once it stays at most a quarter full for as
+ * many removes in a row as it has slots, so that one that keeps seeing bursts does not reallocate on each.
+ */
+static bool buffer_resize(buffer_t* buffer, size_t capacity)
+{
+    void** inline_slots = (void**)(buffer + 1);
+    void** data = inline_slots;
+    if (capacity != buffer->min_capacity) {
+        data = (void**) malloc(capacity * sizeof(void*));
+        if (data == NULL) {
+            return false;
+        }
+    }
+    size_t head = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+    size_t size = buffer_locked_size(buffer);
+    size_t pos = buffer_slot(buffer, head);
+    size_t first = buffer->capacity - pos;
+    if (first > size) {
+        first = size;
+    }
+    memcpy(data, &buffer->data[pos], first * sizeof(void*));
+    memcpy(data + first, buffer->data, (size - first) * sizeof(void*));
+    if (buffer->data != inline_slots) {
+        free(buffer->data);
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    buffer->mask = buffer_mask(capacity);
+    buffer->quiet = 0;
+    atomic_store_explicit(&buffer->head, 0, memory_order_relaxed);
+    atomic_store_explicit(&buffer->tail, size, memory_order_relaxed);
+    return true;
+}
+
+/* Doubles the capacity of a full elastic buffer; returns false if it is at max_capacity or out of memory */
+static bool buffer_grow(buffer_t* buffer)
+{
+    if (buffer->capacity >= buffer->max_capacity) {
+        return false;
+    }
+    size_t capacity = buffer->capacity * 2;
+    return buffer_resize(buffer, capacity < buffer->max_capacity ? capacity : buffer->max_capacity);
+}
+
+/* Counts removes from an elastic buffer above its minimum capacity, and halves it after enough quiet ones */
+static void buffer_removed(buffer_t* buffer, size_t count)
+{
+    if (buffer_locked_size(buffer) > buffer->capacity / 4) {
+        buffer->quiet = 0;
+        return;
+    }
+    buffer->quiet += count;
+    if (buffer->quiet >= buffer->capacity) {
+        size_t capacity = buffer->capacity / 2;
+        buffer_resize(buffer, capacity > buffer->min_capacity ? capacity : buffer->min_capacity);
+    }
+}
+
+// Adds the value into the buffer, growing an elastic buffer that is full
 // Returns BUFFER_SUCCESS if the buffer is not full and value was added
 // Returns BUFFER_ERROR otherwise
 enum buffer_status buffer_add(buffer_t* buffer, void* data)
 {
-    if (buffer->size >= buffer->capacity) {
-        return BUFFER_ERROR;
-    }
-    size_t pos = buffer->next + buffer->size;
-    if (pos >= buffer->capacity) {
-        pos -= buffer->capacity;
+    size_t tail = atomic_load_explicit(&buffer->tail, memory_order_relaxed);
+    if (tail - atomic_load_explicit(&buffer->head, memory_order_relaxed) >= buffer->capacity) {
+        if (!buffer_grow(buffer)) {
+            return BUFFER_ERROR;
+        }
+        tail = atomic_load_explicit(&buffer->tail, memory_order_relaxed);
     }
-    buffer->data[pos] = data;
-    buffer->size++;
+    buffer->data[buffer_slot(buffer, tail)] = data;
+    atomic_store_explicit(&buffer->tail, tail + 1, memory_order_relaxed);
     return BUFFER_SUCCESS;
 }
 
@@ -34,23 +329,201 @@ enum buffer_status buffer_add(buffer_t* buffer, void* data)
 // Returns BUFFER_ERROR otherwise
 enum buffer_status buffer_remove(buffer_t* buffer, void **data)
 {
-    if (buffer->size > 0) {
-        *data = buffer->data[buffer->next];
-        buffer->size--;
-        buffer->next++;
-        if (buffer->next >= buffer->capacity) {
-            buffer->next -= buffer->capacity;
+    size_t head = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+    if (head == atomic_load_explicit(&buffer->tail, memory_order_relaxed)) {
+        return BUFFER_ERROR;
+    }
+    *data = buffer->data[buffer_slot(buffer, head)];
+    atomic_store_explicit(&buffer->head, head + 1, memory_order_relaxed);
+    if (buffer->capacity > buffer->min_capacity) {
+        buffer_removed(buffer, 1);
+    }
+    return BUFFER_SUCCESS;
+}
+
+// Copies the elem_size bytes at value into a typed buffer
+// Returns BUFFER_SUCCESS if the buffer is not full and the value was added
+// Returns BUFFER_ERROR otherwise
+enum buffer_status buffer_add_value(buffer_t* buffer, const void* value)
+{
+    size_t tail = atomic_load_explicit(&buffer->tail, memory_order_relaxed);
+    if (tail - atomic_load_explicit(&buffer->head, memory_order_relaxed) >= buffer->capacity) {
+        return BUFFER_ERROR;
+    }
+    memcpy(buffer->values + buffer_slot(buffer, tail) * buffer->elem_size, value, buffer->elem_size);
+    atomic_store_explicit(&buffer->tail, tail + 1, memory_order_relaxed);
+    return BUFFER_SUCCESS;
+}
+
+// Copies the oldest element of a typed buffer to value and removes it
+// Returns BUFFER_SUCCESS if the buffer is not empty and a value was removed
+// Returns BUFFER_ERROR otherwise
+enum buffer_status buffer_remove_value(buffer_t* buffer, void* value)
+{
+    size_t head = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+    if (head == atomic_load_explicit(&buffer->tail, memory_order_relaxed)) {
+        return BUFFER_ERROR;
+    }
+    memcpy(value, buffer->values + buffer_slot(buffer, head) * buffer->elem_size, buffer->elem_size);
+    atomic_store_explicit(&buffer->head, head + 1, memory_order_relaxed);
+    return BUFFER_SUCCESS;
+}
+
+// Adds up to count values from data into the buffer in order
+// The free space is at most two runs of slots, [pos, capacity) and [0, head's slot), each filled with one memcpy
+// Returns the number of values added
+size_t buffer_add_many(buffer_t* buffer, void** data, size_t count)
+{
+    while (buffer->capacity - buffer_locked_size(buffer) < count && buffer_grow(buffer)) {
+    }
+    size_t space = buffer->capacity - buffer_locked_size(buffer);
+    if (count > space) {
+        count = space;
+    }
+    if (count == 0) {
+        return 0;
+    }
+    size_t tail = atomic_load_explicit(&buffer->tail, memory_order_relaxed);
+    size_t pos = buffer_slot(buffer, tail);
+    size_t first = buffer->capacity - pos;
+    if (first > count) {
+        first = count;
+    }
+    memcpy(&buffer->data[pos], data, first * sizeof(void*));
+    memcpy(buffer->data, data + first, (count - first) * sizeof(void*));
+    atomic_store_explicit(&buffer->tail, tail + count, memory_order_relaxed);
+    return count;
+}
+
+// Removes up to count values from the buffer in FIFO order into data
+// The stored values are at most two runs of slots, [pos, capacity) and the wrapped part from 0
+// Returns the number of values removed
+size_t buffer_remove_many(buffer_t* buffer, void** data, size_t count)
+{
+    size_t size = buffer_locked_size(buffer);
+    if (count > size) {
+        count = size;
+    }
+    if (count == 0) {
+        return 0;
+    }
+    size_t head = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+    size_t pos = buffer_slot(buffer, head);
+    size_t first = buffer->capacity - pos;
+    if (first > count) {
+        first = count;
+    }
+    memcpy(data, &buffer->data[pos], first * sizeof(void*));
+    memcpy(data + first, buffer->data, (count - first) * sizeof(void*));
+    atomic_store_explicit(&buffer->head, head + count, memory_order_relaxed);
+    if (buffer->capacity > buffer->min_capacity) {
+        buffer_removed(buffer, count);
+    }
+    return count;
+}
+
+// Adds the value into an SPSC buffer without any locking
+// Must only be called from the single producer thread
+// Returns BUFFER_SUCCESS if the buffer is not full and value was added
+// Returns BUFFER_ERROR otherwise
+enum buffer_status buffer_spsc_add(buffer_t* buffer, void* data)
+{
+    size_t tail = atomic_load_explicit(&buffer->tail, memory_order_relaxed);
+    // acquire pairs with the consumer's release of head so the slot is no longer being read
+    size_t head = atomic_load_explicit(&buffer->head, memory_order_acquire);
+    if (tail - head >= buffer->capacity) {
+        return BUFFER_ERROR;
+    }
+    buffer->data[buffer_slot(buffer, tail)] = data;
+    // release publishes the slot contents before the consumer can see the new tail
+    atomic_store_explicit(&buffer->tail, tail + 1, memory_order_release);
+    return BUFFER_SUCCESS;
+}
+
+// Removes the value from an SPSC buffer in FIFO order without any locking
+// Must only be called from the single consumer thread
+// Returns BUFFER_SUCCESS if the buffer is not empty and a value was removed
+// Returns BUFFER_ERROR otherwise
+enum buffer_status buffer_spsc_remove(buffer_t* buffer, void** data)
+{
+    size_t head = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+    // acquire pairs with the producer's release of tail so the slot contents are visible
+    size_t tail = atomic_load_explicit(&buffer->tail, memory_order_acquire);
+    if (head == tail) {
+        return BUFFER_ERROR;
+    }
+    *data = buffer->data[buffer_slot(buffer, head)];
+    // release hands the slot back to the producer only after it has been read
+    atomic_store_explicit(&buffer->head, head + 1, memory_order_release);
+    return BUFFER_SUCCESS;
+}
+
+/*
+ * MPMC slot protocol: the slot used by position pos holds sequence 2 * pos while it is free for that
+ * position's producer and 2 * pos + 1 once the value is published. The consumer then hands it to the
+ * next lap by storing 2 * (pos + capacity). Doubling keeps "free" and "full" distinct even for capacity 1.
+ */
+
+// Adds the value into an MPMC buffer without any locking
+// May be called concurrently from any number of threads
+// Returns BUFFER_SUCCESS if the buffer is not full and value was added
+// Returns BUFFER_ERROR otherwise
+enum buffer_status buffer_mpmc_add(buffer_t* buffer, void* data)
+{
+    size_t pos = atomic_load_explicit(&buffer->tail, memory_order_relaxed);
+    while (true) {
+        atomic_size_t* seq = &buffer->seq[buffer_slot(buffer, pos)];
+        size_t expected = 2 * pos;
+        size_t current = atomic_load_explicit(seq, memory_order_acquire);
+        if (current == expected) {
+            // claim the position; on failure pos is reloaded with the current tail
+            if (atomic_compare_exchange_weak_explicit(&buffer->tail, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                buffer->data[buffer_slot(buffer, pos)] = data;
+                atomic_store_explicit(seq, expected + 1, memory_order_release);
+                return BUFFER_SUCCESS;
+            }
+        } else if ((ptrdiff_t)(current - expected) < 0) {
+            // slot still holds the value from the previous lap
+            return BUFFER_ERROR;
+        } else {
+            pos = atomic_load_explicit(&buffer->tail, memory_order_relaxed);
+        }
+    }
+}
+
+// Removes the value from an MPMC buffer in FIFO order without any locking
+// May be called concurrently from any number of threads
+// Returns BUFFER_SUCCESS if the buffer is not empty and a value was removed
+// Returns BUFFER_ERROR otherwise
+enum buffer_status buffer_mpmc_remove(buffer_t* buffer, void** data)
+{
+    size_t pos = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+    while (true) {
+        atomic_size_t* seq = &buffer->seq[buffer_slot(buffer, pos)];
+        size_t expected = 2 * pos + 1;
+        size_t current = atomic_load_explicit(seq, memory_order_acquire);
+        if (current == expected) {
+            if (atomic_compare_exchange_weak_explicit(&buffer->head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                *data = buffer->data[buffer_slot(buffer, pos)];
+                atomic_store_explicit(seq, 2 * (pos + buffer->capacity), memory_order_release);
+                return BUFFER_SUCCESS;
+            }
+        } else if ((ptrdiff_t)(current - expected) < 0) {
+            // slot has not been published for this position yet
+            return BUFFER_ERROR;
+        } else {
+            pos = atomic_load_explicit(&buffer->head, memory_order_relaxed);
         }
-        return BUFFER_SUCCESS;
     }
-    return BUFFER_ERROR;
 }
 
 // Frees the memory allocated to the buffer
 void buffer_free(buffer_t *buffer)
 {
-    free(buffer->data);
-    free(buffer);
+    if (buffer->data != NULL && buffer->data != (void**)(buffer + 1)) {
+        free(buffer->data);
+    }
+    free(buffer_prefix(buffer));
 }
 
 // Returns the total capacity of the buffer
@@ -62,7 +535,14 @@ size_t buffer_capacity(buffer_t* buffer)
 // Returns the current number of elements in the buffer
 size_t buffer_current_size(buffer_t* buffer)
 {
-    return buffer->size;
+    if (buffer->mode != BUFFER_LOCKED) {
+        // head is read first so that the difference can never underflow
+        size_t head = atomic_load_explicit(&buffer->head, memory_order_acquire);
+        size_t tail = atomic_load_explicit(&buffer->tail, memory_order_acquire);
+        size_t size = tail - head;
+        return size > buffer->capacity ? buffer->capacity : size;
+    }
+    return buffer_locked_size(buffer);
 }
 
 // Peeks at a value in the buffer
@@ -2,23 +2,121 @@
 #define BUFFER_H
 
 #include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
 
+// Defines how a buffer may be accessed concurrently
+enum buffer_mode {
+    // Plain ring, callers must serialize every access (e.g. with the channel mutex)
+    BUFFER_LOCKED,
+    // Lock-free ring for exactly one producer thread and one consumer thread
+    BUFFER_SPSC,
+    // Lock-free ring with a sequence number per slot, any number of producers and consumers
+    BUFFER_MPMC
+};
+
+// Gives a field a cache line of its own. The benchmark build channel_bench_packed defines CHANNEL_PACKED_LAYOUT,
+// which leaves it empty, so that bench_cache_lines can time the same code with the fields packed together
+#ifdef CHANNEL_PACKED_LAYOUT
+#define CACHE_LINE_ALIGNED
+#else
+#define CACHE_LINE_ALIGNED _Alignas(64)
+#endif
+
+// Fields are grouped by who writes them, so that a producer and a consumer running on different cores do not
+// keep taking each other's cache line: the first line is written only at creation, the byte ring state only
+// under the caller's lock, and head and tail each get a line of their own
 typedef struct {
-    size_t size;
-    size_t next;
     size_t capacity;
+    // capacity - 1 when capacity is a power of two, so that a ring index maps to its slot with a mask instead
+    // of a division; 0 otherwise
+    size_t mask;
+    // Bounds of capacity, both equal to it unless the buffer is elastic; an elastic buffer changes capacity,
+    // mask and data under the caller's lock, and keeps min_capacity slots in its own allocation
+    size_t min_capacity;
+    size_t max_capacity;
     void** data;
+    enum buffer_mode mode;
+    // Per-slot sequence numbers of the MPMC ring, NULL for other modes
+    atomic_size_t* seq;
+    // Typed buffers store elements of elem_size bytes inline in values instead of pointers in data
+    // elem_size is 0 and values NULL for pointer buffers, and data is NULL for typed ones
+    size_t elem_size;
+    unsigned char* values;
+    // Byte buffers store variable-sized records in values, each behind a buffer_record_t header
+    bool bytes;
+    // Distance from the start of the allocation holding the buffer and its slots to the buffer_t (see buffer_create_prefixed)
+    size_t prefix;
+
+    // Byte ring: reserved, peeked and released are free-running byte offsets of the end of the newest
+    // reservation, the next record to peek and the oldest record not released yet
+    size_t reserved;
+    size_t peeked;
+    size_t released;
+    // Elastic buffers: consecutive removes that left at most a quarter of capacity in use
+    size_t quiet;
+
+    // Free-running indices of every ring but the byte ring: the element added n-th is at index n, in slot
+    // n % capacity, and tail - head elements are stored
+    // head is only written by consumers and tail only by producers; locked buffers access them under the lock
+    CACHE_LINE_ALIGNED atomic_size_t head;
+    CACHE_LINE_ALIGNED atomic_size_t tail;
 } buffer_t;
 
+// Header in front of every record of a byte buffer; the records, and so their payloads, are BUFFER_RECORD_ALIGN aligned
+typedef struct {
+    // Payload size, or for a padding record the bytes skipped up to the end of the ring
+    size_t size;
+    // One of the BUFFER_RECORD_* states; only changed under the lock that serializes the buffer
+    size_t state;
+} buffer_record_t;
+
+#define BUFFER_RECORD_ALIGN 16
+
 enum buffer_status {
     BUFFER_SUCCESS = 1,
     BUFFER_ERROR = -1
 };
 
 // Creates a buffer with the given capacity
+// Buffers of every kind find their slots with a mask rather than a division when capacity is a power of two
 buffer_t* buffer_create(size_t capacity);
 
-// Adds the value into the buffer
+// Creates a buffer, and in front of it prefix bytes of cache-line-aligned storage for the caller, in one
+// cache-line-aligned allocation that also holds the slots; buffer_free releases all of it
+// mode and elem_size pick the kind of buffer as in buffer_create, buffer_create_spsc, buffer_create_mpmc and
+// buffer_create_typed (elem_size above 0, BUFFER_LOCKED only); bytes makes it a byte buffer like buffer_create_bytes
+buffer_t* buffer_create_prefixed(size_t prefix, enum buffer_mode mode, size_t elem_size, size_t capacity, bool bytes);
+
+// Returns the storage in front of a buffer made by buffer_create_prefixed
+void* buffer_prefix(buffer_t* buffer);
+
+// Creates a buffer like buffer_create that grows when full instead of failing, doubling its capacity up to
+// max_capacity, and halves it again, down to capacity, once capacity removes in a row left it at most a
+// quarter full; memory for the slots beyond capacity is only allocated while they are needed
+// capacity must be above 0; only buffer_add, buffer_remove, buffer_add_many and buffer_remove_many may be used
+buffer_t* buffer_create_elastic(size_t capacity, size_t max_capacity);
+
+// Makes a buffer created like buffer_create elastic, as in buffer_create_elastic, with its current capacity as the minimum
+void buffer_make_elastic(buffer_t* buffer, size_t max_capacity);
+
+// Creates a single-producer/single-consumer buffer with the given capacity
+// Only buffer_spsc_add and buffer_spsc_remove may be used to access its elements
+buffer_t* buffer_create_spsc(size_t capacity);
+
+// Creates a multi-producer/multi-consumer buffer with the given capacity
+// Only buffer_mpmc_add and buffer_mpmc_remove may be used to access its elements
+buffer_t* buffer_create_mpmc(size_t capacity);
+
+// Creates a locked buffer that stores capacity elements of elem_size bytes in one contiguous slab
+// Only buffer_add_value and buffer_remove_value may be used to access its elements
+buffer_t* buffer_create_typed(size_t elem_size, size_t capacity);
+
+// Creates a locked buffer of capacity bytes (rounded up to BUFFER_RECORD_ALIGN) that holds variable-sized records
+// Only buffer_reserve, buffer_commit, buffer_peek and buffer_release may be used to access its records
+buffer_t* buffer_create_bytes(size_t capacity);
+
+// Adds the value into the buffer, growing an elastic buffer that is full
 // Returns BUFFER_SUCCESS if the buffer is not full and value was added
 // Returns BUFFER_ERROR otherwise
 enum buffer_status buffer_add(buffer_t* buffer, void* data);
@@ -28,10 +126,70 @@ enum buffer_status buffer_add(buffer_t* buffer, void* data);
 // Returns BUFFER_ERROR otherwise
 enum buffer_status buffer_remove(buffer_t* buffer, void** data);
 
+// Copies the elem_size bytes at value into a typed buffer
+// Returns BUFFER_SUCCESS if the buffer is not full and the value was added
+// Returns BUFFER_ERROR otherwise
+enum buffer_status buffer_add_value(buffer_t* buffer, const void* value);
+
+// Copies the oldest element of a typed buffer to value and removes it
+// Returns BUFFER_SUCCESS if the buffer is not empty and a value was removed
+// Returns BUFFER_ERROR otherwise
+enum buffer_status buffer_remove_value(buffer_t* buffer, void* value);
+
+// Returns true if a record with a payload of size bytes can ever fit in the byte buffer
+bool buffer_record_fits(buffer_t* buffer, size_t size);
+
+// Reserves a record with a payload of size bytes at the end of a byte buffer, contiguous in memory
+// Records are handed to buffer_peek in reservation order, each once it is committed
+// Returns the payload, or NULL if there is not enough free space right now
+void* buffer_reserve(buffer_t* buffer, size_t size);
+
+// Commits a record returned by buffer_reserve, which makes it available to buffer_peek
+void buffer_commit(buffer_t* buffer, void* payload);
+
+// Takes the oldest record of a byte buffer that was not peeked yet and stores its payload size in size
+// Returns its payload, or NULL if there is no such record or it is not committed yet
+void* buffer_peek(buffer_t* buffer, size_t* size);
+
+// Releases a record returned by buffer_peek; its space is reused once every older record is released too
+void buffer_release(buffer_t* buffer, void* payload);
+
+// Adds up to count values from data into the buffer in order, copying at most two contiguous segments
+// Returns the number of values added, which is less than count only if the buffer became full
+size_t buffer_add_many(buffer_t* buffer, void** data, size_t count);
+
+// Removes up to count values from the buffer in FIFO order into data, copying at most two contiguous segments
+// Returns the number of values removed, which is less than count only if the buffer became empty
+size_t buffer_remove_many(buffer_t* buffer, void** data, size_t count);
+
+// Adds the value into an SPSC buffer without any locking
+// Must only be called from the single producer thread
+// Returns BUFFER_SUCCESS if the buffer is not full and value was added
+// Returns BUFFER_ERROR otherwise
+enum buffer_status buffer_spsc_add(buffer_t* buffer, void* data);
+
+// Removes the value from an SPSC buffer in FIFO order without any locking
+// Must only be called from the single consumer thread
+// Returns BUFFER_SUCCESS if the buffer is not empty and a value was removed
+// Returns BUFFER_ERROR otherwise
+enum buffer_status buffer_spsc_remove(buffer_t* buffer, void** data);
+
+// Adds the value into an MPMC buffer without any locking
+// May be called concurrently from any number of threads
+// Returns BUFFER_SUCCESS if the buffer is not full and value was added
+// Returns BUFFER_ERROR otherwise
+enum buffer_status buffer_mpmc_add(buffer_t* buffer, void* data);
+
+// Removes the value from an MPMC buffer in FIFO order without any locking
+// May be called concurrently from any number of threads
+// Returns BUFFER_SUCCESS if the buffer is not empty and a value was removed
+// Returns BUFFER_ERROR otherwise
+enum buffer_status buffer_mpmc_remove(buffer_t* buffer, void** data);
+
 // Frees the memory allocated to the buffer
 void buffer_free(buffer_t* buffer);
 
-// Returns the total capacity of the buffer
+// Returns the total capacity of the buffer, which for an elastic buffer is its current one
 size_t buffer_capacity(buffer_t* buffer);
 
 // Returns the current number of elements in the buffer
@@ -1,4 +1,9 @@
 #include "channel.h"
+#include <sched.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 
 /* Reference: Channels Slides posted on Canvas
               Operating Systems: Three Easy Pieces Textbook
@@ -17,15 +22,6 @@ int Pthread_mutex_init(pthread_mutex_t *mutex, pthread_mutexattr_t *attr){
     return 1;
 }
 
-int Pthread_cond_init(pthread_cond_t *cond, pthread_mutexattr_t *attr){
-    int value = pthread_cond_init(cond, NULL);
-    if (value != 0){
-        printf("Error Initializing Condition Variable");
-        return -1;
-    }
-    return 1;
-}
-
 int Pthread_mutex_lock(pthread_mutex_t *mutex){
     int value = pthread_mutex_lock(mutex);
     if (value != 0){
@@ -44,95 +40,487 @@ int Pthread_mutex_unlock(pthread_mutex_t *mutex){
     return 1;
 }
 
-int Pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex){
-    int value = pthread_cond_wait(cond, mutex);
+int Pthread_mutex_destroy(pthread_mutex_t *mutex){
+    int value = pthread_mutex_destroy(mutex);
     if (value != 0){
-        printf("Error Wait");
+        printf("Error Destroying Mutex");
         return -1;
     }
     return 1;
 }
 
+/*
+ * Locked channels park blocked senders and receivers on sendq/recvq. Each queue entry is a channel_waiter_t
+ * living on the blocked thread's stack, with the queue's list node embedded in it so that parking never
+ * allocates. Whoever makes the waiter's operation possible completes it while holding mutex: a sender
+ * stores its message in a parked receiver's data, a receiver takes the message of a parked sender, and
+ * close fails every waiter with CLOSED_ERROR. Only the completed thread is woken and it returns without
+ * touching mutex again.
+ * A select queues one waiter per case, all sharing the select's parker, so that whichever counterpart
+ * claims the parker first completes that case and the select's other waiters become stale.
+ * A select set registers its waiters once and leaves them queued: counterparts skip them while the set is
+ * not waiting (its parker is completed) or the case is disabled, instead of dequeuing them.
+ * Invariant: recvq only holds completable waiters while the buffer is empty, and sendq only while it is full.
+ * Byte channels reuse the queues for reservers and peekers, which are woken all at once and check again.
+ */
+typedef struct channel_waiter {
+    futex_parker_t* parker;
+    // SEND: the message offered to a receiver; RECV: the message handed over by a sender
+    void* data;
+    enum channel_status status;
+    // Position of the case in the select_t array, 0 for send/receive, or the slot of a select set case
+    size_t index;
+    // Set for select set waiters, which stay queued; disabled is only changed under the channel's mutex
+    bool persistent;
+    bool disabled;
+    list_node_t node;
+} channel_waiter_t;
 
-int Pthread_cond_signal(pthread_cond_t *cond){
-    int value = pthread_cond_signal(cond);
-    if (value != 0){
-        printf("Error Signalling Condition Variable");
+/* Parker completion value telling the owner that case index was completed */
+#define WAITER_DONE(index) ((unsigned int)(FUTEX_PARKER_DONE + (index)))
+
+/*
+ * Returns the oldest waiter of queue that may still be completed, or NULL if there is none. One-shot waiters
+ * are dequeued on the way, including stale ones whose select was completed through another case; select set
+ * waiters stay queued and are skipped while their set is not waiting or their case is disabled.
+ */
+static channel_waiter_t* waiter_next(list_t* queue)
+{
+    list_node_t* node = list_begin(queue);
+    while(node != NULL){
+        channel_waiter_t* waiter = list_data(node);
+        list_node_t* next = list_next(node);
+        bool waiting = atomic_load_explicit(&waiter->parker->state, memory_order_relaxed) < FUTEX_PARKER_DONE;
+        if(!waiter->persistent)
+            list_remove(queue, node);
+        if(waiting && !waiter->disabled)
+            return waiter;
+        node = next;
     }
-    return 1;
+    return NULL;
 }
 
-int Pthread_mutex_destroy(pthread_mutex_t *mutex){
-    int value = pthread_mutex_destroy(mutex);
-    if (value != 0){
-        printf("Error Destroying Mutex");
-        return -1;
+/*
+ * Finishes the operation of a waiter returned by waiter_next with status. Returns false if the waiter's select had already been
+ * completed through another case, in which case the operation must be considered not done.
+ * Nothing may touch waiter after a successful completion.
+ */
+static bool waiter_complete(channel_waiter_t* waiter, enum channel_status status)
+{
+    waiter->status = status;
+    return futex_parker_complete(waiter->parker, WAITER_DONE(waiter->index));
+}
+
+/* Hands data straight to the oldest parked receiver; returns false if no receiver is parked */
+static bool channel_handoff(channel_t* channel, void* data)
+{
+    channel_waiter_t* waiter;
+    while((waiter = waiter_next(channel->recvq)) != NULL){
+        waiter->data = data;
+        if(waiter_complete(waiter, SUCCESS))
+            return true;
     }
-    return 1;
+    return false;
 }
 
-int Pthread_cond_destroy(pthread_cond_t *cond){
-    int value = pthread_cond_destroy(cond);
-    if (value != 0){
-        printf("Error Destroying Condition Variable");
-        return -1;
+/* Takes the message of the oldest parked sender and releases it; returns false if no sender is parked */
+static bool channel_take_sender(channel_t* channel, void** data)
+{
+    channel_waiter_t* waiter;
+    while((waiter = waiter_next(channel->sendq)) != NULL){
+        void* value = waiter->data;
+        if(waiter_complete(waiter, SUCCESS)){
+            *data = value;
+            return true;
+        }
     }
-    return 1;
+    return false;
 }
 
-int Pthread_cond_broadcast(pthread_cond_t *cond){
-    int value = pthread_cond_broadcast(cond);
-    if (value != 0){
-        printf("Error Broadcast");
-        return -1;
+/*
+ * Delivers data to a parked receiver or else appends it to the buffer; returns false if neither is possible.
+ * An unbuffered channel's buffer has no slots, so for it this is purely a match against recvq.
+ */
+static bool channel_put(channel_t* channel, void* data)
+{
+    if(channel_handoff(channel, data))
+        return true;
+    return buffer_add(channel->buffer, data) == BUFFER_SUCCESS;
+}
+
+/* Takes the next message from the buffer, refilling the freed slot from a parked sender, or straight from a parked sender */
+static bool channel_take(channel_t* channel, void** data)
+{
+    if(buffer_remove(channel->buffer, data) == BUFFER_SUCCESS){
+        void* next;
+        if(channel_take_sender(channel, &next))
+            buffer_add(channel->buffer, next);
+        return true;
     }
-    return 1;
+    return channel_take_sender(channel, data);
+}
+
+/*
+ * Typed channels copy values instead of passing pointers, through the same queues: a sender's waiter points
+ * at the value it offers and a receiver's at where the value goes, and whoever completes the waiter copies
+ * the value across before waking it, while the owner cannot return. Typed channels are not allowed in a
+ * select, so their waiters are never stale and the copy always stands.
+ */
+/* True for typed and byte channels, whose messages live in the buffer rather than behind a void* */
+static bool channel_stores_inline(channel_t* channel)
+{
+    return channel->elem_size != 0 || channel->buffer->bytes;
+}
+
+static bool channel_put_value(channel_t* channel, const void* value)
+{
+    channel_waiter_t* waiter = waiter_next(channel->recvq);
+    if(waiter != NULL){
+        memcpy(waiter->data, value, channel->elem_size);
+        return waiter_complete(waiter, SUCCESS);
+    }
+    return buffer_add_value(channel->buffer, value) == BUFFER_SUCCESS;
 }
 
-// void remove_all_send(select_t* channel_list, size_t channel_count, pthread_cond_t* select){
-//     for(int i = 0 ; i < channel_count; i++){
-//         channel_t *channel = channel_list[i].channel;
-//         void *data = channel_list[i].data;
-//         Pthread_mutex_lock(&channel->mutex);
-//         list_node_t *node = list_find(channel_list[i].channel->list, data);
-//         list_remove(channel_list[i].channel->list, node);
-//         Pthread_cond_signal(&channel->full);
-//         Pthread_mutex_unlock(&channel->mutex);
-//     } 
-// }
-
-void remove_all(select_t* channel_list, size_t channel_count, pthread_cond_t* select, void* data){
-    for(int i = 0 ; i < channel_count; i++){
-        channel_t *channel = channel_list[i].channel;
-        //void *data = channel_list[i].data;
+static bool channel_take_value(channel_t* channel, void* value)
+{
+    channel_waiter_t* waiter;
+    if(buffer_remove_value(channel->buffer, value) == BUFFER_SUCCESS){
+        if((waiter = waiter_next(channel->sendq)) != NULL){
+            buffer_add_value(channel->buffer, waiter->data);
+            waiter_complete(waiter, SUCCESS);
+        }
+        return true;
+    }
+    if((waiter = waiter_next(channel->sendq)) == NULL)
+        return false;
+    memcpy(value, waiter->data, channel->elem_size);
+    return waiter_complete(waiter, SUCCESS);
+}
+
+/* True if queue holds a waiter that could be completed right now; unlike waiter_next nothing is dequeued */
+static bool queue_waiting(list_t* queue)
+{
+    for(list_node_t* node = list_begin(queue); node != NULL; node = list_next(node)){
+        channel_waiter_t* waiter = list_data(node);
+        if(atomic_load_explicit(&waiter->parker->state, memory_order_relaxed) < FUTEX_PARKER_DONE && !waiter->disabled)
+            return true;
+    }
+    return false;
+}
+
+/* Brings an eventfd's counter in line with ready: 1 while the direction is ready, 0 while it is not */
+static void channel_fd_set(int fd, bool* signalled, bool ready)
+{
+    eventfd_t value;
+    if(fd < 0 || *signalled == ready)
+        return;
+    if(ready)
+        eventfd_write(fd, 1);
+    else
+        eventfd_read(fd, &value);
+    *signalled = ready;
+}
+
+/*
+ * Releases mutex after an operation on a locked channel. Every change of what a receive or send could do
+ * happens under mutex, so refreshing the eventfds from channel_get_fd here keeps them in sync; channels
+ * nobody asked an fd for pay a single branch.
+ */
+static int channel_unlock(channel_t* channel)
+{
+    if(channel->recv_fd >= 0 || channel->send_fd >= 0){
+        size_t size = buffer_current_size(channel->buffer);
+        bool closed = channel->closed;
+        channel_fd_set(channel->recv_fd, &channel->recv_fd_signalled, closed || size > 0 || queue_waiting(channel->sendq));
+        channel_fd_set(channel->send_fd, &channel->send_fd_signalled,
+                       closed || size < channel->buffer->max_capacity || queue_waiting(channel->recvq));
+    }
+    return Pthread_mutex_unlock(&channel->mutex);
+}
+
+/*
+ * Queues waiter on queue, releases mutex and blocks until another thread completes it or deadline passes.
+ * Returns the status the waiter was completed with, or TIMEOUT. The wait policy decides how the waiter's own
+ * futex word is watched, and the phase that saw the completion is counted; a completion that lands between the
+ * last poll and the sleep counts as none, like a lock-free wait the recheck under mutex resolved.
+ * Completers only claim a waiter under mutex, so once the owner holds mutex again after a timeout the
+ * outcome is settled: either the cancel wins and the waiter is still queued, or it was completed just in time.
+ */
+static enum channel_status channel_park(channel_t* channel, list_t* queue, channel_waiter_t* waiter, const struct timespec* deadline)
+{
+    futex_parker_t parker;
+    enum futex_wait_phase phase;
+    unsigned int spin_count = 0, yield_count = 0;
+    futex_parker_init(&parker);
+    waiter->parker = &parker;
+    waiter->index = 0;
+    list_insert_node(queue, &waiter->node, waiter);
+    channel_unlock(channel);
+    if(channel->attr.wait_policy == CHANNEL_WAIT_ADAPTIVE){
+        spin_count = channel->attr.spin_count;
+        yield_count = channel->attr.yield_count;
+    }
+    unsigned int state = futex_parker_wait(&parker, spin_count, yield_count, deadline, &phase);
+    if(phase == FUTEX_WAIT_SPIN)
+        atomic_fetch_add_explicit(&channel->wait_spin, 1, memory_order_relaxed);
+    else if(phase == FUTEX_WAIT_YIELD)
+        atomic_fetch_add_explicit(&channel->wait_yield, 1, memory_order_relaxed);
+    else if(phase == FUTEX_WAIT_PARK)
+        atomic_fetch_add_explicit(&channel->wait_park, 1, memory_order_relaxed);
+    if(state < FUTEX_PARKER_DONE || state == FUTEX_PARKER_CANCELLED){
         Pthread_mutex_lock(&channel->mutex);
-        list_node_t *node = list_find(channel_list[i].channel->list, data);
-        list_remove(channel_list[i].channel->list, node);
-        Pthread_mutex_unlock(&channel->mutex);
+        if(futex_parker_cancel(&parker) == FUTEX_PARKER_CANCELLED){
+            list_remove(queue, &waiter->node);
+            waiter->status = TIMEOUT;
+        }
+        channel_unlock(channel);
     }
+    return waiter->status;
 }
 
-channel_t* channel_create(size_t size)
+/*
+ * Lock-free channels (SPSC and MPMC): senders and receivers move data through the lock-free ring in buffer_t.
+ * mutex, full and empty are only used to park when the ring is full/empty. A parking thread bumps
+ * send_waiting/recv_waiting before rechecking the ring, and the other side checks the count after publishing,
+ * so either the parker sees the new element or the publisher sees the parker and signals it under mutex.
+ */
+/* Orders a publish of head/tail against a read of the waiter count; tsan cannot model fences, so its build uses an RMW */
+static size_t lock_free_waiters(atomic_size_t* waiting)
 {
-    /* IMPLEMENT THIS */
-    /* Initializing all the members of struct channel_t */
-	channel_t* channel = (channel_t *) malloc(sizeof(channel_t));
-	channel->buffer = buffer_create(size);
-    channel->closed = 0;
-    if(Pthread_cond_init(&channel->full, NULL)==-1){
-        return NULL;
+#ifdef __SANITIZE_THREAD__
+    return atomic_fetch_add(waiting, 0);
+#else
+    atomic_thread_fence(memory_order_seq_cst);
+    return atomic_load_explicit(waiting, memory_order_relaxed);
+#endif
+}
+
+static bool lock_free_blocked(buffer_t* buffer, bool want_space)
+{
+    size_t size = buffer_current_size(buffer);
+    return want_space ? size == buffer_capacity(buffer) : size == 0;
+}
+
+/*
+ * The adaptive policy polls the ring itself before parking, since its size can be read without the mutex.
+ * Returns false if deadline passed while the ring was still full/empty.
+ */
+static bool lock_free_park(channel_t* channel, atomic_size_t* waiting, futex_cond_t* cond, bool want_space, const struct timespec* deadline)
+{
+    if(channel->attr.wait_policy == CHANNEL_WAIT_ADAPTIVE){
+        for(unsigned int i = 0; i < channel->attr.spin_count; i++){
+            if(channel->closed || !lock_free_blocked(channel->buffer, want_space)){
+                atomic_fetch_add_explicit(&channel->wait_spin, 1, memory_order_relaxed);
+                return true;
+            }
+            cpu_relax();
+        }
+        for(unsigned int i = 0; i < channel->attr.yield_count; i++){
+            sched_yield();
+            if(channel->closed || !lock_free_blocked(channel->buffer, want_space)){
+                atomic_fetch_add_explicit(&channel->wait_yield, 1, memory_order_relaxed);
+                return true;
+            }
+        }
     }
-    if(Pthread_cond_init(&channel->empty, NULL)==-1){
-        return NULL;
+    Pthread_mutex_lock(&channel->mutex);
+    atomic_fetch_add(waiting, 1);
+    bool ready = true;
+    bool slept = false;
+    while(ready && !channel->closed && lock_free_blocked(channel->buffer, want_space)){
+        slept = true;
+        if(!futex_cond_timedwait(cond, &channel->mutex, deadline))
+            ready = channel->closed || !lock_free_blocked(channel->buffer, want_space);
+    }
+    atomic_fetch_sub(waiting, 1);
+    Pthread_mutex_unlock(&channel->mutex);
+    /* A wait the recheck under mutex resolved never parked */
+    if(slept)
+        atomic_fetch_add_explicit(&channel->wait_park, 1, memory_order_relaxed);
+    return ready;
+}
+
+static void lock_free_wake(channel_t* channel, atomic_size_t* waiting, futex_cond_t* cond)
+{
+    if(lock_free_waiters(waiting) == 0)
+        return;
+    Pthread_mutex_lock(&channel->mutex);
+    futex_cond_signal(cond);
+    Pthread_mutex_unlock(&channel->mutex);
+}
+
+static enum buffer_status lock_free_add(buffer_t* buffer, void* data)
+{
+    if(buffer->mode == BUFFER_SPSC)
+        return buffer_spsc_add(buffer, data);
+    return buffer_mpmc_add(buffer, data);
+}
+
+static enum buffer_status lock_free_remove(buffer_t* buffer, void** data)
+{
+    if(buffer->mode == BUFFER_SPSC)
+        return buffer_spsc_remove(buffer, data);
+    return buffer_mpmc_remove(buffer, data);
+}
+
+static enum channel_status lock_free_send(channel_t* channel, void* data, bool blocking, const struct timespec* deadline)
+{
+    while(true){
+        if(atomic_load_explicit(&channel->closed, memory_order_acquire))
+            return CLOSED_ERROR;
+        if(lock_free_add(channel->buffer, data) == BUFFER_SUCCESS){
+            lock_free_wake(channel, &channel->recv_waiting, &channel->full);
+            return SUCCESS;
+        }
+        if(!blocking)
+            return CHANNEL_FULL;
+        if(!lock_free_park(channel, &channel->send_waiting, &channel->empty, true, deadline))
+            return TIMEOUT;
+    }
+}
+
+static enum channel_status lock_free_receive(channel_t* channel, void** data, bool blocking, const struct timespec* deadline)
+{
+    while(true){
+        if(atomic_load_explicit(&channel->closed, memory_order_acquire))
+            return CLOSED_ERROR;
+        if(lock_free_remove(channel->buffer, data) == BUFFER_SUCCESS){
+            lock_free_wake(channel, &channel->send_waiting, &channel->empty);
+            return SUCCESS;
+        }
+        if(!blocking)
+            return CHANNEL_EMPTY;
+        if(!lock_free_park(channel, &channel->recv_waiting, &channel->full, false, deadline))
+            return TIMEOUT;
     }
+}
+
+/* The channel lives in front of its buffer's slots, in the same allocation (see channel.h) */
+static channel_t* channel_init(enum buffer_mode mode, size_t elem_size, size_t size, bool bytes, const channel_attr_t* attr)
+{
+    buffer_t* buffer = buffer_create_prefixed(sizeof(channel_t), mode, elem_size, size, bytes);
+    if(buffer == NULL)
+        return NULL;
+    channel_t* channel = (channel_t*) buffer_prefix(buffer);
+    channel->buffer = buffer;
+    channel->closed = 0;
+    channel->lock_free = buffer->mode != BUFFER_LOCKED;
+    atomic_init(&channel->send_waiting, 0);
+    atomic_init(&channel->recv_waiting, 0);
+    if(attr == NULL)
+        channel_attr_init(&channel->attr);
+    else
+        channel->attr = *attr;
+    atomic_init(&channel->wait_spin, 0);
+    atomic_init(&channel->wait_yield, 0);
+    atomic_init(&channel->wait_park, 0);
+    channel->recv_fd = -1;
+    channel->send_fd = -1;
+    channel->recv_fd_signalled = false;
+    channel->send_fd_signalled = false;
+    channel->elem_size = buffer->elem_size;
+    futex_cond_init(&channel->full);
+    futex_cond_init(&channel->empty);
 	if(Pthread_mutex_init(&channel->mutex, NULL)==-1){
         return NULL;
     }
-    channel->list = list_create();
-    //channel->size = size;
+    channel->sendq = list_create();
+    channel->recvq = list_create();
+    return channel;
+}
+
+channel_t* channel_create(size_t size)
+{
+    /* IMPLEMENT THIS */
+    /* Initializing all the members of struct channel_t */
+    return channel_init(BUFFER_LOCKED, 0, size, false, NULL);
+}
+
+// Fills attr with the defaults used by channel_create
+void channel_attr_init(channel_attr_t* attr)
+{
+    attr->wait_policy = CHANNEL_WAIT_PARK;
+    attr->spin_count = 200;
+    attr->yield_count = 8;
+}
+
+// Creates a new channel like channel_create, using the wait policy in attr
+channel_t* channel_create_with_attr(size_t size, const channel_attr_t* attr)
+{
+    return channel_init(BUFFER_LOCKED, 0, size, false, attr);
+}
+
+// Copies the counters of how often each wait phase resolved a blocked send/receive into stats
+void channel_get_wait_stats(channel_t* channel, channel_wait_stats_t* stats)
+{
+    stats->spin = atomic_load_explicit(&channel->wait_spin, memory_order_relaxed);
+    stats->yield = atomic_load_explicit(&channel->wait_yield, memory_order_relaxed);
+    stats->park = atomic_load_explicit(&channel->wait_park, memory_order_relaxed);
+}
+
+// Creates a new buffered channel whose buffer grows up to max_size when full and shrinks back once mostly empty
+// Returns NULL if size is 0 or max_size is below size
+channel_t* channel_create_elastic(size_t size, size_t max_size)
+{
+    if(size == 0 || max_size < size)
+        return NULL;
+    channel_t* channel = channel_init(BUFFER_LOCKED, 0, size, false, NULL);
+    if(channel != NULL)
+        buffer_make_elastic(channel->buffer, max_size);
     return channel;
 }
 
+// Creates a new buffered channel for exactly one sending thread and one receiving thread
+// Send and receive complete without taking a lock and only park when the buffer is full or empty
+// Returns NULL if size is 0
+channel_t* channel_create_spsc(size_t size)
+{
+    return channel_create_spsc_with_attr(size, NULL);
+}
+
+// Creates a new SPSC channel like channel_create_spsc, using the wait policy in attr
+channel_t* channel_create_spsc_with_attr(size_t size, const channel_attr_t* attr)
+{
+    if(size == 0)
+        return NULL;
+    return channel_init(BUFFER_SPSC, 0, size, false, attr);
+}
+
+// Creates a new buffered channel whose send/receive complete without taking a lock for any number of threads
+// Threads only park when the buffer is full or empty
+// Returns NULL if size is 0
+channel_t* channel_create_mpmc(size_t size)
+{
+    return channel_create_mpmc_with_attr(size, NULL);
+}
+
+// Creates a new MPMC channel like channel_create_mpmc, using the wait policy in attr
+channel_t* channel_create_mpmc_with_attr(size_t size, const channel_attr_t* attr)
+{
+    if(size == 0)
+        return NULL;
+    return channel_init(BUFFER_MPMC, 0, size, false, attr);
+}
+
+// Creates a new channel that carries values of elem_size bytes rather than void* messages
+// Returns NULL if elem_size is 0
+channel_t* channel_create_typed(size_t elem_size, size_t size)
+{
+    if(elem_size == 0)
+        return NULL;
+    return channel_init(BUFFER_LOCKED, elem_size, size, false, NULL);
+}
+
+// Creates a new channel whose buffer is capacity bytes of records written and read in place
+// Returns NULL if capacity is 0
+channel_t* channel_create_bytes(size_t capacity)
+{
+    if(capacity == 0)
+        return NULL;
+    return channel_init(BUFFER_LOCKED, 0, capacity, true, NULL);
+}
+
 // Writes data to the given channel
 // This is a blocking call i.e., the function only returns on a successful completion of send
 // In case the channel is full, the function waits till the channel has space to write the new data
@@ -141,44 +529,34 @@ channel_t* channel_create(size_t size)
 // GEN_ERROR on encountering any other generic error of any sort
 /* Reference from Textbook: Three Easy Pieces - Consumer Producer Problem */
 enum channel_status channel_send(channel_t *channel, void* data)
+{
+    return channel_send_timeout(channel, data, NULL);
+}
+
+// Writes data to the given channel like channel_send, but waits no longer than deadline
+// Returns TIMEOUT if the data could not be written before deadline, otherwise the same values as channel_send
+/* The untimed send is this with a NULL deadline, so both share one wait path */
+enum channel_status channel_send_timeout(channel_t* channel, void* data, const struct timespec* deadline)
 {
     /* IMPLEMENT THIS */
+    if(channel == NULL || channel_stores_inline(channel))
+        return GEN_ERROR;
+    if(channel->lock_free)
+        return lock_free_send(channel, data, true, deadline);
     Pthread_mutex_lock(&channel->mutex);
     if(channel == NULL)
         return GEN_ERROR;
     if(channel->closed){
-        if(Pthread_mutex_unlock(&channel->mutex)==-1)
+        if(channel_unlock(channel)==-1)
             return GEN_ERROR;
         return CLOSED_ERROR;
     }
-     /* When close function closes the channel from outside and we are still waiting we should check if the channel is close  */
-    while(buffer_add(channel->buffer, data)==-1){
-        if(Pthread_cond_wait(&channel->empty, &channel->mutex)==-1)//Wait till channel not empty
-            return GEN_ERROR;          
-        if(channel->closed){
-            if(Pthread_mutex_unlock(&channel->mutex)==-1)
-                return GEN_ERROR;
-            return CLOSED_ERROR;
-        }
-    }
-    if(Pthread_cond_signal(&channel->full)==-1)
-        return GEN_ERROR;
-
-    if(channel->list->count != 0){
-        list_node_t *temp = channel->list->head;
-
-        while(temp){
-            Pthread_mutex_lock(temp->select_mutex);
-            Pthread_cond_signal(temp->select);
-            Pthread_mutex_unlock(temp->select_mutex);
-            temp = temp->next;
-        }
+    /* A parked receiver gets the message directly; otherwise park until a receiver takes it or the channel closes */
+    if(!channel_put(channel, data)){
+        channel_waiter_t waiter = {.data = data};
+        return channel_park(channel, channel->sendq, &waiter, deadline);
     }
-    if(Pthread_cond_signal(&channel->full)==-1)
-        return GEN_ERROR;
-    //Pthread_cond_signal(&channel->list->head->data);
-    
-    if(Pthread_mutex_unlock(&channel->mutex)==-1)
+    if(channel_unlock(channel)==-1)
         return GEN_ERROR;
     return SUCCESS;
 }
@@ -191,35 +569,34 @@ enum channel_status channel_send(channel_t *channel, void* data)
 // GEN_ERROR on encountering any other generic error of any sort
 /* Reference from Textbook: Three Easy Pieces - Consumer Producer Problem */
 enum channel_status channel_receive(channel_t* channel, void** data)
+{
+    return channel_receive_timeout(channel, data, NULL);
+}
+
+// Reads data from the given channel like channel_receive, but waits no longer than deadline
+// Returns TIMEOUT if no data arrived before deadline, otherwise the same values as channel_receive
+enum channel_status channel_receive_timeout(channel_t* channel, void** data, const struct timespec* deadline)
 {
     /* IMPLEMENT THIS */
+    if(channel == NULL || channel_stores_inline(channel))
+        return GEN_ERROR;
+    if(channel->lock_free)
+        return lock_free_receive(channel, data, true, deadline);
     Pthread_mutex_lock(&channel->mutex);
     if(channel == NULL)
         return GEN_ERROR;
     if(channel->closed){
-        Pthread_mutex_unlock(&channel->mutex);
+        channel_unlock(channel);
         return CLOSED_ERROR;
     }
-    while(buffer_remove(channel->buffer, data)==-1){
-        Pthread_cond_wait(&channel->full, &channel->mutex);
-        if(channel->closed){
-            Pthread_mutex_unlock(&channel->mutex);
-            return CLOSED_ERROR;
-        }
-    }
-    if(channel->list->count != 0){
-        list_node_t *temp = channel->list->head;
-
-        while(temp){
-            Pthread_mutex_lock(temp->select_mutex);
-            Pthread_cond_signal(temp->select);
-            Pthread_mutex_unlock(temp->select_mutex);
-            temp = temp->next;
-        }
+    if(!channel_take(channel, data)){
+        channel_waiter_t waiter = {.data = NULL};
+        enum channel_status status = channel_park(channel, channel->recvq, &waiter, deadline);
+        if(status == SUCCESS)
+            *data = waiter.data;
+        return status;
     }
-    if(Pthread_cond_signal(&channel->empty)==-1)
-        return GEN_ERROR;
-    if(Pthread_mutex_unlock(&channel->mutex)==-1)
+    if(channel_unlock(channel)==-1)
         return GEN_ERROR;
     return SUCCESS;
 }
@@ -237,27 +614,22 @@ enum channel_status channel_receive(channel_t* channel, void** data)
 enum channel_status channel_non_blocking_send(channel_t* channel, void* data)
 {
     /* IMPLEMENT THIS */
+    if(channel == NULL || channel_stores_inline(channel))
+        return GEN_ERROR;
+    if(channel->lock_free)
+        return lock_free_send(channel, data, false, NULL);
     Pthread_mutex_lock(&channel->mutex);
     if(channel == NULL)
         return GEN_ERROR;
     if(channel->closed){
-        Pthread_mutex_unlock(&channel->mutex);
+        channel_unlock(channel);
         return CLOSED_ERROR;
     }
-    if(buffer_add(channel->buffer, data)==-1){
-        Pthread_mutex_unlock(&channel->mutex);      //Was causing error when I was not unlocking in this case
+    if(!channel_put(channel, data)){
+        channel_unlock(channel);      //Was causing error when I was not unlocking in this case
         return CHANNEL_FULL;
     }
-    Pthread_cond_signal(&channel->full);            //Was missing signal here and was waiting for very long in test cases thus failing them
-    list_node_t *temp = channel->list->head;
-    while(temp){
-        Pthread_mutex_lock(temp->select_mutex);
-        Pthread_cond_signal(temp->select);
-        Pthread_mutex_unlock(temp->select_mutex);
-        temp = temp->next;
-        
-    }
-    Pthread_mutex_unlock(&channel->mutex);
+    channel_unlock(channel);
     return SUCCESS;
 }
 
@@ -274,29 +646,309 @@ enum channel_status channel_non_blocking_send(channel_t* channel, void* data)
 enum channel_status channel_non_blocking_receive(channel_t* channel, void** data)
 {
     /* IMPLEMENT THIS */
+    if(channel == NULL || channel_stores_inline(channel))
+        return GEN_ERROR;
+    if(channel->lock_free)
+        return lock_free_receive(channel, data, false, NULL);
 
     Pthread_mutex_lock(&channel->mutex);
     if(channel == NULL)
         return GEN_ERROR;
     if(channel->closed){
-        Pthread_mutex_unlock(&channel->mutex);
+        channel_unlock(channel);
         return CLOSED_ERROR;                        
     }   
-    if(buffer_remove(channel->buffer, data)==-1){
-        Pthread_mutex_unlock(&channel->mutex);          //Earlier error when not unlocking in this if case.
+    if(!channel_take(channel, data)){
+        channel_unlock(channel);          //Earlier error when not unlocking in this if case.
+        return CHANNEL_EMPTY;
+    }
+    channel_unlock(channel);
+    return SUCCESS;
+}
+
+// Writes the n messages in items to the given channel, in order
+// Returns SUCCESS once all n messages are written, CLOSED_ERROR if the channel is closed, and GEN_ERROR on any other error
+/*
+ * Each lock acquisition first hands messages to parked receivers (only possible while the buffer is empty),
+ * then copies as many as fit into the buffer in one go. Only when the buffer is full does the next message
+ * park as an ordinary sender, after which the rest of the batch continues under a fresh lock.
+ */
+enum channel_status channel_send_many(channel_t* channel, void** items, size_t n, size_t* sent)
+{
+    *sent = 0;
+    if(channel == NULL || channel_stores_inline(channel))
+        return GEN_ERROR;
+    if(channel->lock_free){
+        for(; *sent < n; (*sent)++){
+            enum channel_status status = lock_free_send(channel, items[*sent], true, NULL);
+            if(status != SUCCESS)
+                return status;
+        }
+        return SUCCESS;
+    }
+    while(*sent < n){
+        Pthread_mutex_lock(&channel->mutex);
+        if(channel->closed){
+            channel_unlock(channel);
+            return CLOSED_ERROR;
+        }
+        while(*sent < n && channel_handoff(channel, items[*sent]))
+            (*sent)++;
+        *sent += buffer_add_many(channel->buffer, items + *sent, n - *sent);
+        if(*sent == n){
+            channel_unlock(channel);
+            return SUCCESS;
+        }
+        channel_waiter_t waiter = {.data = items[*sent]};
+        enum channel_status status = channel_park(channel, channel->sendq, &waiter, NULL);
+        if(status != SUCCESS)
+            return status;
+        (*sent)++;
+    }
+    return SUCCESS;
+}
+
+// Reads up to max messages from the given channel into out, in order, and stores their number in got
+// Returns SUCCESS for at least one message, CLOSED_ERROR if the channel is closed, and GEN_ERROR on any other error
+/*
+ * Drains the buffer with segment copies; every slot freed that way is refilled from a parked sender, whose
+ * messages are newer than anything buffered, so the next round of the loop picks them up in order.
+ * An unbuffered channel has nothing to drain and takes from its parked senders directly.
+ */
+enum channel_status channel_receive_many(channel_t* channel, void** out, size_t max, size_t* got)
+{
+    *got = 0;
+    if(channel == NULL || channel_stores_inline(channel) || max == 0)
+        return GEN_ERROR;
+    if(channel->lock_free){
+        enum channel_status status = lock_free_receive(channel, &out[0], true, NULL);
+        if(status != SUCCESS)
+            return status;
+        for(*got = 1; *got < max && lock_free_receive(channel, &out[*got], false, NULL) == SUCCESS; (*got)++);
+        return SUCCESS;
+    }
+    Pthread_mutex_lock(&channel->mutex);
+    if(channel->closed){
+        channel_unlock(channel);
+        return CLOSED_ERROR;
+    }
+    while(*got < max){
+        size_t removed = buffer_remove_many(channel->buffer, out + *got, max - *got);
+        *got += removed;
+        if(removed == 0){
+            if(!channel_take_sender(channel, &out[*got]))
+                break;
+            (*got)++;
+            continue;
+        }
+        void* next;
+        for(size_t i = 0; i < removed && channel_take_sender(channel, &next); i++)
+            buffer_add(channel->buffer, next);
+    }
+    if(*got == 0){
+        channel_waiter_t waiter = {.data = NULL};
+        enum channel_status status = channel_park(channel, channel->recvq, &waiter, NULL);
+        if(status == SUCCESS){
+            out[0] = waiter.data;
+            *got = 1;
+        }
+        return status;
+    }
+    channel_unlock(channel);
+    return SUCCESS;
+}
+
+static enum channel_status channel_send_value_internal(channel_t* channel, const void* value, bool blocking)
+{
+    if(channel == NULL || channel->elem_size == 0)
+        return GEN_ERROR;
+    Pthread_mutex_lock(&channel->mutex);
+    if(channel->closed){
+        channel_unlock(channel);
+        return CLOSED_ERROR;
+    }
+    if(channel_put_value(channel, value)){
+        channel_unlock(channel);
+        return SUCCESS;
+    }
+    if(!blocking){
+        channel_unlock(channel);
+        return CHANNEL_FULL;
+    }
+    /* Receivers only read through waiter.data */
+    channel_waiter_t waiter = {.data = (void*) value};
+    return channel_park(channel, channel->sendq, &waiter, NULL);
+}
+
+static enum channel_status channel_receive_value_internal(channel_t* channel, void* value, bool blocking)
+{
+    if(channel == NULL || channel->elem_size == 0)
+        return GEN_ERROR;
+    Pthread_mutex_lock(&channel->mutex);
+    if(channel->closed){
+        channel_unlock(channel);
+        return CLOSED_ERROR;
+    }
+    if(channel_take_value(channel, value)){
+        channel_unlock(channel);
+        return SUCCESS;
+    }
+    if(!blocking){
+        channel_unlock(channel);
         return CHANNEL_EMPTY;
     }
-    Pthread_cond_signal(&channel->empty);            //Was missing signal here and was waiting for very long in test cases thus failing them
-    //Pthread_cond_signa
-    list_node_t *temp = channel->list->head;
-    while(temp){
-        Pthread_mutex_lock(temp->select_mutex);
-        Pthread_cond_signal(temp->select);
-        Pthread_mutex_unlock(temp->select_mutex);
-        temp = temp->next;
-        
+    channel_waiter_t waiter = {.data = value};
+    return channel_park(channel, channel->recvq, &waiter, NULL);
+}
+
+// Copies the elem_size bytes at value into a typed channel, blocking while it is full
+// Returns SUCCESS, CLOSED_ERROR if the channel is closed, and GEN_ERROR if the channel is not typed or on any other error
+enum channel_status channel_send_value(channel_t* channel, const void* value)
+{
+    return channel_send_value_internal(channel, value, true);
+}
+
+// Receives the next value of a typed channel into the elem_size bytes at value, blocking while it is empty
+// Returns SUCCESS, CLOSED_ERROR if the channel is closed, and GEN_ERROR if the channel is not typed or on any other error
+enum channel_status channel_receive_value(channel_t* channel, void* value)
+{
+    return channel_receive_value_internal(channel, value, true);
+}
+
+// Non-blocking version of channel_send_value
+enum channel_status channel_non_blocking_send_value(channel_t* channel, const void* value)
+{
+    return channel_send_value_internal(channel, value, false);
+}
+
+// Non-blocking version of channel_receive_value
+enum channel_status channel_non_blocking_receive_value(channel_t* channel, void* value)
+{
+    return channel_receive_value_internal(channel, value, false);
+}
+
+/*
+ * Byte channels: producers and consumers only hold mutex to claim or hand back a record, and write or read
+ * its payload in place without it. Producers that find no room park on sendq and consumers that find no
+ * committed record on recvq, through a parker like the other locked channels, so that inside a coroutine
+ * only the coroutine waits. A commit or release wakes all of them, since one commit can make several records
+ * visible and one release several reservations possible, and each woken one checks the buffer again. Waiters
+ * yield once before sleeping: the other side usually has more than one record to hand over, and on a shared
+ * CPU a thread that sleeps right away is woken, and preempts it, for every single record.
+ */
+static void channel_bytes_wait(channel_t* channel, list_t* queue)
+{
+    futex_parker_t parker;
+    enum futex_wait_phase phase;
+    futex_parker_init(&parker);
+    channel_waiter_t waiter = {.parker = &parker};
+    list_insert_node(queue, &waiter.node, &waiter);
+    Pthread_mutex_unlock(&channel->mutex);
+    futex_parker_wait(&parker, 0, 1, NULL, &phase);
+    Pthread_mutex_lock(&channel->mutex);
+}
+
+/* Wakes every byte channel waiter parked on queue; the caller holds mutex */
+static void channel_bytes_wake(list_t* queue)
+{
+    channel_waiter_t* waiter;
+    while((waiter = waiter_next(queue)) != NULL)
+        waiter_complete(waiter, SUCCESS);
+}
+
+static enum channel_status channel_reserve_internal(channel_t* channel, size_t size, channel_slot_t* slot, bool blocking)
+{
+    if(channel == NULL || !channel->buffer->bytes || !buffer_record_fits(channel->buffer, size))
+        return GEN_ERROR;
+    Pthread_mutex_lock(&channel->mutex);
+    void* data;
+    while(!channel->closed && (data = buffer_reserve(channel->buffer, size)) == NULL){
+        if(!blocking){
+            Pthread_mutex_unlock(&channel->mutex);
+            return CHANNEL_FULL;
+        }
+        channel_bytes_wait(channel, channel->sendq);
+    }
+    if(channel->closed){
+        Pthread_mutex_unlock(&channel->mutex);
+        return CLOSED_ERROR;
     }
     Pthread_mutex_unlock(&channel->mutex);
+    slot->data = data;
+    slot->size = size;
+    return SUCCESS;
+}
+
+// Reserves size bytes of channel-owned storage in a byte channel, blocking while there is not enough room
+// Returns SUCCESS, CLOSED_ERROR if the channel is closed, and GEN_ERROR if the channel is not a byte channel or
+// size can never fit in it
+enum channel_status channel_reserve(channel_t* channel, size_t size, channel_slot_t* slot)
+{
+    return channel_reserve_internal(channel, size, slot, true);
+}
+
+// Non-blocking version of channel_reserve
+enum channel_status channel_non_blocking_reserve(channel_t* channel, size_t size, channel_slot_t* slot)
+{
+    return channel_reserve_internal(channel, size, slot, false);
+}
+
+// Makes a record filled in after channel_reserve available to channel_peek
+enum channel_status channel_commit(channel_t* channel, channel_slot_t slot)
+{
+    if(channel == NULL || !channel->buffer->bytes)
+        return GEN_ERROR;
+    Pthread_mutex_lock(&channel->mutex);
+    buffer_commit(channel->buffer, slot.data);
+    channel_bytes_wake(channel->recvq);
+    Pthread_mutex_unlock(&channel->mutex);
+    return SUCCESS;
+}
+
+static enum channel_status channel_peek_internal(channel_t* channel, channel_slot_t* slot, bool blocking)
+{
+    if(channel == NULL || !channel->buffer->bytes)
+        return GEN_ERROR;
+    Pthread_mutex_lock(&channel->mutex);
+    void* data;
+    while(!channel->closed && (data = buffer_peek(channel->buffer, &slot->size)) == NULL){
+        if(!blocking){
+            Pthread_mutex_unlock(&channel->mutex);
+            return CHANNEL_EMPTY;
+        }
+        channel_bytes_wait(channel, channel->recvq);
+    }
+    if(channel->closed){
+        Pthread_mutex_unlock(&channel->mutex);
+        return CLOSED_ERROR;
+    }
+    Pthread_mutex_unlock(&channel->mutex);
+    slot->data = data;
+    return SUCCESS;
+}
+
+// Takes the oldest committed record of a byte channel, blocking while there is none
+// Returns SUCCESS, CLOSED_ERROR if the channel is closed, and GEN_ERROR if the channel is not a byte channel
+enum channel_status channel_peek(channel_t* channel, channel_slot_t* slot)
+{
+    return channel_peek_internal(channel, slot, true);
+}
+
+// Non-blocking version of channel_peek
+enum channel_status channel_non_blocking_peek(channel_t* channel, channel_slot_t* slot)
+{
+    return channel_peek_internal(channel, slot, false);
+}
+
+// Hands a record returned by channel_peek back to the channel
+enum channel_status channel_release(channel_t* channel, channel_slot_t slot)
+{
+    if(channel == NULL || !channel->buffer->bytes)
+        return GEN_ERROR;
+    Pthread_mutex_lock(&channel->mutex);
+    buffer_release(channel->buffer, slot.data);
+    channel_bytes_wake(channel->sendq);
+    Pthread_mutex_unlock(&channel->mutex);
     return SUCCESS;
 }
 
@@ -306,8 +958,9 @@ enum channel_status channel_non_blocking_receive(channel_t* channel, void** data
 // CLOSED_ERROR if the channel is already closed, and
 // GEN_ERROR in any other error case
 /*
- * Using pthread_cond_broadcast which wakes all the threads. Changing the closed flag to 0 so that all threads when wake up to
- * updated closed value.
+ * Sets closed under mutex, then completes every waiter parked on sendq and recvq with CLOSED_ERROR, which also wakes
+ * blocked selects and byte-channel reservers and peekers. Lock-free channels park on full/empty instead, so both are
+ * broadcast; their waiters see closed when they take mutex again.
  */
 enum channel_status channel_close(channel_t* channel)
 {
@@ -316,16 +969,37 @@ enum channel_status channel_close(channel_t* channel)
     if(channel == NULL)
         return GEN_ERROR;
     if(channel->closed){
-        Pthread_mutex_unlock(&channel->mutex);
+        channel_unlock(channel);
         return CLOSED_ERROR;
     }
     channel->closed  = 1;
-    Pthread_cond_broadcast(&channel->full);
-    Pthread_cond_broadcast(&channel->empty);
-    Pthread_mutex_unlock(&channel->mutex);
+    channel_waiter_t* waiter;
+    while((waiter = waiter_next(channel->sendq)) != NULL)
+        waiter_complete(waiter, CLOSED_ERROR);
+    while((waiter = waiter_next(channel->recvq)) != NULL)
+        waiter_complete(waiter, CLOSED_ERROR);
+    futex_cond_broadcast(&channel->full);
+    futex_cond_broadcast(&channel->empty);
+    channel_unlock(channel);
     return SUCCESS;
 }
 
+// Returns an eventfd that is readable while a receive (dir RECV) or a send (dir SEND) on the channel would not block
+// Returns -1 for SPSC/MPMC channels or if the eventfd could not be created
+/* The fd is created on first use; syncing it right away under mutex covers whatever happened before */
+int channel_get_fd(channel_t* channel, enum direction dir)
+{
+    if(channel == NULL || channel->lock_free || channel->buffer->bytes)
+        return -1;
+    Pthread_mutex_lock(&channel->mutex);
+    int* fd = dir == RECV ? &channel->recv_fd : &channel->send_fd;
+    if(*fd < 0)
+        *fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    int result = *fd;
+    channel_unlock(channel);
+    return result;
+}
+
 // Frees all the memory allocated to the channel
 // The caller is responsible for calling channel_close and waiting for all threads to finish their tasks before calling channel_destroy
 // Returns SUCCESS if destroy is successful,
@@ -340,16 +1014,174 @@ enum channel_status channel_destroy(channel_t* channel)
     if(channel->closed == 0){
         return DESTROY_ERROR;
     }
-    /* Destroying all the mutex and condition variables initialized. Calling buffer_free function to free the buffer. Also, freeing the memory for channel */
+    /* Destroying all the mutex and condition variables initialized. Calling buffer_free function last, since it frees the channel too */
     Pthread_mutex_destroy(&channel->mutex);
-    Pthread_cond_destroy(&channel->full);
-    Pthread_cond_destroy(&channel->empty);
+    if(channel->recv_fd >= 0)
+        close(channel->recv_fd);
+    if(channel->send_fd >= 0)
+        close(channel->send_fd);
+    list_destroy(channel->sendq);
+    list_destroy(channel->recvq);
     buffer_free(channel->buffer);
-    list_destroy(channel->list);
-    free(channel);
     return SUCCESS;
 }
 
+/* Fills order with the indices of channel_list sorted by channel address */
+static void select_sort(select_t* channel_list, size_t channel_count, size_t* order)
+{
+    for(size_t i = 0; i < channel_count; i++){
+        size_t j = i;
+        while(j > 0 && channel_list[order[j - 1]].channel > channel_list[i].channel){
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+}
+
+/* Locks every distinct channel of the select in address order, so that concurrent selects cannot deadlock */
+static void select_lock(select_t* channel_list, size_t channel_count, size_t* order)
+{
+    for(size_t i = 0; i < channel_count; i++){
+        if(i == 0 || channel_list[order[i]].channel != channel_list[order[i - 1]].channel)
+            Pthread_mutex_lock(&channel_list[order[i]].channel->mutex);
+    }
+}
+
+static void select_unlock(select_t* channel_list, size_t channel_count, size_t* order)
+{
+    for(size_t i = channel_count; i > 0; i--){
+        if(i == 1 || channel_list[order[i - 1]].channel != channel_list[order[i - 2]].channel)
+            channel_unlock(channel_list[order[i - 1]].channel);
+    }
+}
+
+/* A case waits on the queue of the counterparts that can complete it */
+static list_t* select_queue(select_t* entry)
+{
+    return entry->dir == SEND ? entry->channel->sendq : entry->channel->recvq;
+}
+
+/*
+ * Picks where a fair select starts scanning. channel.c keeps no state to seed a generator with, so the
+ * monotonic clock and the caller's stack address are mixed through the splitmix64 finalizer instead.
+ */
+static size_t select_random_start(size_t channel_count)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t x = ((uint64_t)now.tv_sec << 32) ^ (uint64_t)now.tv_nsec ^ (uint64_t)(uintptr_t)&now;
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return (size_t)(x % channel_count);
+}
+
+/*
+ * Performs the first case that is ready, scanning channel_list from start and wrapping around, with every
+ * channel locked. Returns SUCCESS or CLOSED_ERROR with selected_index set, or CHANNEL_EMPTY if no case is ready.
+ */
+static enum channel_status select_poll(select_t* channel_list, size_t channel_count, size_t start, size_t* selected_index)
+{
+    for(size_t k = 0; k < channel_count; k++){
+        size_t i = start + k < channel_count ? start + k : start + k - channel_count;
+        channel_t* channel = channel_list[i].channel;
+        bool done;
+        if(channel->closed){
+            *selected_index = i;
+            return CLOSED_ERROR;
+        }
+        if(channel_list[i].dir == SEND)
+            done = channel_put(channel, channel_list[i].data);
+        else
+            done = channel_take(channel, &channel_list[i].data);
+        if(done){
+            *selected_index = i;
+            return SUCCESS;
+        }
+    }
+    return CHANNEL_EMPTY;
+}
+
+/*
+ * Shared body of channel_select, channel_select_fair, channel_try_select and channel_select_timeout; the
+ * readiness pass starts at case start, and if no case is ready a non-blocking select returns CHANNEL_EMPTY
+ * instead of parking, while a blocking one parks until deadline
+ */
+static enum channel_status select_run(select_t* channel_list, size_t channel_count, size_t start, bool blocking,
+                                      const struct timespec* deadline, size_t* selected_index)
+{
+    /* Lock-free channels have no waiter queues, so a select on them could never be woken; typed and byte ones carry no void* */
+    for(size_t i = 0; i < channel_count; i++){
+        if(channel_list[i].channel->lock_free || channel_stores_inline(channel_list[i].channel)){
+            *selected_index = i;
+            return GEN_ERROR;
+        }
+    }
+    /*
+     * Modelled on Go's selectgo: with every channel locked in address order, one pass either performs a
+     * ready case or queues a waiter for each case, then the select parks once. Nothing can change between
+     * the pass and the enqueue, and the counterpart that claims the shared parker completes its case itself,
+     * so the select only has to lock everything again to take its stale waiters back off the other queues.
+     * Waiters live on this stack frame unless there are too many cases for it.
+     */
+    size_t order_stack[SELECT_STACK_CASES];
+    channel_waiter_t waiters_stack[SELECT_STACK_CASES];
+    size_t* order = order_stack;
+    channel_waiter_t* waiters = waiters_stack;
+    if(channel_count > SELECT_STACK_CASES){
+        order = (size_t*) malloc(channel_count * sizeof(size_t));
+        if(blocking && order != NULL)
+            waiters = (channel_waiter_t*) malloc(channel_count * sizeof(channel_waiter_t));
+        if(order == NULL || waiters == NULL){
+            free(order);
+            return GEN_ERROR;
+        }
+    }
+    select_sort(channel_list, channel_count, order);
+    select_lock(channel_list, channel_count, order);
+    enum channel_status status = select_poll(channel_list, channel_count, start, selected_index);
+    if(status == CHANNEL_EMPTY && blocking){
+        futex_parker_t parker;
+        futex_parker_init(&parker);
+        for(size_t i = 0; i < channel_count; i++){
+            waiters[i].parker = &parker;
+            waiters[i].data = channel_list[i].data;
+            waiters[i].index = i;
+            waiters[i].persistent = false;
+            waiters[i].disabled = false;
+            list_insert_node(select_queue(&channel_list[i]), &waiters[i].node, &waiters[i]);
+        }
+        select_unlock(channel_list, channel_count, order);
+        enum futex_wait_phase phase;
+        unsigned int state = futex_parker_wait(&parker, 0, 0, deadline, &phase);
+        select_lock(channel_list, channel_count, order);
+        if(state < FUTEX_PARKER_DONE)
+            state = futex_parker_cancel(&parker);
+        for(size_t i = 0; i < channel_count; i++){
+            list_t* queue = select_queue(&channel_list[i]);
+            list_remove(queue, &waiters[i].node);
+        }
+        if(state == FUTEX_PARKER_CANCELLED){
+            status = TIMEOUT;
+        } else {
+            size_t index = state - FUTEX_PARKER_DONE;
+            status = waiters[index].status;
+            if(status == SUCCESS && channel_list[index].dir == RECV)
+                channel_list[index].data = waiters[index].data;
+            *selected_index = index;
+        }
+    }
+    select_unlock(channel_list, channel_count, order);
+    if(order != order_stack){
+        if(waiters != waiters_stack)
+            free(waiters);
+        free(order);
+    }
+    return status;
+}
+
 // Takes an array of channels, channel_list, of type select_t and the array length, channel_count, as inputs
 // This API iterates over the provided list and finds the set of possible channels which can be used to invoke the required operation (send or receive) specified in select_t
 // If multiple options are available, it selects the first option and performs its corresponding action
@@ -360,75 +1192,212 @@ enum channel_status channel_destroy(channel_t* channel)
 enum channel_status channel_select(select_t* channel_list, size_t channel_count, size_t* selected_index)
 {
     /* IMPLEMENT THIS */
+    return select_run(channel_list, channel_count, 0, true, NULL, selected_index);
+}
 
-    pthread_mutex_t select_mutex;
-    pthread_cond_t select;
-    void* data = NULL;
-    Pthread_mutex_init(&select_mutex, NULL);
-    Pthread_cond_init(&select, NULL);
-    Pthread_mutex_lock(&select_mutex);
-   for(int i = 0 ; i < channel_count; i++){
-        Pthread_mutex_lock(&channel_list[i].channel->mutex);
-        list_insert(channel_list[i].channel->list, &select_mutex, &select, &data);
-        Pthread_mutex_unlock(&channel_list[i].channel->mutex);
-    }
-   while(true){
-    for(int i = 0 ; i < channel_count; i++){
-        Pthread_mutex_lock(&channel_list[i].channel->mutex);
-        channel_t *channel = channel_list[i].channel; 
-        //Performing SEND 
-        if(channel_list[i].dir == SEND){  
-            data = channel_list[i].data;
-            if(channel->closed){
-            Pthread_mutex_unlock(&channel->mutex);
-                return CLOSED_ERROR;
-            }
-            if(buffer_add(channel->buffer, data) == BUFFER_SUCCESS){
-                pthread_cond_signal(&channel->full);
-                list_node_t *temp = channel->list->head;
-                while(temp){
-                    Pthread_cond_signal(temp->select);
-                    temp = temp->next;
-                }
-                *selected_index = (size_t) i; 
-                list_node_t *node = list_find(channel_list[i].channel->list, data);
-                list_remove(channel_list[i].channel->list, node);
-                Pthread_mutex_unlock(&channel->mutex);
-                remove_all(channel_list, channel_count, &select, data);
-                return SUCCESS;
-            } 
-        }
-        //Performing RECV
-        if(channel_list[i].dir == RECV){
-            if(channel->closed){
-                Pthread_mutex_unlock(&channel->mutex);
-                return CLOSED_ERROR;                        
-            }   
-            if(buffer_remove(channel->buffer, &data) == BUFFER_SUCCESS){
-                channel_list[i].data = data;
-                pthread_cond_signal(&channel->empty);
-                list_node_t *temp = channel->list->head;
-                while(temp){
-                    Pthread_cond_signal(temp->select);
-                    temp = temp->next;
-                }
-                //pthread_cond_signal(&select);
-                //remocve_list;
-                *selected_index = (size_t) i; 
-                list_node_t *node = list_find(channel_list[i].channel->list, data);
-                list_remove(channel_list[i].channel->list, node);
-                pthread_mutex_unlock(&channel->mutex);
-                remove_all(channel_list, channel_count, &select, data);
-                return SUCCESS;
-            }
-        }
-        Pthread_mutex_unlock(&channel->mutex);
+// Like channel_select, but scans the cases from a random start index so that no ready case can be starved
+// Returns the same values as channel_select, or GEN_ERROR if channel_count is 0
+enum channel_status channel_select_fair(select_t* channel_list, size_t channel_count, size_t* selected_index)
+{
+    if(channel_count == 0)
+        return GEN_ERROR;
+    return select_run(channel_list, channel_count, select_random_start(channel_count), true, NULL, selected_index);
+}
+
+// Performs the first ready operation of channel_list like channel_select, but never blocks
+// Returns SUCCESS or CLOSED_ERROR like channel_select, or CHANNEL_EMPTY if no channel is ready
+/* Nothing is queued when no case is ready, so the only per-call state is the lock order on the stack */
+enum channel_status channel_try_select(select_t* channel_list, size_t channel_count, size_t* selected_index)
+{
+    return select_run(channel_list, channel_count, 0, false, NULL, selected_index);
+}
+
+// Like channel_select, but waits no longer than deadline
+// Returns TIMEOUT without performing any operation if no channel became ready before deadline
+enum channel_status channel_select_timeout(select_t* channel_list, size_t channel_count, size_t* selected_index,
+                                           const struct timespec* deadline)
+{
+    return select_run(channel_list, channel_count, 0, true, deadline, selected_index);
+}
+
+/* Swaps the cases at positions a and b of a select set, keeping each case's waiter slot with it */
+static void select_set_swap(select_set_t* set, size_t a, size_t b)
+{
+    select_t entry = set->list[a];
+    set->list[a] = set->list[b];
+    set->list[b] = entry;
+    size_t slot = set->slot[a];
+    set->slot[a] = set->slot[b];
+    set->slot[b] = slot;
+    set->position[set->slot[a]] = a;
+    set->position[set->slot[b]] = b;
+}
+
+static channel_t* select_set_channel(select_set_t* set, size_t slot)
+{
+    return set->list[set->position[slot]].channel;
+}
+
+/* Locks the channels of the enabled cases in address order, or unlocks them */
+static void select_set_lock(select_set_t* set, bool lock)
+{
+    channel_t* last = NULL;
+    for(size_t i = 0; i < set->capacity; i++){
+        size_t slot = set->order[i];
+        channel_t* channel = select_set_channel(set, slot);
+        if(set->waiters[slot].disabled || channel == last)
+            continue;
+        if(lock)
+            Pthread_mutex_lock(&channel->mutex);
+        else
+            channel_unlock(channel);
+        last = channel;
     }
-    Pthread_cond_wait(&select, &select_mutex); 
-   }
-    Pthread_mutex_unlock(&select_mutex);
-    
+}
+
+/* Changes whether the counterparts of a case may complete its waiter, under the case's channel mutex */
+static void select_set_mark(select_set_t* set, size_t position, bool disabled)
+{
+    channel_t* channel = set->list[position].channel;
+    Pthread_mutex_lock(&channel->mutex);
+    set->waiters[set->slot[position]].disabled = disabled;
+    channel_unlock(channel);
+}
+
+/* Frees a select set and whichever of its arrays were allocated; the waiters must not be queued anywhere */
+static void select_set_free(select_set_t* set)
+{
+    free(set->list);
+    free(set->waiters);
+    free(set->slot);
+    free(set->position);
+    free(set->order);
+    free(set);
+}
+
+// Creates a select set from a copy of the channel_count cases in channel_list, all of them enabled
+// Returns NULL if channel_count is 0, a channel is NULL or lock-free, or an allocation fails
+/*
+ * Each case gets a waiter slot that is queued on its channel here and stays there until select_set_destroy.
+ * The set's parker starts out cancelled, so counterparts ignore the waiters until the first select_set_wait.
+ */
+select_set_t* select_set_create(select_t* channel_list, size_t channel_count)
+{
+    if(channel_list == NULL || channel_count == 0)
+        return NULL;
+    for(size_t i = 0; i < channel_count; i++){
+        if(channel_list[i].channel == NULL || channel_list[i].channel->lock_free || channel_stores_inline(channel_list[i].channel))
+            return NULL;
+    }
+    select_set_t* set = (select_set_t*) malloc(sizeof(select_set_t));
+    if(set == NULL)
+        return NULL;
+    set->list = (select_t*) malloc(channel_count * sizeof(select_t));
+    set->waiters = (channel_waiter_t*) malloc(channel_count * sizeof(channel_waiter_t));
+    set->slot = (size_t*) malloc(channel_count * sizeof(size_t));
+    set->position = (size_t*) malloc(channel_count * sizeof(size_t));
+    set->order = (size_t*) malloc(channel_count * sizeof(size_t));
+    if(set->list == NULL || set->waiters == NULL || set->slot == NULL || set->position == NULL || set->order == NULL){
+        select_set_free(set);
+        return NULL;
+    }
+    set->count = channel_count;
+    set->capacity = channel_count;
+    set->start = 0;
+    futex_parker_init(&set->parker);
+    futex_parker_cancel(&set->parker);
+    memcpy(set->list, channel_list, channel_count * sizeof(select_t));
+    select_sort(set->list, channel_count, set->order);
+    for(size_t i = 0; i < channel_count; i++){
+        set->slot[i] = i;
+        set->position[i] = i;
+        set->waiters[i].parker = &set->parker;
+        set->waiters[i].data = NULL;
+        set->waiters[i].status = SUCCESS;
+        set->waiters[i].index = i;
+        set->waiters[i].persistent = true;
+        set->waiters[i].disabled = false;
+        channel_t* channel = set->list[i].channel;
+        Pthread_mutex_lock(&channel->mutex);
+        list_insert_node(select_queue(&set->list[i]), &set->waiters[i].node, &set->waiters[i]);
+        channel_unlock(channel);
+    }
+    return set;
+}
+
+// Performs one operation among the enabled cases of set like channel_select, blocking until one is possible
+// Returns SUCCESS or CLOSED_ERROR with selected_index set like channel_select, or GEN_ERROR if no case is enabled
+/*
+ * Same locked readiness pass as channel_select, but instead of queueing waiters the set only re-arms the
+ * parker its registered waiters share. The counterpart that claims it has completed the case, and the other
+ * waiters go back to being skipped, so there is nothing to clean up after waking. The scan resumes after the
+ * case selected last, so that every ready case gets its turn.
+ */
+enum channel_status select_set_wait(select_set_t* set, size_t* selected_index)
+{
+    if(set == NULL || set->count == 0)
+        return GEN_ERROR;
+    select_set_lock(set, true);
+    size_t start = set->start < set->count ? set->start : 0;
+    enum channel_status status = select_poll(set->list, set->count, start, selected_index);
+    if(status != CHANNEL_EMPTY){
+        select_set_lock(set, false);
+    } else {
+        for(size_t i = 0; i < set->count; i++)
+            set->waiters[set->slot[i]].data = set->list[i].dir == SEND ? set->list[i].data : NULL;
+        futex_parker_init(&set->parker);
+        select_set_lock(set, false);
+        enum futex_wait_phase phase;
+        size_t slot = futex_parker_wait(&set->parker, 0, 0, NULL, &phase) - FUTEX_PARKER_DONE;
+        *selected_index = set->position[slot];
+        status = set->waiters[slot].status;
+        if(status == SUCCESS && set->list[*selected_index].dir == RECV)
+            set->list[*selected_index].data = set->waiters[slot].data;
+    }
+    set->start = *selected_index + 1;
+    return status;
+}
+
+// Disables the case at position index of set->list by swapping it with the last enabled case and
+// decrementing set->count, like removing it from a select_t array by hand
+// Returns SUCCESS, or GEN_ERROR if index is not an enabled case
+enum channel_status select_set_disable(select_set_t* set, size_t index)
+{
+    if(set == NULL || index >= set->count)
+        return GEN_ERROR;
+    select_set_mark(set, index, true);
+    select_set_swap(set, index, set->count - 1);
+    set->count--;
     return SUCCESS;
 }
 
+// Enables the disabled case at position index of set->list by swapping it to position set->count and
+// incrementing set->count
+// Returns SUCCESS, or GEN_ERROR if index is not a disabled case
+enum channel_status select_set_enable(select_set_t* set, size_t index)
+{
+    if(set == NULL || index < set->count || index >= set->capacity)
+        return GEN_ERROR;
+    select_set_mark(set, index, false);
+    select_set_swap(set, index, set->count);
+    set->count++;
+    return SUCCESS;
+}
 
+// Unregisters the set from its channels and frees it
+// Must be called before any of the set's channels is destroyed
+// Returns SUCCESS, or GEN_ERROR if set is NULL
+enum channel_status select_set_destroy(select_set_t* set)
+{
+    if(set == NULL)
+        return GEN_ERROR;
+    for(size_t slot = 0; slot < set->capacity; slot++){
+        select_t* entry = &set->list[set->position[slot]];
+        list_t* queue = select_queue(entry);
+        Pthread_mutex_lock(&entry->channel->mutex);
+        list_remove(queue, &set->waiters[slot].node);
+        channel_unlock(entry->channel);
+    }
+    select_set_free(set);
+    return SUCCESS;
+}
@@ -9,7 +9,10 @@
 #include <stddef.h> 
 #include <string.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
 #include "linked_list.h"
+#include "futex.h"
 
 // Defines possible return values from channel functions
 enum channel_status {
@@ -18,9 +21,34 @@ enum channel_status {
     SUCCESS = 1,
     CLOSED_ERROR = -2,
     GEN_ERROR = -1,
-    DESTROY_ERROR = -3
+    DESTROY_ERROR = -3,
+    TIMEOUT = -4
 };
 
+// Defines how a blocked send/receive waits for the channel to become ready
+enum channel_wait_policy {
+    // Park on the futex right away
+    CHANNEL_WAIT_PARK,
+    // Spin with a pause instruction, then yield the CPU, then park
+    CHANNEL_WAIT_ADAPTIVE
+};
+
+// Defines the attributes a channel is created with
+typedef struct {
+    enum channel_wait_policy wait_policy;
+    // Number of polls before yielding, only used by CHANNEL_WAIT_ADAPTIVE
+    unsigned int spin_count;
+    // Number of sched_yield calls before parking, only used by CHANNEL_WAIT_ADAPTIVE
+    unsigned int yield_count;
+} channel_attr_t;
+
+// Counts how often a blocked send/receive was resolved in each phase of its wait
+typedef struct {
+    size_t spin;
+    size_t yield;
+    size_t park;
+} channel_wait_stats_t;
+
 // Defines channel object
 typedef struct {
     // DO NOT REMOVE buffer (OR CHANGE ITS NAME) FROM THE STRUCT
@@ -32,21 +60,58 @@ typedef struct {
     /* 
      * closed used as flag to check if channel is closed
      * pthread_mutex_t mutex for lock and unlock to make sure one thread is using buffer and other components of channel_t
-     * pthread_cond_t full, empty are condition variables for each to check if the buffer is full and empty. Used for waiting and signalling to activate sleeping threads
+     * futex_cond_t full, empty are futex-based condition variables the lock-free channels park on when the ring is full
+     * or empty, and they skip the wake syscall when nobody is waiting
+     * sendq, recvq queue the threads blocked in send/receive in FIFO order; each entry points at the waiter's stack slot so the
+     * other side can hand the message over directly and wake just that thread; a blocked select queues one waiter per case here too,
+     * and a select set keeps one registered per case for its whole lifetime; byte channels park reservers on sendq and peekers on recvq
+     * lock_free is set for SPSC/MPMC channels, whose send/receive use the lock-free ring and only touch mutex to park
+     * send_waiting, recv_waiting count the threads parked on empty/full so the lock-free path only takes mutex when someone sleeps
+     * attr holds the wait policy chosen at creation, and wait_spin, wait_yield, wait_park count which phase resolved each wait
+     * recv_fd, send_fd are the eventfds handed out by channel_get_fd (-1 until asked for), and recv_fd_signalled,
+     * send_fd_signalled whether their counter is currently 1; both are only changed under mutex
+     * elem_size is the size of the values a typed channel copies, 0 for channels of void* messages
+     * The fields are grouped by who writes them, each group starting a cache line, so that threads on different cores do not
+     * invalidate each other's lines for fields they only read: what is set at creation (and closed, written once), what is
+     * changed under mutex, the counter and condition receivers park on, the ones senders park on, and the wait statistics.
+     * The channel is allocated in front of its buffer (see buffer_create_prefixed), so the slots follow on the next lines
     */
 
-    int closed; 
-    pthread_mutex_t mutex;
-    //pthread_mutex_t *select_mutex;
-    pthread_cond_t full;
-    pthread_cond_t empty;
-    //pthread_cond_t *select; //LinkedList
-    size_t size;
-    list_t *list;
+    atomic_int closed;
+    bool lock_free;
+    size_t elem_size;
+    channel_attr_t attr;
+
+    CACHE_LINE_ALIGNED pthread_mutex_t mutex;
+    list_t *sendq;
+    list_t *recvq;
+    int recv_fd;
+    int send_fd;
+    bool recv_fd_signalled;
+    bool send_fd_signalled;
+
+    CACHE_LINE_ALIGNED futex_cond_t full;
+    atomic_size_t recv_waiting;
+
+    CACHE_LINE_ALIGNED futex_cond_t empty;
+    atomic_size_t send_waiting;
+
+    CACHE_LINE_ALIGNED atomic_size_t wait_spin;
+    atomic_size_t wait_yield;
+    atomic_size_t wait_park;
 } channel_t;
 
 
 
+// Describes a record of a byte channel: size bytes of channel-owned storage at data
+typedef struct {
+    void* data;
+    size_t size;
+} channel_slot_t;
+
+// Most cases channel_select and its variants handle without allocating
+#define SELECT_STACK_CASES 32
+
 // Defines channel list structure for channel_select function
 enum direction {
     SEND,
@@ -62,10 +127,136 @@ typedef struct {
     void* data;
 } select_t;
 
+// Waiter a select set keeps registered on a channel for each of its cases; private to channel.c
+struct channel_waiter;
+
+// Defines a select set, a select_t array that is registered on its channels once and then waited on repeatedly
+typedef struct {
+    // Cases of the set: list[0..count) are enabled and take part in select_set_wait, list[count..capacity) are
+    // disabled. The data of SEND cases may be changed between waits; received messages are stored in data of RECV cases
+    select_t* list;
+    size_t count;
+    size_t capacity;
+
+    // The remaining fields are internal to channel.c
+    // waiters are indexed by slot, which stays with a case when enable/disable reorder list; slot maps a position
+    // in list to its slot and position maps back, order holds the slots in lock order, start is where the next scan begins
+    struct channel_waiter* waiters;
+    size_t* slot;
+    size_t* position;
+    size_t* order;
+    futex_parker_t parker;
+    size_t start;
+} select_set_t;
+
 // Creates a new channel with the provided size and returns it to the caller
 // A 0 size indicates an unbuffered channel, whereas a positive size indicates a buffered channel
+// On an unbuffered channel a send completes only once a receiver (or select) has taken the message
+// A power-of-two size is slightly cheaper to index, see buffer_create
 channel_t* channel_create(size_t size);
 
+// Fills attr with the defaults used by channel_create: park immediately, with spin/yield counts
+// suitable for CHANNEL_WAIT_ADAPTIVE should the caller switch the policy
+void channel_attr_init(channel_attr_t* attr);
+
+// Creates a new channel like channel_create, using the wait policy in attr
+// A NULL attr is the same as the defaults from channel_attr_init
+channel_t* channel_create_with_attr(size_t size, const channel_attr_t* attr);
+
+// Copies the counters of how often each wait phase resolved a blocked send/receive into stats
+void channel_get_wait_stats(channel_t* channel, channel_wait_stats_t* stats);
+
+// Creates a new buffered channel like channel_create whose buffer starts with size slots and doubles, up to
+// max_size, whenever a send finds it full, instead of blocking the sender; it halves again, down to size, once
+// it has stayed at most a quarter full for as many receives in a row as it has slots. Only the size slots are
+// allocated with the channel, so a channel sized for its worst burst holds that memory only during bursts
+// Sends block, and channel_get_fd reports the channel as not writable, only while max_size messages are buffered
+// Returns NULL if size is 0 or max_size is below size
+channel_t* channel_create_elastic(size_t size, size_t max_size);
+
+// Creates a new buffered channel for exactly one sending thread and one receiving thread
+// Send and receive complete without taking a lock and only park when the buffer is full or empty
+// The caller must guarantee that at most one thread sends and at most one thread receives
+// SPSC channels cannot be used with channel_select, which returns GEN_ERROR for them
+// Returns NULL if size is 0
+channel_t* channel_create_spsc(size_t size);
+
+// Creates a new SPSC channel like channel_create_spsc, using the wait policy in attr (NULL for the defaults)
+// With CHANNEL_WAIT_ADAPTIVE a blocked call polls the ring before parking, without taking the channel mutex
+channel_t* channel_create_spsc_with_attr(size_t size, const channel_attr_t* attr);
+
+// Creates a new buffered channel whose buffer is a lock-free multi-producer/multi-consumer ring
+// Any number of threads may send and receive; non-blocking send/receive never take the channel mutex
+// and blocking calls only park when the buffer is full or empty
+// MPMC channels cannot be used with channel_select, which returns GEN_ERROR for them
+// Returns NULL if size is 0
+channel_t* channel_create_mpmc(size_t size);
+
+// Creates a new MPMC channel like channel_create_mpmc, using the wait policy in attr (NULL for the defaults)
+channel_t* channel_create_mpmc_with_attr(size_t size, const channel_attr_t* attr);
+
+// Creates a new channel that carries values of elem_size bytes rather than void* messages
+// Sent values are copied into one contiguous slab in the buffer (or straight into a parked receiver), so small
+// values need no allocation per message; size is the number of values buffered, 0 for an unbuffered channel
+// Typed channels are only used through the *_value calls; the void* calls and channel_select return GEN_ERROR for them
+// Returns NULL if elem_size is 0
+channel_t* channel_create_typed(size_t elem_size, size_t size);
+
+// Copies the elem_size bytes at value into a typed channel, blocking like channel_send while it is full
+// Returns SUCCESS, CLOSED_ERROR if the channel is closed, and GEN_ERROR if the channel is not typed or on any
+// other error
+enum channel_status channel_send_value(channel_t* channel, const void* value);
+
+// Receives the next value of a typed channel into the elem_size bytes at value, blocking like channel_receive
+// while it is empty
+// Returns SUCCESS, CLOSED_ERROR if the channel is closed, and GEN_ERROR if the channel is not typed or on any
+// other error
+enum channel_status channel_receive_value(channel_t* channel, void* value);
+
+// Non-blocking version of channel_send_value
+// Returns CHANNEL_FULL if the value could not be written right away, otherwise the same values as channel_send_value
+enum channel_status channel_non_blocking_send_value(channel_t* channel, const void* value);
+
+// Non-blocking version of channel_receive_value
+// Returns CHANNEL_EMPTY if no value could be read right away, otherwise the same values as channel_receive_value
+enum channel_status channel_non_blocking_receive_value(channel_t* channel, void* value);
+
+// Creates a new channel whose buffer is a ring of capacity bytes holding variable-sized records
+// Producers write a message straight into the ring between channel_reserve and channel_commit, and consumers read
+// it in place between channel_peek and channel_release, so the payload is never copied by the channel. Records are
+// peeked in reservation order, and their space is reused once they and all older records are released
+// Byte channels are only used through the calls below; the void* calls and channel_select return GEN_ERROR for
+// them, and channel_get_fd returns -1
+// Returns NULL if capacity is 0
+channel_t* channel_create_bytes(size_t capacity);
+
+// Reserves a record of size bytes in a byte channel and describes it in slot, blocking while there is not enough
+// contiguous room; the caller fills slot->data and then passes slot to channel_commit
+// Returns SUCCESS, CLOSED_ERROR if the channel is closed, and GEN_ERROR if the channel is not a byte channel or the
+// record could never fit in it
+enum channel_status channel_reserve(channel_t* channel, size_t size, channel_slot_t* slot);
+
+// Non-blocking version of channel_reserve
+// Returns CHANNEL_FULL if there is not enough room right now, otherwise the same values as channel_reserve
+enum channel_status channel_non_blocking_reserve(channel_t* channel, size_t size, channel_slot_t* slot);
+
+// Publishes a record reserved with channel_reserve to consumers; it is peeked after all records reserved before it
+// Returns SUCCESS, or GEN_ERROR if the channel is not a byte channel
+enum channel_status channel_commit(channel_t* channel, channel_slot_t slot);
+
+// Takes the oldest committed record of a byte channel and describes it in slot, blocking while there is none
+// The caller reads slot->data in place and then passes slot to channel_release
+// Returns SUCCESS, CLOSED_ERROR if the channel is closed, and GEN_ERROR if the channel is not a byte channel
+enum channel_status channel_peek(channel_t* channel, channel_slot_t* slot);
+
+// Non-blocking version of channel_peek
+// Returns CHANNEL_EMPTY if no committed record is waiting, otherwise the same values as channel_peek
+enum channel_status channel_non_blocking_peek(channel_t* channel, channel_slot_t* slot);
+
+// Gives the space of a record taken with channel_peek back to the channel
+// Returns SUCCESS, or GEN_ERROR if the channel is not a byte channel
+enum channel_status channel_release(channel_t* channel, channel_slot_t slot);
+
 // Writes data to the given channel
 // This is a blocking call i.e., the function only returns on a successful completion of send
 // In case the channel is full, the function waits till the channel has space to write the new data
@@ -74,6 +265,13 @@ channel_t* channel_create(size_t size);
 // GEN_ERROR on encountering any other generic error of any sort
 enum channel_status channel_send(channel_t* channel, void* data);
 
+// Writes data to the given channel like channel_send, but gives up at deadline
+// deadline is an absolute CLOCK_MONOTONIC time, e.g. clock_gettime(CLOCK_MONOTONIC) plus the latency budget;
+// a NULL deadline waits forever like channel_send
+// Returns TIMEOUT if the deadline passed before the data could be written, in which case it was not sent,
+// otherwise the same values as channel_send
+enum channel_status channel_send_timeout(channel_t* channel, void* data, const struct timespec* deadline);
+
 // Reads data from the given channel and stores it in the function’s input parameter, data (Note that it is a double pointer).
 // This is a blocking call i.e., the function only returns on a successful completion of receive
 // In case the channel is empty, the function waits till the channel has some data to read
@@ -82,6 +280,12 @@ enum channel_status channel_send(channel_t* channel, void* data);
 // GEN_ERROR on encountering any other generic error of any sort
 enum channel_status channel_receive(channel_t* channel, void** data);
 
+// Reads data from the given channel like channel_receive, but gives up at deadline
+// deadline is an absolute CLOCK_MONOTONIC time; a NULL deadline waits forever like channel_receive
+// Returns TIMEOUT if the deadline passed before any data arrived, in which case nothing is stored in data,
+// otherwise the same values as channel_receive
+enum channel_status channel_receive_timeout(channel_t* channel, void** data, const struct timespec* deadline);
+
 // Writes data to the given channel
 // This is a non-blocking call i.e., the function simply returns if the channel is full
 // Returns SUCCESS for successfully writing data to the channel,
@@ -98,6 +302,23 @@ enum channel_status channel_non_blocking_send(channel_t* channel, void* data);
 // GEN_ERROR on encountering any other generic error of any sort
 enum channel_status channel_non_blocking_receive(channel_t* channel, void** data);
 
+// Writes the n messages in items to the given channel, in order
+// This is a blocking call like channel_send, but it moves as many messages as the channel can take per lock
+// acquisition and wakes blocked selects once per batch rather than once per message
+// The number of messages written is stored in sent, also when the call fails part way through
+// Returns SUCCESS once all n messages are written,
+// CLOSED_ERROR if the channel is closed, and
+// GEN_ERROR on encountering any other generic error of any sort
+enum channel_status channel_send_many(channel_t* channel, void** items, size_t n, size_t* sent);
+
+// Reads up to max messages from the given channel into out, in order, and stores their number in got
+// This is a blocking call that waits like channel_receive until at least one message is available,
+// then takes every message available up to max under a single lock acquisition
+// Returns SUCCESS for successful retrieval of at least one message,
+// CLOSED_ERROR if the channel is closed, and
+// GEN_ERROR on encountering any other generic error of any sort
+enum channel_status channel_receive_many(channel_t* channel, void** out, size_t max, size_t* got);
+
 // Closes the channel and informs all the blocking send/receive/select calls to return with CLOSED_ERROR
 // Once the channel is closed, send/receive/select operations will cease to function and just return CLOSED_ERROR
 // Returns SUCCESS if close is successful,
@@ -105,6 +326,14 @@ enum channel_status channel_non_blocking_receive(channel_t* channel, void** data
 // GEN_ERROR in any other error case
 enum channel_status channel_close(channel_t* channel);
 
+// Returns an eventfd for use with poll/epoll that is readable exactly while a receive (dir RECV) or a send
+// (dir SEND) on the channel can complete without blocking, i.e. while the buffer has a message (or space),
+// a counterpart is parked, or the channel is closed; it is level-triggered and updated by every channel operation
+// Readiness can be spurious when another thread gets to the channel first, so use the non-blocking calls after
+// a wakeup. The fd belongs to the channel: do not read, write or close it; channel_destroy closes it
+// Returns -1 for SPSC and MPMC channels and on encountering any other error
+int channel_get_fd(channel_t* channel, enum direction dir);
+
 // Frees all the memory allocated to the channel
 // The caller is responsible for calling channel_close and waiting for all threads to finish their tasks before calling channel_destroy
 // Returns SUCCESS if destroy is successful,
@@ -119,6 +348,53 @@ enum channel_status channel_destroy(channel_t* channel);
 // Once an operation has been successfully performed, select should set selected_index to the index of the channel that performed the operation and then return SUCCESS
 // In the event that a channel is closed or encounters any error, the error should be propagated and returned through select
 // Additionally, selected_index is set to the index of the channel that generated the error
+// Selects of up to SELECT_STACK_CASES cases keep their state on the stack and never allocate; larger ones allocate
+// it on every call and return GEN_ERROR if that fails, so a large select run in a loop should be a select set
 enum channel_status channel_select(select_t* channel_list, size_t channel_count, size_t* selected_index);
 
+// Same as channel_select, except that the search for a ready channel starts at a random index of channel_list
+// and wraps around, so that channels late in channel_list cannot be starved by ready ones before them
+// Returns GEN_ERROR if channel_count is 0
+enum channel_status channel_select_fair(select_t* channel_list, size_t channel_count, size_t* selected_index);
+
+// Non-blocking version of channel_select, like a Go select with a default branch
+// Checks every channel in channel_list once and performs the first operation that can complete right away
+// Returns SUCCESS with selected_index set if an operation was performed,
+// CHANNEL_EMPTY if no channel was ready and nothing was performed,
+// CLOSED_ERROR with selected_index set if a channel checked before any ready one is closed, and
+// GEN_ERROR on encountering any other generic error of any sort
+enum channel_status channel_try_select(select_t* channel_list, size_t channel_count, size_t* selected_index);
+
+// Like channel_select, but gives up at deadline, an absolute CLOCK_MONOTONIC time
+// Returns TIMEOUT if no operation could be performed before the deadline, in which case no operation was
+// performed and selected_index is untouched, otherwise the same values as channel_select
+enum channel_status channel_select_timeout(select_t* channel_list, size_t channel_count, size_t* selected_index,
+                                           const struct timespec* deadline);
+
+// Creates a select set from a copy of channel_list, with all channel_count cases enabled
+// Each case is registered on its channel once here rather than on every wait, which makes repeated waits on
+// (nearly) the same cases cheaper than calling channel_select in a loop
+// Returns NULL if channel_count is 0, a channel is NULL, SPSC, MPMC, typed or a byte channel, or on allocation failure
+select_set_t* select_set_create(select_t* channel_list, size_t channel_count);
+
+// Waits on the enabled cases set->list[0..set->count) like channel_select and performs one of them
+// The search for a ready case resumes after the case selected by the previous wait, so no case is starved
+// Returns SUCCESS with selected_index set to the position of the case in set->list,
+// CLOSED_ERROR with selected_index set if that case's channel is closed, and
+// GEN_ERROR if no case is enabled or on encountering any other generic error of any sort
+enum channel_status select_set_wait(select_set_t* set, size_t* selected_index);
+
+// Disables the enabled case set->list[index]: it is swapped with the last enabled case and set->count is decremented
+// Returns SUCCESS, or GEN_ERROR if index is not below set->count
+enum channel_status select_set_disable(select_set_t* set, size_t index);
+
+// Enables the disabled case set->list[index]: it is swapped to position set->count and set->count is incremented
+// Returns SUCCESS, or GEN_ERROR if index is not a disabled case
+enum channel_status select_set_enable(select_set_t* set, size_t index);
+
+// Unregisters the set from its channels and frees it
+// The caller must destroy the set before destroying any of its channels, and must not wait on it concurrently
+// Returns SUCCESS if destroy is successful, and GEN_ERROR in any other error case
+enum channel_status select_set_destroy(select_set_t* set);
+
 #endif // CHANNEL_H
@@ -0,0 +1,215 @@
+#include "futex.h"
+#include "scheduler.h"
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+// Sleeps while *word == val, returns when woken, interrupted or if *word != val on entry
+void futex_wait(atomic_uint* word, unsigned int val)
+{
+    syscall(SYS_futex, (void*)word, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+// Like futex_wait, but gives up at deadline; FUTEX_WAIT_BITSET takes an absolute CLOCK_MONOTONIC timeout
+// An invalid deadline is reported as expired rather than letting the caller retry forever
+bool futex_wait_until(atomic_uint* word, unsigned int val, const struct timespec* deadline)
+{
+    if (deadline == NULL) {
+        futex_wait(word, val);
+        return true;
+    }
+    if (syscall(SYS_futex, (void*)word, FUTEX_WAIT_BITSET_PRIVATE, val, deadline, NULL, FUTEX_BITSET_MATCH_ANY) == 0) {
+        return true;
+    }
+    return errno != ETIMEDOUT && errno != EINVAL;
+}
+
+// Wakes up to count threads sleeping in futex_wait on word
+void futex_wake(atomic_uint* word, int count)
+{
+    syscall(SYS_futex, (void*)word, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+// Initializes the condition variable
+void futex_cond_init(futex_cond_t* cond)
+{
+    atomic_init(&cond->seq, 0);
+    atomic_init(&cond->waiters, 0);
+    atomic_init(&cond->sleepers, 0);
+}
+
+// Atomically releases mutex and sleeps until the condition is signalled, then reacquires mutex
+// seq is sampled while mutex is held, so a signal issued after the unlock changes it and the
+// futex_wait below returns immediately instead of missing the wakeup
+void futex_cond_wait(futex_cond_t* cond, pthread_mutex_t* mutex)
+{
+    futex_cond_wait_adaptive(cond, mutex, 0, 0);
+}
+
+// Like futex_cond_wait, but spins and then yields before sleeping in the kernel
+// A signaller only issues FUTEX_WAKE when sleepers is non-zero; a waiter that registers as a sleeper
+// after the signal still sees the new seq and futex_wait returns immediately
+enum futex_wait_phase futex_cond_wait_adaptive(futex_cond_t* cond, pthread_mutex_t* mutex, unsigned int spin_count, unsigned int yield_count)
+{
+    enum futex_wait_phase phase = FUTEX_WAIT_PARK;
+    unsigned int seq = atomic_load_explicit(&cond->seq, memory_order_relaxed);
+    atomic_fetch_add(&cond->waiters, 1);
+    pthread_mutex_unlock(mutex);
+    for (unsigned int i = 0; i < spin_count; i++) {
+        if (atomic_load_explicit(&cond->seq, memory_order_relaxed) != seq) {
+            phase = FUTEX_WAIT_SPIN;
+            break;
+        }
+        cpu_relax();
+    }
+    for (unsigned int i = 0; phase == FUTEX_WAIT_PARK && i < yield_count; i++) {
+        sched_yield();
+        if (atomic_load_explicit(&cond->seq, memory_order_relaxed) != seq) {
+            phase = FUTEX_WAIT_YIELD;
+        }
+    }
+    if (phase == FUTEX_WAIT_PARK) {
+        atomic_fetch_add(&cond->sleepers, 1);
+        futex_wait(&cond->seq, seq);
+        atomic_fetch_sub(&cond->sleepers, 1);
+    }
+    pthread_mutex_lock(mutex);
+    atomic_fetch_sub(&cond->waiters, 1);
+    return phase;
+}
+
+// Like futex_cond_wait, but gives up at deadline
+bool futex_cond_timedwait(futex_cond_t* cond, pthread_mutex_t* mutex, const struct timespec* deadline)
+{
+    unsigned int seq = atomic_load_explicit(&cond->seq, memory_order_relaxed);
+    atomic_fetch_add(&cond->waiters, 1);
+    pthread_mutex_unlock(mutex);
+    atomic_fetch_add(&cond->sleepers, 1);
+    bool signalled = futex_wait_until(&cond->seq, seq, deadline);
+    atomic_fetch_sub(&cond->sleepers, 1);
+    pthread_mutex_lock(mutex);
+    atomic_fetch_sub(&cond->waiters, 1);
+    return signalled;
+}
+
+// Wakes one thread waiting on the condition, if any
+void futex_cond_signal(futex_cond_t* cond)
+{
+    if (atomic_load_explicit(&cond->waiters, memory_order_relaxed) == 0) {
+        return;
+    }
+    atomic_fetch_add(&cond->seq, 1);
+    if (atomic_load(&cond->sleepers) != 0) {
+        futex_wake(&cond->seq, 1);
+    }
+}
+
+// Wakes every thread waiting on the condition
+void futex_cond_broadcast(futex_cond_t* cond)
+{
+    if (atomic_load_explicit(&cond->waiters, memory_order_relaxed) == 0) {
+        return;
+    }
+    atomic_fetch_add(&cond->seq, 1);
+    if (atomic_load(&cond->sleepers) != 0) {
+        futex_wake(&cond->seq, INT_MAX);
+    }
+}
+
+// Initializes the parker as waiting
+// An atomic store rather than atomic_init, since completers may still be looking at a parker being reused
+void futex_parker_init(futex_parker_t* parker)
+{
+    atomic_store_explicit(&parker->state, FUTEX_PARKER_WAITING, memory_order_relaxed);
+    atomic_store_explicit(&parker->coroutine, NULL, memory_order_relaxed);
+}
+
+// Waits until the parker is completed and returns its completion value
+// The owner announces that it is about to sleep by moving state from WAITING to SLEEPING; a completer
+// that replaces SLEEPING knows it has to issue FUTEX_WAKE, and one that replaces WAITING can skip it
+// Past the deadline the owner stays SLEEPING; futex_parker_cancel then decides between it and a late completer
+unsigned int futex_parker_wait(futex_parker_t* parker, unsigned int spin_count, unsigned int yield_count,
+                               const struct timespec* deadline, enum futex_wait_phase* phase)
+{
+    unsigned int state;
+    if (sched_current() != NULL) {
+        *phase = FUTEX_WAIT_PARK;
+        return sched_park(parker, deadline);
+    }
+    for (unsigned int i = 0; i < spin_count; i++) {
+        state = atomic_load_explicit(&parker->state, memory_order_acquire);
+        if (state >= FUTEX_PARKER_DONE) {
+            *phase = FUTEX_WAIT_SPIN;
+            return state;
+        }
+        cpu_relax();
+    }
+    for (unsigned int i = 0; i < yield_count; i++) {
+        sched_yield();
+        state = atomic_load_explicit(&parker->state, memory_order_acquire);
+        if (state >= FUTEX_PARKER_DONE) {
+            *phase = FUTEX_WAIT_YIELD;
+            return state;
+        }
+    }
+    *phase = FUTEX_WAIT_NONE;
+    state = FUTEX_PARKER_WAITING;
+    while (!atomic_compare_exchange_weak(&parker->state, &state, FUTEX_PARKER_SLEEPING)) {
+        if (state >= FUTEX_PARKER_DONE) {
+            return state;
+        }
+        if (state == FUTEX_PARKER_SLEEPING) {
+            break;
+        }
+    }
+    *phase = FUTEX_WAIT_PARK;
+    while (true) {
+        bool expired = !futex_wait_until(&parker->state, FUTEX_PARKER_SLEEPING, deadline);
+        state = atomic_load_explicit(&parker->state, memory_order_acquire);
+        if (state >= FUTEX_PARKER_DONE || expired) {
+            return state;
+        }
+    }
+}
+
+// Completes the parker with value and wakes its owner if it sleeps in the kernel
+// FUTEX_WAKE may reach the word after its owner has returned; the kernel then finds nobody waiting,
+// or wakes an unrelated futex_parker_wait spuriously, which simply sleeps again
+// A sleeping coroutine is requeued instead; coroutine is read before the CAS, since a thread owner may return
+// right after it, but only once SLEEPING is seen, which its owner stores after setting coroutine
+bool futex_parker_complete(futex_parker_t* parker, unsigned int value)
+{
+    struct coroutine* coroutine = NULL;
+    unsigned int state = atomic_load_explicit(&parker->state, memory_order_acquire);
+    do {
+        if (state >= FUTEX_PARKER_DONE) {
+            return false;
+        }
+        if (state == FUTEX_PARKER_SLEEPING) {
+            coroutine = atomic_load_explicit(&parker->coroutine, memory_order_relaxed);
+        }
+    } while (!atomic_compare_exchange_weak(&parker->state, &state, value));
+    if (state == FUTEX_PARKER_SLEEPING) {
+        if (coroutine != NULL) {
+            sched_wake(coroutine);
+        } else {
+            futex_wake(&parker->state, 1);
+        }
+    }
+    return true;
+}
+
+// Cancels the parker unless it has been completed; no wakeup is needed since only the owner cancels
+unsigned int futex_parker_cancel(futex_parker_t* parker)
+{
+    unsigned int state = atomic_load_explicit(&parker->state, memory_order_acquire);
+    do {
+        if (state >= FUTEX_PARKER_DONE) {
+            return state;
+        }
+    } while (!atomic_compare_exchange_weak(&parker->state, &state, FUTEX_PARKER_CANCELLED));
+    return FUTEX_PARKER_CANCELLED;
+}
@@ -0,0 +1,114 @@
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <time.h>
+
+// Condition variable built directly on a Linux futex
+// seq is the futex word and changes on every wakeup; waiters counts the threads inside futex_cond_wait
+// so that signalling a condition nobody waits on costs no system call, and sleepers counts the subset
+// actually blocked in the kernel so that waking spinning threads costs none either
+typedef struct {
+    atomic_uint seq;
+    atomic_uint waiters;
+    atomic_uint sleepers;
+} futex_cond_t;
+
+// Phase of futex_cond_wait_adaptive or futex_parker_wait that observed the wakeup
+// FUTEX_WAIT_NONE: a parker was completed after the last poll but before its owner could go to sleep
+enum futex_wait_phase {
+    FUTEX_WAIT_SPIN,
+    FUTEX_WAIT_YIELD,
+    FUTEX_WAIT_PARK,
+    FUTEX_WAIT_NONE
+};
+
+struct coroutine;
+
+// Parks a single thread until another thread completes it with a value
+// state is FUTEX_PARKER_WAITING while the owner may be spinning, FUTEX_PARKER_SLEEPING once it sleeps in
+// the kernel, and the completion value (at least FUTEX_PARKER_DONE) after it has been completed
+// An owner that gives up waiting stores FUTEX_PARKER_CANCELLED, which completers treat as already completed
+// coroutine is set when the owner is a coroutine of scheduler.c, which is then requeued instead of woken by FUTEX_WAKE
+typedef struct {
+    atomic_uint state;
+    _Atomic(struct coroutine*) coroutine;
+} futex_parker_t;
+
+#define FUTEX_PARKER_WAITING 0u
+#define FUTEX_PARKER_SLEEPING 1u
+#define FUTEX_PARKER_DONE 2u
+#define FUTEX_PARKER_CANCELLED (~0u)
+
+// Hints the CPU that the caller is busy-waiting
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+// Initializes the condition variable
+void futex_cond_init(futex_cond_t* cond);
+
+// Atomically releases mutex and sleeps until the condition is signalled, then reacquires mutex
+// The caller must hold mutex; like pthread_cond_wait, wakeups may be spurious
+void futex_cond_wait(futex_cond_t* cond, pthread_mutex_t* mutex);
+
+// Like futex_cond_wait, but first polls for a signal spin_count times with cpu_relax in between,
+// then yields the CPU up to yield_count times, and only then sleeps in the kernel
+// Returns the phase during which the wakeup was observed
+enum futex_wait_phase futex_cond_wait_adaptive(futex_cond_t* cond, pthread_mutex_t* mutex, unsigned int spin_count, unsigned int yield_count);
+
+// Like futex_cond_wait, but gives up at deadline, an absolute CLOCK_MONOTONIC time; a NULL deadline never expires
+// Returns false if the deadline passed before the condition was signalled; mutex is reacquired either way
+bool futex_cond_timedwait(futex_cond_t* cond, pthread_mutex_t* mutex, const struct timespec* deadline);
+
+// Wakes one thread waiting on the condition, if any
+// The caller must hold the mutex the waiters use
+void futex_cond_signal(futex_cond_t* cond);
+
+// Wakes every thread waiting on the condition
+// The caller must hold the mutex the waiters use
+void futex_cond_broadcast(futex_cond_t* cond);
+
+// Initializes the parker as waiting
+// A completed or cancelled parker may be initialized again to reuse it, as long as its completers are
+// excluded by the caller's locking while it is
+void futex_parker_init(futex_parker_t* parker);
+
+// Waits until the parker is completed and returns its completion value
+// Polls spin_count times, then yields up to yield_count times before sleeping in the kernel;
+// the phase that observed the completion is stored in phase, FUTEX_WAIT_PARK only if the owner actually slept
+// The kernel sleep gives up at deadline, an absolute CLOCK_MONOTONIC time, in which case a value below
+// FUTEX_PARKER_DONE or FUTEX_PARKER_CANCELLED is returned and the owner must futex_parker_cancel the parker;
+// NULL waits forever
+// Called from a coroutine, only the coroutine is suspended and the spin/yield phases are skipped
+unsigned int futex_parker_wait(futex_parker_t* parker, unsigned int spin_count, unsigned int yield_count,
+                               const struct timespec* deadline, enum futex_wait_phase* phase);
+
+// Completes the parker with value, which must be at least FUTEX_PARKER_DONE, and wakes its owner
+// Writes made before the call are visible to the owner once futex_parker_wait returns
+// Returns false without changing anything if the parker had already been completed
+// The caller must not touch the parker's memory afterwards, since its owner may have returned
+bool futex_parker_complete(futex_parker_t* parker, unsigned int value);
+
+// Lets the owner of a parker whose wait timed out stop waiting
+// Returns FUTEX_PARKER_CANCELLED if the parker was cancelled, or its completion value if a completer got there first
+unsigned int futex_parker_cancel(futex_parker_t* parker);
+
+// Sleeps while *word == val, returns when woken, interrupted or if *word != val on entry
+void futex_wait(atomic_uint* word, unsigned int val);
+
+// Like futex_wait, but gives up at deadline, an absolute CLOCK_MONOTONIC time; a NULL deadline never expires
+// Returns false if the deadline passed
+bool futex_wait_until(atomic_uint* word, unsigned int val, const struct timespec* deadline);
+
+// Wakes up to count threads sleeping in futex_wait on word
+void futex_wake(atomic_uint* word, int count);
+
+#endif // FUTEX_H
@@ -102,6 +102,34 @@ add_test_case_valgrind("test_stress_unbuffered", iters_one, timeout_valgrind * 3
 add_test_case_channel("test_stress_mixed_buffered_unbuffered", iters_one, timeout_channel * 3)
 add_test_case_sanitize("test_stress_mixed_buffered_unbuffered", iters_one, timeout_sanitize * 3)
 add_test_case_valgrind("test_stress_mixed_buffered_unbuffered", iters_one, timeout_valgrind * 3)
+add_test_cases("test_spsc", iters_slow)
+add_test_cases("test_mpmc", iters_slow)
+add_test_cases("test_wait_policy", iters_slow)
+add_test_cases("test_wake_without_waiters", iters_slow)
+add_test_cases("test_handoff", iters_slow)
+add_test_cases("test_rendezvous", iters_slow)
+add_test_cases("test_send_receive_many", iters_slow)
+add_test_cases("test_for_too_many_select_wakeups", iters_one, timeout_too_many_wakeups)
+add_test_cases("test_select_direct_completion", iters_slow)
+add_test_cases("test_select_fair", iters_slow)
+add_test_cases("test_try_select", iters_slow)
+add_test_cases("test_timeout", iters_slow)
+add_test_cases("test_select_set", iters_slow)
+add_test_cases("test_channel_fd", iters_slow)
+add_test_cases("test_coroutines", iters_slow)
+add_test_cases("test_coroutine_bytes", iters_slow)
+add_test_cases("test_stress_coroutines", iters_one, timeout_stress_send_recv)
+add_test_cases("test_pool", iters_slow)
+add_test_cases("test_stress_pool", iters_one, timeout_stress_send_recv)
+add_test_cases("test_sharded_channel", iters_slow)
+add_test_cases("test_sharded_wakeup", iters_slow)
+add_test_cases("test_broadcast", iters_slow)
+add_test_cases("test_stress_broadcast", iters_one, timeout_stress_send_recv)
+add_test_cases("test_typed_channel", iters_slow)
+add_test_cases("test_zero_copy", iters_slow)
+add_test_cases("test_cache_lines", iters_slow)
+add_test_cases("test_ring_indexing", iters_slow)
+add_test_cases("test_elastic_channel", iters_slow)
 
 # Score distribution
 point_breakdown = [
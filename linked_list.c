@@ -8,6 +8,7 @@ list_t* list_create()
     /* IMPLEMENT THIS IF YOU WANT TO USE LINKED LISTS */
     list_t* myList = (list_t*)malloc(sizeof(list_t));
     myList->head = NULL;
+    myList->tail = NULL;
     myList->count = 0;
 
     return myList;
@@ -20,8 +21,10 @@ void list_destroy(list_t* list)
     /* IMPLEMENT THIS IF YOU WANT TO USE LINKED LISTS */
     list_node_t *temp = list->head;
     while(temp){
-        free(temp);
-        temp = temp->next;
+        list_node_t *next = temp->next;
+        if(temp->allocated)
+            free(temp);
+        temp = next;
     }
     free(list);
 }
@@ -72,77 +75,53 @@ list_node_t* list_find(list_t* list, void* data)
     return NULL;
 }
 
-// Inserts a new node in the list with the given data
-void list_insert(list_t* list, void* select_mutex, void* select_cond, void* data)
+// Inserts a new node at the end of the list with the given data
+// Appending keeps the list in FIFO order, so list_begin is always the oldest node
+// Returns the node as a handle for list_remove
+list_node_t* list_insert(list_t* list, void* data)
 {
     /* IMPLEMENT THIS IF YOU WANT TO USE LINKED LISTS */
     list_node_t *myNode = (list_node_t*)malloc(sizeof(list_node_t));
-    
-    if(list->count == 0){
-        myNode->next= NULL;
-        myNode->prev = NULL;
-        myNode->select = select_cond;
-        myNode->select_mutex = select_mutex; 
-        myNode->data = data;
-        list->head = myNode;
-        list->count++;
-    }
-    else{
-        // list->head->next = myNode;
-        // myNode->next = NULL;
-        // myNode->prev = list->head;
-        myNode->next = list->head;
-        myNode->select = select_cond;
-        myNode->data = data;
-        list->head->prev = myNode;
-        myNode->prev = NULL;
-        list->head = myNode;
-        list->count++;
-    }
+    list_insert_node(list, myNode, data);
+    myNode->allocated = true;
+    return myNode;
+}
+
+// Inserts node, owned by the caller, at the end of the list with the given data without allocating
+void list_insert_node(list_t* list, list_node_t* node, void* data)
+{
+    node->next = NULL;
+    node->prev = list->tail;
+    node->data = data;
+    node->allocated = false;
+    node->list = list;
+    if(list->tail)
+        list->tail->next = node;
+    else
+        list->head = node;
+    list->tail = node;
+    list->count++;
 }
 
 // Removes a node from the list and frees the node resources
+// The node records which list it is in, so it is unlinked through its own prev/next without a scan
 void list_remove(list_t* list, list_node_t* node)
 {
     /* IMPLEMENT THIS IF YOU WANT TO USE LINKED LISTS */
-    list_node_t *temp = list->head;
-    while(temp){
-        if (temp == node){
-            if((temp->next == NULL) && (temp->prev == NULL)){   //Only Element in list
-                list->head = NULL;
-                pthread_cond_destroy(temp->select);
-                free(temp);
-                list->count = list->count-1;
-                temp->next = node->next;
-                //free(node);
-            }
-            else if(temp->next == NULL){        //Last Element
-                temp->prev->next = NULL;
-                pthread_cond_destroy(temp->select);
-                free(temp);
-                list->count = list->count - 1;
-            }
-            else if(temp->prev == NULL){       //First Element
-                list->head = temp->next;
-                temp->next->prev = NULL;
-                pthread_cond_destroy(temp->select);
-                free(temp);
-                list->count = list->count - 1;
-            }
-            else{                           //In middle
-                temp->prev->next = temp->next;
-                temp->next->prev = temp->prev;
-                pthread_cond_destroy(temp->select);
-                free(temp);
-                list->count = list->count -1;
-            }
-        }
-        temp = temp->next;
-    }
-    if (list->count == 0)
-         list->head = NULL;
-
-    //return 1;
+    if(node == NULL || node->list != list)
+        return;
+    if(node->prev)
+        node->prev->next = node->next;
+    else                                //First Element
+        list->head = node->next;
+    if(node->next)
+        node->next->prev = node->prev;
+    else                                //Last Element
+        list->tail = node->prev;
+    list->count--;
+    node->list = NULL;
+    if(node->allocated)
+        free(node);
 }
 
 // Executes a function for each element in the list
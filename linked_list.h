@@ -3,17 +3,21 @@
 
 #include <stdlib.h>
 #include <stddef.h>
+#include <stdbool.h>
 
 typedef struct list_node {
     struct list_node* next;
     struct list_node* prev;
-    pthread_cond_t* select;
-    pthread_mutex_t* select_mutex;
     void* data;
+    // Set for nodes list_insert allocated; nodes linked with list_insert_node belong to the caller
+    bool allocated;
+    // The list the node is linked into, NULL once it has been removed
+    struct list* list;
 } list_node_t;
 
-typedef struct {
+typedef struct list {
     list_node_t* head;
+    list_node_t* tail;
     size_t count;
 } list_t;
 
@@ -39,10 +43,17 @@ size_t list_count(list_t* list);
 // Returns NULL if data could not be found
 list_node_t* list_find(list_t* list, void* data);
 
-// Inserts a new node in the list with the given data
-void list_insert(list_t* list, void* select_mutex, void* select_cond, void* data);
+// Inserts a new node at the end of the list with the given data
+// Returns the node, which list_remove can unlink in constant time
+list_node_t* list_insert(list_t* list, void* data);
 
-// Removes a node from the list and frees the node resources
+// Inserts node, owned by the caller, at the end of the list with the given data without allocating
+// The node may live in the structure data points to; the list never frees it
+void list_insert_node(list_t* list, list_node_t* node, void* data);
+
+// Removes a node from the list and frees the node resources in constant time
+// Nodes linked with list_insert_node are only unlinked, so they may be removed again: removing a node that
+// is not in the list, or NULL, does nothing
 void list_remove(list_t* list, list_node_t* node);
 
 // Executes a function for each element in the list
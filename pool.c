@@ -0,0 +1,315 @@
+#include "pool.h"
+#include <limits.h>
+#include <stdlib.h>
+
+/*
+ * A pool of consumers used to be a set of threads all looping on channel_receive from one channel, so every
+ * task cost a turn on that channel's mutex. Here one idle worker at a time takes a whole batch from the
+ * channel into its own Chase-Lev deque, and works through it from the bottom while idle workers steal from
+ * the top. Taking and stealing only contend on the last task of a deque, and tasks submitted by handlers are
+ * pushed by their own worker, so the source channel's mutex is taken once per batch rather than once per task.
+ *
+ * Idle workers that find nothing to steal while another worker waits on the source sleep on the epoch futex.
+ * Whoever makes work available (a push, the end of a poll, or the close of the source) bumps the epoch and
+ * wakes them, but only if sleepers says somebody is asleep.
+ *
+ * This file keeps the worker a thread is running, if any, in thread-local state, for pool_submit.
+ */
+
+enum pool_steal {
+    POOL_STEAL_SUCCESS,
+    POOL_STEAL_EMPTY,
+    // Lost the race for the task to its owner or another thief; the deque may still hold tasks
+    POOL_STEAL_RETRY
+};
+
+static __thread pool_worker_t* current_pool_worker;
+
+static pool_array_t* pool_array_create(size_t capacity)
+{
+    pool_array_t* array = (pool_array_t*) malloc(sizeof(pool_array_t) + capacity * sizeof(_Atomic(void*)));
+    if(array == NULL)
+        return NULL;
+    array->mask = capacity - 1;
+    array->retired = NULL;
+    return array;
+}
+
+/* Returns false if the deque's array could not be allocated */
+static bool pool_deque_init(pool_deque_t* deque)
+{
+    pool_array_t* array = pool_array_create(POOL_DEQUE_CAPACITY);
+    atomic_init(&deque->top, 0);
+    atomic_init(&deque->bottom, 0);
+    atomic_init(&deque->array, array);
+    return array != NULL;
+}
+
+static void pool_deque_destroy(pool_deque_t* deque)
+{
+    pool_array_t* array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+    while(array != NULL){
+        pool_array_t* retired = array->retired;
+        free(array);
+        array = retired;
+    }
+}
+
+/* Moves the tasks between top and bottom into an array twice as large; only the owner calls it */
+/* Returns NULL, leaving the deque as it was, if the larger array could not be allocated */
+static pool_array_t* pool_deque_grow(pool_deque_t* deque, pool_array_t* array, long top, long bottom)
+{
+    pool_array_t* grown = pool_array_create(2 * (array->mask + 1));
+    if(grown == NULL)
+        return NULL;
+    for(long i = top; i < bottom; i++){
+        void* task = atomic_load_explicit(&array->slots[(size_t)i & array->mask], memory_order_relaxed);
+        atomic_store_explicit(&grown->slots[(size_t)i & grown->mask], task, memory_order_relaxed);
+    }
+    grown->retired = array;
+    atomic_store_explicit(&deque->array, grown, memory_order_release);
+    return grown;
+}
+
+/* Pushes task at the bottom; only the owner calls it. Returns false if the deque is full and could not grow */
+static bool pool_deque_push(pool_deque_t* deque, void* task)
+{
+    long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    pool_array_t* array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+    if((size_t)(bottom - top) > array->mask){
+        array = pool_deque_grow(deque, array, top, bottom);
+        if(array == NULL)
+            return false;
+    }
+    atomic_store_explicit(&array->slots[(size_t)bottom & array->mask], task, memory_order_relaxed);
+    /* Publishes the task, and whatever it points to, to the thief that reads the new bottom */
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_release);
+    return true;
+}
+
+/*
+ * Takes the newest task from the bottom; only the owner calls it. Lowering bottom before reading top (both
+ * sequentially consistent, as are the thieves' loads) means that a thief and the owner cannot both miss each
+ * other, so only a deque down to its last task needs the CAS on top to decide who gets it.
+ */
+static bool pool_deque_take(pool_deque_t* deque, void** task)
+{
+    long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    pool_array_t* array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_seq_cst);
+    long top = atomic_load_explicit(&deque->top, memory_order_seq_cst);
+    if(top > bottom){
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        return false;
+    }
+    *task = atomic_load_explicit(&array->slots[(size_t)bottom & array->mask], memory_order_relaxed);
+    if(top < bottom)
+        return true;
+    bool won = atomic_compare_exchange_strong(&deque->top, &top, top + 1);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    return won;
+}
+
+/* Steals the oldest task from the top; any worker but the owner may call it */
+static enum pool_steal pool_deque_steal(pool_deque_t* deque, void** task)
+{
+    long top = atomic_load_explicit(&deque->top, memory_order_seq_cst);
+    long bottom = atomic_load_explicit(&deque->bottom, memory_order_seq_cst);
+    if(top >= bottom)
+        return POOL_STEAL_EMPTY;
+    /* A retired array still holds the task at top, since the owner only writes to the newest one */
+    pool_array_t* array = atomic_load_explicit(&deque->array, memory_order_acquire);
+    *task = atomic_load_explicit(&array->slots[(size_t)top & array->mask], memory_order_relaxed);
+    if(!atomic_compare_exchange_strong(&deque->top, &top, top + 1))
+        return POOL_STEAL_RETRY;
+    return POOL_STEAL_SUCCESS;
+}
+
+static bool pool_deque_empty(pool_deque_t* deque)
+{
+    return atomic_load_explicit(&deque->top, memory_order_seq_cst) >= atomic_load_explicit(&deque->bottom, memory_order_seq_cst);
+}
+
+static unsigned int pool_random(pool_worker_t* worker)
+{
+    worker->seed ^= worker->seed << 13;
+    worker->seed ^= worker->seed >> 17;
+    worker->seed ^= worker->seed << 5;
+    return worker->seed;
+}
+
+/* Tries every other worker's deque once, from a random one on, and again as long as a steal lost a race */
+static bool pool_steal(pool_worker_t* worker, void** task)
+{
+    pool_t* pool = worker->pool;
+    bool retry = true;
+    while(retry){
+        retry = false;
+        size_t start = pool_random(worker) % pool->worker_count;
+        for(size_t i = 0; i < pool->worker_count; i++){
+            pool_worker_t* victim = &pool->workers[(start + i) % pool->worker_count];
+            if(victim == worker)
+                continue;
+            enum pool_steal result = pool_deque_steal(&victim->deque, task);
+            if(result == POOL_STEAL_SUCCESS)
+                return true;
+            if(result == POOL_STEAL_RETRY)
+                retry = true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Wakes up to count idle workers after work was made available or the pool closed. sleepers is read with a
+ * read-modify-write rather than a load: a sleeper counts itself with one before checking for work, so either
+ * that check sees the change, or this read sees the sleeper (a fence would do, but ThreadSanitizer rejects it).
+ */
+static void pool_notify(pool_t* pool, int count)
+{
+    if(atomic_fetch_add(&pool->sleepers, 0) == 0)
+        return;
+    atomic_fetch_add(&pool->epoch, 1);
+    futex_wake(&pool->epoch, count);
+}
+
+/* True if there is anything for an idle worker to do: a deque to steal from, a poll to take over, or an exit */
+static bool pool_has_work(pool_t* pool)
+{
+    if(!atomic_load(&pool->polling) || atomic_load(&pool->closed))
+        return true;
+    for(size_t i = 0; i < pool->worker_count; i++){
+        if(!pool_deque_empty(&pool->workers[i].deque))
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Called by a worker with nothing to take or steal. If nobody polls the source, the worker takes a batch
+ * from it into its deque, oldest task at the bottom; otherwise it sleeps until there may be work.
+ * Returns false once the source is closed and the worker should exit.
+ */
+static bool pool_idle(pool_worker_t* worker)
+{
+    pool_t* pool = worker->pool;
+    if(atomic_load(&pool->closed))
+        return false;
+    bool polling = false;
+    if(atomic_compare_exchange_strong(&pool->polling, &polling, true)){
+        void* batch[POOL_BATCH];
+        size_t got;
+        enum channel_status status = channel_receive_many(pool->source, batch, POOL_BATCH, &got);
+        if(status == SUCCESS){
+            /* The deque is empty and holds POOL_DEQUE_CAPACITY tasks, so this only fails if that is below POOL_BATCH */
+            for(size_t i = got; i > 0; i--){
+                if(!pool_deque_push(&worker->deque, batch[i - 1]))
+                    pool->handler(batch[i - 1], pool->context);
+            }
+        } else {
+            atomic_store(&pool->closed, true);
+        }
+        atomic_store(&pool->polling, false);
+        /* One woken worker takes over the poll, the others steal from the batch */
+        pool_notify(pool, status == SUCCESS ? (int)got : INT_MAX);
+        return status == SUCCESS;
+    }
+    atomic_fetch_add(&pool->sleepers, 1);
+    unsigned int epoch = atomic_load(&pool->epoch);
+    if(!pool_has_work(pool))
+        futex_wait(&pool->epoch, epoch);
+    atomic_fetch_sub(&pool->sleepers, 1);
+    return true;
+}
+
+static void* pool_worker(void* arg)
+{
+    pool_worker_t* worker = arg;
+    pool_t* pool = worker->pool;
+    current_pool_worker = worker;
+    while(true){
+        void* task;
+        if(pool_deque_take(&worker->deque, &task) || pool_steal(worker, &task))
+            pool->handler(task, pool->context);
+        else if(!pool_idle(worker))
+            break;
+    }
+    current_pool_worker = NULL;
+    return NULL;
+}
+
+/* Frees the first deque_count deques, the workers and the pool; no worker thread may be running */
+static void pool_free(pool_t* pool, size_t deque_count)
+{
+    for(size_t i = 0; i < deque_count; i++)
+        pool_deque_destroy(&pool->workers[i].deque);
+    free(pool->workers);
+    free(pool);
+}
+
+// Creates a pool of worker_count threads that run handler(task, context) for every task received from source
+pool_t* pool_create(channel_t* source, size_t worker_count, void (*handler)(void* task, void* context), void* context)
+{
+    if(source == NULL || worker_count == 0)
+        return NULL;
+    pool_t* pool = (pool_t*) malloc(sizeof(pool_t));
+    if(pool == NULL)
+        return NULL;
+    pool->source = source;
+    pool->handler = handler;
+    pool->context = context;
+    pool->worker_count = worker_count;
+    pool->workers = (pool_worker_t*) aligned_alloc(_Alignof(pool_worker_t), worker_count * sizeof(pool_worker_t));
+    if(pool->workers == NULL){
+        free(pool);
+        return NULL;
+    }
+    atomic_init(&pool->polling, false);
+    atomic_init(&pool->closed, false);
+    atomic_init(&pool->epoch, 0);
+    atomic_init(&pool->sleepers, 0);
+    for(size_t i = 0; i < worker_count; i++){
+        if(!pool_deque_init(&pool->workers[i].deque)){
+            pool_free(pool, i);
+            return NULL;
+        }
+        pool->workers[i].pool = pool;
+        pool->workers[i].seed = (unsigned int)i * 2654435761u + 1;
+    }
+    for(size_t i = 0; i < worker_count; i++){
+        if(pthread_create(&pool->workers[i].thread, NULL, pool_worker, &pool->workers[i]) != 0){
+            /* Stops the workers already started; every deque was initialized, whether its thread started or not */
+            channel_close(source);
+            for(size_t j = 0; j < i; j++)
+                pthread_join(pool->workers[j].thread, NULL);
+            pool_free(pool, worker_count);
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+// Submits a task to the pool
+enum channel_status pool_submit(pool_t* pool, void* task)
+{
+    pool_worker_t* worker = current_pool_worker;
+    if(worker == NULL || worker->pool != pool)
+        return channel_send(pool->source, task);
+    /* Sending to the source instead could block this worker on a full source that only the workers drain */
+    if(!pool_deque_push(&worker->deque, task)){
+        pool->handler(task, pool->context);
+        return SUCCESS;
+    }
+    pool_notify(pool, 1);
+    return SUCCESS;
+}
+
+// Closes the source channel, waits for the workers to run every task they took, then frees the pool
+void pool_destroy(pool_t* pool)
+{
+    channel_close(pool->source);
+    for(size_t i = 0; i < pool->worker_count; i++)
+        pthread_join(pool->workers[i].thread, NULL);
+    pool_free(pool, pool->worker_count);
+}
@@ -0,0 +1,79 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "channel.h"
+#include "futex.h"
+
+// Slots of a worker's deque when it is created; a deque doubles whenever its owner pushes into a full one
+#define POOL_DEQUE_CAPACITY 256
+
+// Most tasks a worker takes from the source channel with one channel_receive_many
+#define POOL_BATCH 32
+
+// Circular array of a deque; arrays a deque outgrew stay on its retired list until the pool is destroyed,
+// since a thief may still be reading from one
+typedef struct pool_array {
+    size_t mask;
+    struct pool_array* retired;
+    _Atomic(void*) slots[];
+} pool_array_t;
+
+// Chase-Lev deque: its owner pushes and takes at bottom, other workers steal at top, and only the last task
+// is ever contended; top and bottom sit on their own cache lines
+typedef struct {
+    _Alignas(64) atomic_long top;
+    _Alignas(64) atomic_long bottom;
+    _Atomic(pool_array_t*) array;
+} pool_deque_t;
+
+// Defines a worker of the pool
+typedef struct {
+    pool_deque_t deque;
+    struct pool* pool;
+    // xorshift state picking the first victim of every round of steals
+    unsigned int seed;
+    pthread_t thread;
+} pool_worker_t;
+
+// Defines a work-stealing pool
+// The workers run handler(task, context) for every task sent to source. Instead of each taking one task per
+// lock acquisition of source, one worker at a time takes a batch with channel_receive_many and keeps it in its
+// deque, where idle workers steal from it; tasks a handler submits go to the deque of its worker and never
+// touch a lock
+typedef struct pool {
+    channel_t* source;
+    void (*handler)(void* task, void* context);
+    void* context;
+    size_t worker_count;
+    pool_worker_t* workers;
+    // Set while a worker takes a batch from source, so that the others sleep instead of piling onto its mutex
+    atomic_bool polling;
+    atomic_bool closed;
+    // epoch changes whenever there may be new work or the pool shuts down; idle workers futex_wait on it,
+    // and sleepers counts them so that pushing a task while nobody is idle costs no system call
+    atomic_uint epoch;
+    atomic_uint sleepers;
+} pool_t;
+
+// Creates a pool of worker_count threads that run handler(task, context) for every task received from source
+// Returns NULL if source is NULL, worker_count is 0 or the pool could not be allocated, and also if the workers
+// could not be started, in which case source has been closed to stop the ones that were
+pool_t* pool_create(channel_t* source, size_t worker_count, void (*handler)(void* task, void* context), void* context);
+
+// Submits a task to the pool
+// Called from a handler of this pool, the task is pushed onto the worker's own deque without taking a lock;
+// from any other thread it is sent to the source channel like channel_send
+// Should the deque be full and unable to grow, the handler runs the task itself before returning
+// Returns SUCCESS, or the status of channel_send
+enum channel_status pool_submit(pool_t* pool, void* task);
+
+// Closes the source channel if it is still open, waits for the workers to run every task they already took
+// (and the tasks those submit), then frees the pool
+// Like any close, tasks still buffered in source are dropped; source itself is left for the caller to destroy
+void pool_destroy(pool_t* pool);
+
+#endif // POOL_H
@@ -0,0 +1,300 @@
+#include "scheduler.h"
+#include <stdlib.h>
+#include <sys/mman.h>
+#ifdef __SANITIZE_THREAD__
+#include <sanitizer/tsan_interface.h>
+#endif
+
+/*
+ * Every worker thread loops over the shared run queue and switches into the next runnable coroutine with
+ * swapcontext. A coroutine gives its worker back control when it finishes or when it parks, so a blocked
+ * channel operation costs a context switch in user space instead of a sleeping OS thread.
+ *
+ * Parking follows the futex_parker protocol. The coroutine stores itself in the parker and switches to its
+ * worker, and only then does the worker announce the park by moving the parker from WAITING to SLEEPING. The
+ * coroutine's context is saved by that point, so whoever wins the parker from SLEEPING (a completer, or the
+ * timer scan when the deadline passes) can requeue it right away with sched_wake, possibly on another worker.
+ *
+ * This is the only file with thread-local state: the worker a thread is running, if any.
+ */
+
+typedef struct {
+    sched_t* sched;
+    ucontext_t context;
+    coroutine_t* running;
+    void* tsan_fiber;
+} sched_worker_t;
+
+static __thread sched_worker_t* current_worker;
+
+/*
+ * A coroutine can resume on a different thread than it suspended on, so the compiler must not reuse a
+ * thread-local address it computed before a switch; reading current_worker only through this function
+ * guarantees a fresh lookup after every switch.
+ */
+static __attribute__((noinline)) sched_worker_t* sched_self(void)
+{
+    return current_worker;
+}
+
+static void* sched_fiber_current(void)
+{
+#ifdef __SANITIZE_THREAD__
+    return __tsan_get_current_fiber();
+#else
+    return NULL;
+#endif
+}
+
+/* Switches from context from to context to, telling ThreadSanitizer which stack runs next */
+static void sched_switch(ucontext_t* from, ucontext_t* to, void* to_fiber)
+{
+#ifdef __SANITIZE_THREAD__
+    __tsan_switch_to_fiber(to_fiber, 0);
+#else
+    (void)to_fiber;
+#endif
+    swapcontext(from, to);
+}
+
+static bool timespec_passed(const struct timespec* deadline, const struct timespec* now)
+{
+    return now->tv_sec > deadline->tv_sec || (now->tv_sec == deadline->tv_sec && now->tv_nsec >= deadline->tv_nsec);
+}
+
+/* Appends coroutine to the run queue; the caller holds sched->mutex */
+static void sched_enqueue(sched_t* sched, coroutine_t* coroutine)
+{
+    list_insert_node(sched->run_queue, &coroutine->run_node, coroutine);
+    futex_cond_signal(&sched->work);
+}
+
+/* Entry point of every coroutine; finishing switches back to the worker, which frees the coroutine */
+static void sched_trampoline(void)
+{
+    sched_worker_t* worker = sched_self();
+    coroutine_t* self = worker->running;
+    self->fn(self->arg);
+    self->finished = true;
+    worker = sched_self();
+    sched_switch(&self->context, &worker->context, worker->tsan_fiber);
+}
+
+/*
+ * Cancels the parks whose deadline has passed and requeues their coroutines. A park that is not yet announced
+ * stays in the list for the next scan, and one that was completed meanwhile is just dropped from it.
+ * Returns whether a deadline is still pending, and the earliest one in next. The caller holds sched->mutex.
+ */
+static bool sched_expire_timers(sched_t* sched, struct timespec* next)
+{
+    if(list_count(sched->timers) == 0)
+        return false;
+    bool pending = false;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    list_node_t* node = list_begin(sched->timers);
+    while(node != NULL){
+        list_node_t* following = list_next(node);
+        coroutine_t* coroutine = list_data(node);
+        unsigned int state = atomic_load_explicit(&coroutine->parker->state, memory_order_acquire);
+        if(state >= FUTEX_PARKER_DONE){
+            list_remove(sched->timers, node);
+        } else if(state == FUTEX_PARKER_SLEEPING && timespec_passed(&coroutine->deadline, &now)){
+            list_remove(sched->timers, node);
+            if(atomic_compare_exchange_strong(&coroutine->parker->state, &state, FUTEX_PARKER_CANCELLED))
+                sched_enqueue(sched, coroutine);
+        } else if(!pending || !timespec_passed(next, &coroutine->deadline)){
+            *next = coroutine->deadline;
+            pending = true;
+        }
+        node = following;
+    }
+    return pending;
+}
+
+/* Runs coroutine until it finishes or parks, then finishes the park on its behalf */
+static void sched_run(sched_worker_t* worker, coroutine_t* coroutine)
+{
+    sched_t* sched = worker->sched;
+    worker->running = coroutine;
+    sched_switch(&worker->context, &coroutine->context, coroutine->tsan_fiber);
+    worker->running = NULL;
+    if(coroutine->finished){
+#ifdef __SANITIZE_THREAD__
+        __tsan_destroy_fiber(coroutine->tsan_fiber);
+#endif
+        munmap(coroutine->stack, SCHED_STACK_SIZE);
+        free(coroutine);
+        pthread_mutex_lock(&sched->mutex);
+        if(--sched->live == 0)
+            futex_cond_broadcast(&sched->done);
+        pthread_mutex_unlock(&sched->mutex);
+        return;
+    }
+    /* The timer goes in before the park is announced, since the coroutine may be resumed right after */
+    futex_parker_t* parker = coroutine->parker;
+    pthread_mutex_lock(&sched->mutex);
+    if(coroutine->has_deadline)
+        list_insert_node(sched->timers, &coroutine->timer_node, coroutine);
+    unsigned int state = FUTEX_PARKER_WAITING;
+    if(!atomic_compare_exchange_strong(&parker->state, &state, FUTEX_PARKER_SLEEPING)){
+        list_remove(sched->timers, &coroutine->timer_node);
+        sched_enqueue(sched, coroutine);
+    } else if(coroutine->has_deadline){
+        /* Let an idle worker recompute how long it may sleep */
+        futex_cond_signal(&sched->work);
+    }
+    pthread_mutex_unlock(&sched->mutex);
+}
+
+static void* sched_worker(void* arg)
+{
+    sched_worker_t worker = {.sched = arg, .running = NULL, .tsan_fiber = sched_fiber_current()};
+    sched_t* sched = worker.sched;
+    current_worker = &worker;
+    pthread_mutex_lock(&sched->mutex);
+    while(true){
+        struct timespec next;
+        bool pending = sched_expire_timers(sched, &next);
+        list_node_t* node = list_begin(sched->run_queue);
+        if(node != NULL){
+            coroutine_t* coroutine = list_data(node);
+            list_remove(sched->run_queue, node);
+            pthread_mutex_unlock(&sched->mutex);
+            sched_run(&worker, coroutine);
+            pthread_mutex_lock(&sched->mutex);
+            continue;
+        }
+        if(sched->stopping)
+            break;
+        futex_cond_timedwait(&sched->work, &sched->mutex, pending ? &next : NULL);
+    }
+    pthread_mutex_unlock(&sched->mutex);
+    current_worker = NULL;
+    return NULL;
+}
+
+// Creates a scheduler with worker_count worker threads
+sched_t* sched_create(size_t worker_count)
+{
+    if(worker_count == 0)
+        return NULL;
+    sched_t* sched = (sched_t*) malloc(sizeof(sched_t));
+    pthread_mutex_init(&sched->mutex, NULL);
+    futex_cond_init(&sched->work);
+    futex_cond_init(&sched->done);
+    sched->run_queue = list_create();
+    sched->timers = list_create();
+    sched->live = 0;
+    sched->stopping = false;
+    sched->worker_count = 0;
+    sched->workers = (pthread_t*) malloc(worker_count * sizeof(pthread_t));
+    for(size_t i = 0; i < worker_count; i++){
+        if(pthread_create(&sched->workers[i], NULL, sched_worker, sched) != 0){
+            sched_destroy(sched);
+            return NULL;
+        }
+        sched->worker_count++;
+    }
+    return sched;
+}
+
+// Creates a coroutine that runs fn(arg) on one of the scheduler's workers
+bool sched_spawn(sched_t* sched, void (*fn)(void*), void* arg)
+{
+    coroutine_t* coroutine = (coroutine_t*) malloc(sizeof(coroutine_t));
+    if(coroutine == NULL)
+        return false;
+    coroutine->stack = mmap(NULL, SCHED_STACK_SIZE, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if(coroutine->stack == MAP_FAILED){
+        free(coroutine);
+        return false;
+    }
+    getcontext(&coroutine->context);
+    coroutine->context.uc_stack.ss_sp = coroutine->stack;
+    coroutine->context.uc_stack.ss_size = SCHED_STACK_SIZE;
+    coroutine->context.uc_link = NULL;
+    makecontext(&coroutine->context, sched_trampoline, 0);
+    coroutine->fn = fn;
+    coroutine->arg = arg;
+    coroutine->sched = sched;
+    coroutine->run_node.list = NULL;
+    coroutine->timer_node.list = NULL;
+    coroutine->parker = NULL;
+    coroutine->has_deadline = false;
+    coroutine->finished = false;
+#ifdef __SANITIZE_THREAD__
+    coroutine->tsan_fiber = __tsan_create_fiber(0);
+#else
+    coroutine->tsan_fiber = NULL;
+#endif
+    pthread_mutex_lock(&sched->mutex);
+    sched->live++;
+    sched_enqueue(sched, coroutine);
+    pthread_mutex_unlock(&sched->mutex);
+    return true;
+}
+
+// Blocks the calling thread until every coroutine spawned on sched has returned
+void sched_wait(sched_t* sched)
+{
+    pthread_mutex_lock(&sched->mutex);
+    while(sched->live > 0)
+        futex_cond_wait(&sched->done, &sched->mutex);
+    pthread_mutex_unlock(&sched->mutex);
+}
+
+// Waits for all coroutines, then stops the workers and frees the scheduler
+void sched_destroy(sched_t* sched)
+{
+    sched_wait(sched);
+    pthread_mutex_lock(&sched->mutex);
+    sched->stopping = true;
+    futex_cond_broadcast(&sched->work);
+    pthread_mutex_unlock(&sched->mutex);
+    for(size_t i = 0; i < sched->worker_count; i++)
+        pthread_join(sched->workers[i], NULL);
+    list_destroy(sched->run_queue);
+    list_destroy(sched->timers);
+    pthread_mutex_destroy(&sched->mutex);
+    free(sched->workers);
+    free(sched);
+}
+
+// Returns the coroutine the calling thread is running, or NULL outside of coroutines
+coroutine_t* sched_current(void)
+{
+    sched_worker_t* worker = sched_self();
+    return worker == NULL ? NULL : worker->running;
+}
+
+// Suspends the calling coroutine until parker is completed or deadline passes
+/* Only a completer or the timer scan requeues a parked coroutine, and both first move the parker past SLEEPING */
+unsigned int sched_park(futex_parker_t* parker, const struct timespec* deadline)
+{
+    sched_worker_t* worker = sched_self();
+    coroutine_t* self = worker->running;
+    atomic_store_explicit(&parker->coroutine, self, memory_order_relaxed);
+    self->parker = parker;
+    self->has_deadline = deadline != NULL;
+    if(deadline != NULL)
+        self->deadline = *deadline;
+    sched_switch(&self->context, &worker->context, worker->tsan_fiber);
+    if(self->has_deadline){
+        sched_t* sched = self->sched;
+        pthread_mutex_lock(&sched->mutex);
+        list_remove(sched->timers, &self->timer_node);
+        pthread_mutex_unlock(&sched->mutex);
+    }
+    return atomic_load_explicit(&parker->state, memory_order_acquire);
+}
+
+// Makes a coroutine suspended in sched_park runnable again
+void sched_wake(coroutine_t* coroutine)
+{
+    sched_t* sched = coroutine->sched;
+    pthread_mutex_lock(&sched->mutex);
+    sched_enqueue(sched, coroutine);
+    pthread_mutex_unlock(&sched->mutex);
+}
@@ -0,0 +1,83 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include <ucontext.h>
+#include "futex.h"
+#include "linked_list.h"
+
+// Stack size of every coroutine; the stacks are reserved lazily, so only the pages a coroutine touches cost memory
+#define SCHED_STACK_SIZE (256 * 1024)
+
+// Defines a coroutine (green thread) run by a scheduler
+typedef struct coroutine {
+    ucontext_t context;
+    void* stack;
+    void (*fn)(void*);
+    void* arg;
+    struct sched* sched;
+    // Links the coroutine into the run queue while it is runnable, and into the timer list while it waits
+    // with a deadline
+    list_node_t run_node;
+    list_node_t timer_node;
+    // The parker the coroutine suspends on, handed to its worker to announce the park, and its deadline
+    futex_parker_t* parker;
+    bool has_deadline;
+    struct timespec deadline;
+    bool finished;
+    // ThreadSanitizer fiber of the coroutine's stack, NULL in regular builds
+    void* tsan_fiber;
+} coroutine_t;
+
+// Defines an M:N scheduler that runs any number of coroutines on a fixed set of worker threads
+// A channel operation that blocks inside a coroutine suspends only that coroutine, and its worker goes on
+// running other ones until a counterpart (a coroutine or a regular thread) completes the operation
+// Lock-free channels (channel_create_spsc/mpmc) still block the whole worker, since they wait on a futex_cond;
+// byte channels (channel_create_bytes) park on their waiter queues and suspend only the coroutine
+typedef struct sched {
+    // mutex protects everything below; work is signalled when a coroutine becomes runnable, done when the
+    // last coroutine finishes
+    pthread_mutex_t mutex;
+    futex_cond_t work;
+    futex_cond_t done;
+    list_t* run_queue;
+    list_t* timers;
+    // Number of coroutines spawned and not yet finished
+    size_t live;
+    bool stopping;
+    size_t worker_count;
+    pthread_t* workers;
+} sched_t;
+
+// Creates a scheduler with worker_count worker threads, which start waiting for coroutines right away
+// Returns NULL if worker_count is 0 or the workers could not be started
+sched_t* sched_create(size_t worker_count);
+
+// Creates a coroutine that runs fn(arg) on one of the scheduler's workers
+// May be called from regular threads and from coroutines
+// Returns false if the coroutine could not be created
+bool sched_spawn(sched_t* sched, void (*fn)(void*), void* arg);
+
+// Blocks the calling thread until every coroutine spawned on sched has returned
+// Must not be called from a coroutine of sched
+void sched_wait(sched_t* sched);
+
+// Waits for all coroutines like sched_wait, then stops the workers and frees the scheduler
+void sched_destroy(sched_t* sched);
+
+// Returns the coroutine the calling thread is running, or NULL outside of coroutines
+coroutine_t* sched_current(void);
+
+// Suspends the calling coroutine until parker is completed, or until deadline (absolute CLOCK_MONOTONIC, may
+// be NULL) passes, in which case the parker is cancelled; returns the parker's final state
+// Used by futex_parker_wait, which is what channel operations block in
+unsigned int sched_park(futex_parker_t* parker, const struct timespec* deadline);
+
+// Makes a coroutine suspended in sched_park runnable again
+// Only the thread that moved the coroutine's parker out of FUTEX_PARKER_SLEEPING may call it
+void sched_wake(coroutine_t* coroutine);
+
+#endif // SCHEDULER_H
@@ -0,0 +1,184 @@
+#include "sharded_channel.h"
+#include <limits.h>
+#include <sched.h>
+#include <stdint.h>
+
+/*
+ * The lanes are plain channels, so a send is a channel_send on one lane and a receive a
+ * channel_non_blocking_receive on a lane whose pending count says it has a message. A sender counts its
+ * message before sending it, and a receiver uncounts it after taking it, so a lane is only skipped when it
+ * has nothing, and a receiver that finds a counted message not there yet knows it is about to arrive.
+ *
+ * Receivers that find no lane with pending messages sleep on the epoch futex. A sender increments pending
+ * and then reads sleepers, while a sleeper increments sleepers and then reads every pending, all sequentially
+ * consistent, so either the sleeper sees the message or the sender sees the sleeper and wakes it. Senders that
+ * find a wakeup already on its way (waking) leave their message to the receiver it wakes, which clears waking
+ * and, if it leaves messages behind while others still sleep, passes the wakeup on. A sender may also set
+ * waking for a receiver that is counted in sleepers but sees the message and never sleeps, which nobody would
+ * clear; so every receiver clears it again before checking the lanes, and only sleeps if they are all empty.
+ */
+
+/* Lane of the calling thread; pthread_t values are addresses, so they are mixed before taking the remainder */
+static sharded_lane_t* sharded_channel_lane(sharded_channel_t* channel)
+{
+    uint64_t id = (uint64_t)pthread_self() * 0x9E3779B97F4A7C15ull;
+    return &channel->lanes[(size_t)(id >> 32) % channel->lane_count];
+}
+
+static void sharded_channel_wake(sharded_channel_t* channel)
+{
+    if(atomic_load(&channel->sleepers) == 0 || atomic_exchange(&channel->waking, true))
+        return;
+    atomic_fetch_add(&channel->epoch, 1);
+    futex_wake(&channel->epoch, 1);
+}
+
+// Creates a sharded channel of lane_count lanes, each buffering up to lane_size messages
+sharded_channel_t* sharded_channel_create(size_t lane_count, size_t lane_size)
+{
+    if(lane_count == 0 || lane_count > SHARDED_CHANNEL_MAX_LANES || lane_size == 0)
+        return NULL;
+    sharded_channel_t* channel = (sharded_channel_t*) aligned_alloc(_Alignof(sharded_channel_t), sizeof(sharded_channel_t));
+    if(channel == NULL)
+        return NULL;
+    channel->lane_count = lane_count;
+    atomic_init(&channel->next, 0);
+    atomic_init(&channel->closed, false);
+    atomic_init(&channel->epoch, 0);
+    atomic_init(&channel->sleepers, 0);
+    atomic_init(&channel->waking, false);
+    for(size_t i = 0; i < lane_count; i++){
+        atomic_init(&channel->lanes[i].pending, 0);
+        channel->lanes[i].channel = channel_create(lane_size);
+        if(channel->lanes[i].channel == NULL){
+            channel->lane_count = i;
+            sharded_channel_close(channel);
+            sharded_channel_destroy(channel);
+            return NULL;
+        }
+    }
+    return channel;
+}
+
+static enum channel_status sharded_channel_send_lane(sharded_channel_t* channel, void* data, bool blocking)
+{
+    if(channel == NULL)
+        return GEN_ERROR;
+    sharded_lane_t* lane = sharded_channel_lane(channel);
+    atomic_fetch_add(&lane->pending, 1);
+    sharded_channel_wake(channel);
+    enum channel_status status = blocking ? channel_send(lane->channel, data) : channel_non_blocking_send(lane->channel, data);
+    if(status != SUCCESS)
+        atomic_fetch_sub(&lane->pending, 1);
+    return status;
+}
+
+// Writes data to the calling thread's lane
+enum channel_status sharded_channel_send(sharded_channel_t* channel, void* data)
+{
+    return sharded_channel_send_lane(channel, data, true);
+}
+
+// Non-blocking version of sharded_channel_send
+enum channel_status sharded_channel_non_blocking_send(sharded_channel_t* channel, void* data)
+{
+    return sharded_channel_send_lane(channel, data, false);
+}
+
+/* Sweeps the lanes with pending messages once; sets *counted if one had a message that was not there yet */
+static enum channel_status sharded_channel_sweep(sharded_channel_t* channel, void** data, bool* counted)
+{
+    size_t start = atomic_fetch_add_explicit(&channel->next, 1, memory_order_relaxed);
+    *counted = false;
+    for(size_t i = 0; i < channel->lane_count; i++){
+        sharded_lane_t* lane = &channel->lanes[(start + i) % channel->lane_count];
+        if(atomic_load(&lane->pending) == 0)
+            continue;
+        enum channel_status status = channel_non_blocking_receive(lane->channel, data);
+        if(status == SUCCESS)
+            atomic_fetch_sub(&lane->pending, 1);
+        if(status != CHANNEL_EMPTY)
+            return status;
+        *counted = true;
+    }
+    if(atomic_load(&channel->closed))
+        return CLOSED_ERROR;
+    return CHANNEL_EMPTY;
+}
+
+// Non-blocking version of sharded_channel_receive
+enum channel_status sharded_channel_non_blocking_receive(sharded_channel_t* channel, void** data)
+{
+    if(channel == NULL)
+        return GEN_ERROR;
+    bool counted;
+    return sharded_channel_sweep(channel, data, &counted);
+}
+
+static bool sharded_channel_any_pending(sharded_channel_t* channel)
+{
+    for(size_t i = 0; i < channel->lane_count; i++){
+        if(atomic_load(&channel->lanes[i].pending) != 0)
+            return true;
+    }
+    return false;
+}
+
+// Reads a message from any lane into data, blocking until one is available
+enum channel_status sharded_channel_receive(sharded_channel_t* channel, void** data)
+{
+    if(channel == NULL)
+        return GEN_ERROR;
+    bool slept = false;
+    while(true){
+        bool counted;
+        enum channel_status status = sharded_channel_sweep(channel, data, &counted);
+        if(status != CHANNEL_EMPTY){
+            if(slept && status == SUCCESS && sharded_channel_any_pending(channel))
+                sharded_channel_wake(channel);
+            return status;
+        }
+        if(counted){
+            /* A sender is between counting its message and putting it in the lane */
+            sched_yield();
+            continue;
+        }
+        atomic_fetch_add(&channel->sleepers, 1);
+        /* A wakeup meant for a receiver that then found a message without sleeping must not outlive it */
+        atomic_store(&channel->waking, false);
+        unsigned int epoch = atomic_load(&channel->epoch);
+        if(!sharded_channel_any_pending(channel) && !atomic_load(&channel->closed)){
+            futex_wait(&channel->epoch, epoch);
+            atomic_store(&channel->waking, false);
+        }
+        atomic_fetch_sub(&channel->sleepers, 1);
+        slept = true;
+    }
+}
+
+// Closes every lane
+enum channel_status sharded_channel_close(sharded_channel_t* channel)
+{
+    if(channel == NULL)
+        return GEN_ERROR;
+    if(atomic_exchange(&channel->closed, true))
+        return CLOSED_ERROR;
+    for(size_t i = 0; i < channel->lane_count; i++)
+        channel_close(channel->lanes[i].channel);
+    atomic_fetch_add(&channel->epoch, 1);
+    futex_wake(&channel->epoch, INT_MAX);
+    return SUCCESS;
+}
+
+// Frees the lanes and the channel
+enum channel_status sharded_channel_destroy(sharded_channel_t* channel)
+{
+    if(channel == NULL)
+        return GEN_ERROR;
+    if(!atomic_load(&channel->closed))
+        return DESTROY_ERROR;
+    for(size_t i = 0; i < channel->lane_count; i++)
+        channel_destroy(channel->lanes[i].channel);
+    free(channel);
+    return SUCCESS;
+}
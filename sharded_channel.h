@@ -0,0 +1,67 @@
+#ifndef SHARDED_CHANNEL_H
+#define SHARDED_CHANNEL_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include "channel.h"
+
+// Most lanes a sharded channel can have
+#define SHARDED_CHANNEL_MAX_LANES 64
+
+// Lane of a sharded channel; pending counts the messages sent to it and not yet received, including a send
+// that is still on its way into the lane, so that receivers skip empty lanes without taking their mutex
+typedef struct {
+    _Alignas(64) channel_t* channel;
+    atomic_size_t pending;
+} sharded_lane_t;
+
+// Defines a sharded channel for many producers feeding few consumers
+// Each lane is a regular channel with its own buffer and mutex. A sender always uses the lane its thread
+// hashes to, so producers on different lanes rarely share a lock and the messages of one producer stay in
+// FIFO order; there is no order between messages of different producers. Receivers sweep the lanes with
+// pending messages from a rotating start, and sleep on epoch only when no lane has any
+typedef struct {
+    size_t lane_count;
+    sharded_lane_t lanes[SHARDED_CHANNEL_MAX_LANES];
+    // Start of the next receiver's sweep, so that receivers spread over the lanes instead of all draining the first
+    atomic_size_t next;
+    atomic_bool closed;
+    // epoch changes when a message is sent while a receiver sleeps, and on close; sleepers counts the
+    // receivers waiting on it so that a send nobody waits for costs no system call, and waking is set while a
+    // wakeup is on its way, so that the sends until the woken receiver runs cost none either
+    _Alignas(64) atomic_uint epoch;
+    atomic_uint sleepers;
+    atomic_bool waking;
+} sharded_channel_t;
+
+// Creates a sharded channel of lane_count lanes, each buffering up to lane_size messages
+// Lanes must be buffered: receivers never wait on a single lane, so an unbuffered lane would have no receiver
+// for a non-blocking send to hand its message to
+// Returns NULL if lane_count is 0 or above SHARDED_CHANNEL_MAX_LANES, if lane_size is 0, or on any other error
+sharded_channel_t* sharded_channel_create(size_t lane_count, size_t lane_size);
+
+// Writes data to the calling thread's lane, blocking while that lane is full even if others have room
+// Returns SUCCESS, CLOSED_ERROR if the channel is closed, and GEN_ERROR on any other error
+enum channel_status sharded_channel_send(sharded_channel_t* channel, void* data);
+
+// Reads a message from any lane into data, blocking until one is available
+// Returns SUCCESS, CLOSED_ERROR if the channel is closed, and GEN_ERROR on any other error
+enum channel_status sharded_channel_receive(sharded_channel_t* channel, void** data);
+
+// Non-blocking version of sharded_channel_send
+// Returns CHANNEL_FULL if the calling thread's lane is full, otherwise the same values as sharded_channel_send
+enum channel_status sharded_channel_non_blocking_send(sharded_channel_t* channel, void* data);
+
+// Non-blocking version of sharded_channel_receive
+// Returns CHANNEL_EMPTY if every lane is empty, otherwise the same values as sharded_channel_receive
+enum channel_status sharded_channel_non_blocking_receive(sharded_channel_t* channel, void** data);
+
+// Closes every lane, which makes blocked and future calls return CLOSED_ERROR
+// Returns SUCCESS, or CLOSED_ERROR if the channel is already closed
+enum channel_status sharded_channel_close(sharded_channel_t* channel);
+
+// Frees the lanes and the channel, which must be closed first
+// Returns SUCCESS, or DESTROY_ERROR if the channel is not closed
+enum channel_status sharded_channel_destroy(sharded_channel_t* channel);
+
+#endif // SHARDED_CHANNEL_H
@@ -5,6 +5,7 @@
 #include <stdbool.h>
 #include "channel.h"
 #include "stress.h"
+#include "scheduler.h"
 
 typedef unsigned int distance_t;
 typedef struct {
@@ -174,14 +175,19 @@ void* router(void* arg)
             select_count++;
         }
     }
+    // the cases are registered on their channels once; sent SEND cases are disabled until the next broadcast
+    select_set_t* select_set = select_set_create(select_list, select_count);
+    assert(select_set != NULL);
+    free(select_list);
     while (true) {
-        enum channel_status status = channel_select(select_list, select_count, &selected_index);
+        // the set resumes its scan after the last selected case, so the SEND slots are not starved by the two RECV slots
+        enum channel_status status = select_set_wait(select_set, &selected_index);
         if (status == SUCCESS) {
             assert(selected_index != 0);
             if (selected_index == 1) {
-                if (select_list[selected_index].data) {
+                if (select_set->list[selected_index].data) {
                     // update next_state with new data
-                    distance_vector_t* neighbor_state = select_list[selected_index].data;
+                    distance_vector_t* neighbor_state = select_set->list[selected_index].data;
                     distance_t neighbor_dist = get_link_distance(index, neighbor_state->src);
                     assert(neighbor_dist != inf_distance);
                     for (size_t i = 0; i < num_channel; i++) {
@@ -193,19 +199,17 @@ void* router(void* arg)
                     }
                 } else {
                     // special message sent to test convergence
-                    bool converged = (select_count == 2) && !changed;
+                    bool converged = (select_set->count == 2) && !changed;
                     status = channel_send(completed_channel, converged ? curr_state : NULL);
                     assert(status == SUCCESS);
                 }
             } else {
-                select_count--;
                 // swap last element and selected element
-                channel_t* temp = select_list[select_count].channel;
-                select_list[select_count].channel = select_list[selected_index].channel;
-                select_list[selected_index].channel = temp;
+                status = select_set_disable(select_set, selected_index);
+                assert(status == SUCCESS);
             }
             // check if we've sent to everyone
-            if (select_count == 2) {
+            if (select_set->count == 2) {
                 // check if we want to reset
                 if (changed) {
                     // cycle triple buffer
@@ -219,9 +223,12 @@ void* router(void* arg)
                         next_state->dist[i] = curr_state->dist[i];
                     }
                     // reset to broadcast again
-                    select_count = total_select_count;
-                    for (size_t i = 2; i < select_count; i++) {
-                        select_list[i].data = curr_state;
+                    while (select_set->count < total_select_count) {
+                        status = select_set_enable(select_set, select_set->count);
+                        assert(status == SUCCESS);
+                    }
+                    for (size_t i = 2; i < select_set->count; i++) {
+                        select_set->list[i].data = curr_state;
                     }
                     changed = false;
                 }
@@ -233,7 +240,7 @@ void* router(void* arg)
             break;
         }
     }
-    free(select_list);
+    select_set_destroy(select_set);
     free(prev_prev_state);
     free(prev_state);
     free(curr_state);
@@ -299,7 +306,13 @@ bool check_done()
     return valid;
 }
 
-void run_stress(size_t main_buffer_size, size_t secondary_buffer_size, const char* filename)
+void router_coroutine(void* arg)
+{
+    router(arg);
+}
+
+// Runs the routers as OS threads, or as coroutines of sched when it is not NULL
+void run_stress_on(size_t main_buffer_size, size_t secondary_buffer_size, const char* filename, sched_t* sched)
 {
     assert(main_buffer_size <= 1); // only support up to a buffer size of 1
     assert(secondary_buffer_size <= 1); // only support up to a buffer size of 1
@@ -321,8 +334,13 @@ void run_stress(size_t main_buffer_size, size_t secondary_buffer_size, const cha
     pthread_t* pid = malloc(sizeof(pthread_t) * num_channel);
     assert(pid != NULL);
     for (size_t i = 0; i < num_channel; i++) {
-        pthread_status = pthread_create(&pid[i], NULL, router, (void*)i);
-        assert(pthread_status == 0);
+        if (sched != NULL) {
+            bool spawned = sched_spawn(sched, router_coroutine, (void*)i);
+            assert(spawned);
+        } else {
+            pthread_status = pthread_create(&pid[i], NULL, router, (void*)i);
+            assert(pthread_status == 0);
+        }
     }
 
     // wait for convergence
@@ -334,8 +352,12 @@ void run_stress(size_t main_buffer_size, size_t secondary_buffer_size, const cha
     status = channel_close(done_channel);
     assert(status == SUCCESS);
     // join threads
-    for (size_t i = 0; i < num_channel; i++) {
-        pthread_join(pid[i], NULL);
+    if (sched != NULL) {
+        sched_wait(sched);
+    } else {
+        for (size_t i = 0; i < num_channel; i++) {
+            pthread_join(pid[i], NULL);
+        }
     }
     // cleanup
     status = channel_destroy(done_channel);
@@ -354,3 +376,16 @@ void run_stress(size_t main_buffer_size, size_t secondary_buffer_size, const cha
     free(channels);
     destroy_topology();
 }
+
+void run_stress(size_t main_buffer_size, size_t secondary_buffer_size, const char* filename)
+{
+    run_stress_on(main_buffer_size, secondary_buffer_size, filename, NULL);
+}
+
+void run_stress_coroutines(size_t main_buffer_size, size_t secondary_buffer_size, const char* filename, size_t workers)
+{
+    sched_t* sched = sched_create(workers);
+    assert(sched != NULL);
+    run_stress_on(main_buffer_size, secondary_buffer_size, filename, sched);
+    sched_destroy(sched);
+}
@@ -3,4 +3,7 @@
 
 void run_stress(size_t main_buffer_size, size_t secondary_buffer_size, const char* filename);
 
+// Same as run_stress, with every router running as a coroutine on a scheduler with the given number of workers
+void run_stress_coroutines(size_t main_buffer_size, size_t secondary_buffer_size, const char* filename, size_t workers);
+
 #endif // STRESS_H
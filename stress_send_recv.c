@@ -6,6 +6,8 @@
 #include <stdatomic.h>
 #include "channel.h"
 #include "stress_send_recv.h"
+#include "pool.h"
+#include "broadcast.h"
 
 size_t num_channel;
 channel_t** channels;
@@ -134,3 +136,130 @@ void run_stress_send_recv(size_t buffer_size, size_t num_threads, double load, u
     free(pid);
     free(channels);
 }
+
+typedef struct {
+    pool_t* pool;
+    size_t num_msgs;
+    size_t fanout;
+    atomic_uint* msg_check;
+    atomic_size_t remaining;
+    channel_t* done_channel;
+} stress_pool_t;
+
+// Handles every message once; each message sent by run_stress_pool submits fanout more from its worker
+void stress_pool_handler(void* task, void* context)
+{
+    stress_pool_t* stress = context;
+    size_t msg = (size_t)task;
+    assert((1 <= msg) && (msg <= stress->num_msgs * (stress->fanout + 1)));
+    if (msg <= stress->num_msgs) {
+        for (size_t i = 1; i <= stress->fanout; i++) {
+            enum channel_status status = pool_submit(stress->pool, (void*)(msg + i * stress->num_msgs));
+            assert(status == SUCCESS);
+        }
+    }
+    // check that data wasn't duplicated
+    unsigned int seen = atomic_fetch_add(&stress->msg_check[msg], 1);
+    assert(seen == 0);
+    if (atomic_fetch_sub(&stress->remaining, 1) == 1) {
+        enum channel_status status = channel_send(stress->done_channel, NULL);
+        assert(status == SUCCESS);
+    }
+}
+
+void run_stress_pool(size_t buffer_size, size_t num_threads, size_t num_msgs, size_t fanout)
+{
+    enum channel_status status;
+    // setup
+    size_t total = num_msgs * (fanout + 1);
+    stress_pool_t stress = {.num_msgs = num_msgs, .fanout = fanout};
+    stress.msg_check = calloc(total + 1, sizeof(atomic_uint));
+    assert(stress.msg_check != NULL);
+    atomic_init(&stress.remaining, total);
+    stress.done_channel = channel_create(1);
+    assert(stress.done_channel != NULL);
+    channel_t* source = channel_create(buffer_size);
+    assert(source != NULL);
+    stress.pool = pool_create(source, num_threads, stress_pool_handler, &stress);
+    assert(stress.pool != NULL);
+
+    // start test
+    for (size_t msg = 1; msg <= num_msgs; msg++) {
+        status = pool_submit(stress.pool, (void*)msg);
+        assert(status == SUCCESS);
+    }
+    // wait until every message, including the submitted ones, was handled
+    void* data;
+    status = channel_receive(stress.done_channel, &data);
+    assert(status == SUCCESS);
+    for (size_t msg = 1; msg <= total; msg++) {
+        assert(atomic_load(&stress.msg_check[msg]) == 1);
+    }
+
+    // cleanup
+    pool_destroy(stress.pool);
+    status = channel_destroy(source);
+    assert(status == SUCCESS);
+    status = channel_close(stress.done_channel);
+    assert(status == SUCCESS);
+    status = channel_destroy(stress.done_channel);
+    assert(status == SUCCESS);
+    free(stress.msg_check);
+}
+
+typedef struct {
+    broadcast_sub_t* sub;
+    size_t num_msgs;
+} stress_subscriber_t;
+
+// Receives until the broadcast channel is closed, checking that no message is lost, duplicated or reordered
+void* stress_subscriber(void* arg)
+{
+    stress_subscriber_t* subscriber = arg;
+    size_t expected = 1;
+    void* data = NULL;
+    while (broadcast_receive(subscriber->sub, &data) == SUCCESS) {
+        assert((size_t)data == expected);
+        expected++;
+    }
+    assert(expected == subscriber->num_msgs + 1);
+    return NULL;
+}
+
+void run_stress_broadcast(size_t capacity, size_t num_threads, size_t num_msgs)
+{
+    enum channel_status status;
+    // setup
+    broadcast_t* broadcast = broadcast_create(capacity, BROADCAST_BLOCK);
+    assert(broadcast != NULL);
+    stress_subscriber_t* subscribers = malloc(sizeof(stress_subscriber_t) * num_threads);
+    assert(subscribers != NULL);
+    pthread_t* pid = malloc(sizeof(pthread_t) * num_threads);
+    assert(pid != NULL);
+    for (size_t i = 0; i < num_threads; i++) {
+        subscribers[i].sub = broadcast_subscribe(broadcast);
+        assert(subscribers[i].sub != NULL);
+        subscribers[i].num_msgs = num_msgs;
+        int pthread_status = pthread_create(&pid[i], NULL, stress_subscriber, &subscribers[i]);
+        assert(pthread_status == 0);
+    }
+
+    // start test
+    for (size_t msg = 1; msg <= num_msgs; msg++) {
+        status = broadcast_publish(broadcast, (void*)msg);
+        assert(status == SUCCESS);
+    }
+    // subscribers still receive what was published before the close
+    status = broadcast_close(broadcast);
+    assert(status == SUCCESS);
+    for (size_t i = 0; i < num_threads; i++) {
+        pthread_join(pid[i], NULL);
+        broadcast_unsubscribe(subscribers[i].sub);
+    }
+
+    // cleanup
+    status = broadcast_destroy(broadcast);
+    assert(status == SUCCESS);
+    free(subscribers);
+    free(pid);
+}
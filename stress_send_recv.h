@@ -3,4 +3,12 @@
 
 void run_stress_send_recv(size_t buffer_size, size_t num_threads, double load, useconds_t duration_usec);
 
+// Feeds num_msgs messages to a work-stealing pool of num_threads workers through a channel of buffer_size, and
+// checks that every one of them, and the fanout messages each submits from its handler, is handled exactly once
+void run_stress_pool(size_t buffer_size, size_t num_threads, size_t num_msgs, size_t fanout);
+
+// Publishes num_msgs messages on a blocking broadcast channel of the given capacity, and checks that each of
+// num_threads subscribers receives all of them in order
+void run_stress_broadcast(size_t capacity, size_t num_threads, size_t num_msgs);
+
 #endif // STRESS_SEND_RECV_H
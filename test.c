@@ -6,10 +6,15 @@
 #include <stdlib.h>
 #include <time.h>
 #include <sys/resource.h>
+#include <poll.h>
 #include <string.h>
 #include <stdbool.h>
 #include "stress.h"
 #include "stress_send_recv.h"
+#include "scheduler.h"
+#include "pool.h"
+#include "sharded_channel.h"
+#include "broadcast.h"
 
 #define mu_str_(text) #text
 #define mu_str(text) mu_str_(text)
@@ -2003,6 +2008,1862 @@ char* test_select_mixed_buffered_unbuffered() {
     return NULL;
 }
 
+#define SPSC_MESSAGES 10000
+
+void* helper_spsc_producer(send_args *myargs) {
+    myargs->out = SUCCESS;
+    for (size_t i = 1; i <= SPSC_MESSAGES; i++) {
+        enum channel_status status = channel_send(myargs->channel, (void*)i);
+        if (status != SUCCESS) {
+            myargs->out = status;
+            break;
+        }
+    }
+    return NULL;
+}
+
+char* test_spsc() {
+    print_test_details(__func__, "Testing single-producer/single-consumer channel");
+
+    mu_assert("test_spsc: Unbuffered SPSC channel should not be created", channel_create_spsc(0) == NULL);
+
+    size_t capacity = 4;
+    channel_t* channel = channel_create_spsc(capacity);
+    mu_assert("test_spsc: Could not create channel", channel != NULL);
+    mu_assert("test_spsc: Buffer capacity is not as expected", buffer_capacity(channel->buffer) == capacity);
+
+    /* Non-blocking calls report empty and full on the lock-free ring */
+    void* data = NULL;
+    mu_assert("test_spsc: Empty channel should return CHANNEL_EMPTY", channel_non_blocking_receive(channel, &data) == CHANNEL_EMPTY);
+    for (size_t i = 1; i <= capacity; i++) {
+        mu_assert("test_spsc: Non-blocking send failed", channel_non_blocking_send(channel, (void*)i) == SUCCESS);
+    }
+    mu_assert("test_spsc: Buffer size is not as expected", buffer_current_size(channel->buffer) == capacity);
+    mu_assert("test_spsc: Full channel should return CHANNEL_FULL", channel_non_blocking_send(channel, "Message") == CHANNEL_FULL);
+    for (size_t i = 1; i <= capacity; i++) {
+        mu_assert("test_spsc: Non-blocking receive failed", channel_non_blocking_receive(channel, &data) == SUCCESS);
+        mu_assert("test_spsc: Received message out of order", (size_t)data == i);
+    }
+
+    /* Stream messages through the ring so both sides park on full and empty */
+    pthread_t pid;
+    send_args send_;
+    init_object_for_send_api(&send_, channel, NULL, NULL);
+    pthread_create(&pid, NULL, (void *)helper_spsc_producer, &send_);
+    for (size_t i = 1; i <= SPSC_MESSAGES; i++) {
+        mu_assert("test_spsc: Receive failed", channel_receive(channel, &data) == SUCCESS);
+        mu_assert("test_spsc: Received message out of order", (size_t)data == i);
+    }
+    pthread_join(pid, NULL);
+    mu_assert("test_spsc: Send failed", send_.out == SUCCESS);
+    mu_assert("test_spsc: Buffer size is not as expected", buffer_current_size(channel->buffer) == 0);
+
+    select_t list[1];
+    list[0].channel = channel;
+    list[0].dir = RECV;
+    size_t index;
+    mu_assert("test_spsc: Select on SPSC channel should return GEN_ERROR", channel_select(list, 1, &index) == GEN_ERROR);
+
+    /* A receiver parked on the empty ring must be released by close */
+    receive_args rec_;
+    init_object_for_receive_api(&rec_, channel, NULL);
+    pthread_create(&pid, NULL, (void *)helper_receive, &rec_);
+    usleep(10000);
+    mu_assert("test_spsc: It isn't blocked as expected", rec_.out == GEN_ERROR);
+    mu_assert("test_spsc: Can't close channel", channel_close(channel) == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_spsc: Channel is closed, receive should return CLOSED_ERROR", rec_.out == CLOSED_ERROR);
+
+    channel_destroy(channel);
+    return NULL;
+}
+
+#define MPMC_THREADS 4
+#define MPMC_MESSAGES 2000
+
+typedef struct {
+    channel_t* channel;
+    size_t index;
+    bool* seen;
+    enum channel_status out;
+} mpmc_args;
+
+void* helper_mpmc_producer(mpmc_args *myargs) {
+    myargs->out = SUCCESS;
+    for (size_t i = 1; i <= MPMC_MESSAGES; i++) {
+        enum channel_status status = channel_send(myargs->channel, (void*)(myargs->index * MPMC_MESSAGES + i));
+        if (status != SUCCESS) {
+            myargs->out = status;
+            break;
+        }
+    }
+    return NULL;
+}
+
+void* helper_mpmc_consumer(mpmc_args *myargs) {
+    myargs->out = SUCCESS;
+    while (true) {
+        void* data = NULL;
+        // Mix both paths: the lock-free attempt first, then park if nothing was there
+        enum channel_status status = channel_non_blocking_receive(myargs->channel, &data);
+        if (status == CHANNEL_EMPTY) {
+            status = channel_receive(myargs->channel, &data);
+        }
+        if (status != SUCCESS) {
+            myargs->out = status;
+            break;
+        }
+        if (data == NULL) {
+            break;
+        }
+        if (myargs->seen[(size_t)data]) {
+            myargs->out = GEN_ERROR;
+        }
+        myargs->seen[(size_t)data] = true;
+    }
+    return NULL;
+}
+
+char* test_mpmc() {
+    print_test_details(__func__, "Testing multi-producer/multi-consumer lock-free channel");
+
+    mu_assert("test_mpmc: Unbuffered MPMC channel should not be created", channel_create_mpmc(0) == NULL);
+
+    /* A single slot ring must still distinguish full from empty */
+    channel_t* channel = channel_create_mpmc(1);
+    mu_assert("test_mpmc: Could not create channel", channel != NULL);
+    void* data = NULL;
+    mu_assert("test_mpmc: Empty channel should return CHANNEL_EMPTY", channel_non_blocking_receive(channel, &data) == CHANNEL_EMPTY);
+    mu_assert("test_mpmc: Non-blocking send failed", channel_non_blocking_send(channel, "Message1") == SUCCESS);
+    mu_assert("test_mpmc: Full channel should return CHANNEL_FULL", channel_non_blocking_send(channel, "Message2") == CHANNEL_FULL);
+    mu_assert("test_mpmc: Buffer size is not as expected", buffer_current_size(channel->buffer) == 1);
+    mu_assert("test_mpmc: Non-blocking receive failed", channel_non_blocking_receive(channel, &data) == SUCCESS);
+    mu_assert("test_mpmc: Received wrong message", string_equal(data, "Message1"));
+    mu_assert("test_mpmc: Empty channel should return CHANNEL_EMPTY", channel_non_blocking_receive(channel, &data) == CHANNEL_EMPTY);
+    channel_close(channel);
+    channel_destroy(channel);
+
+    /* Every message sent by any producer must be received exactly once */
+    channel = channel_create_mpmc(8);
+    bool* seen = calloc(MPMC_THREADS * MPMC_MESSAGES + 1, sizeof(bool));
+    pthread_t send_pid[MPMC_THREADS];
+    pthread_t rec_pid[MPMC_THREADS];
+    mpmc_args send_args_[MPMC_THREADS];
+    mpmc_args rec_args_[MPMC_THREADS];
+    for (size_t i = 0; i < MPMC_THREADS; i++) {
+        rec_args_[i] = (mpmc_args){channel, i, seen, GEN_ERROR};
+        pthread_create(&rec_pid[i], NULL, (void *)helper_mpmc_consumer, &rec_args_[i]);
+    }
+    for (size_t i = 0; i < MPMC_THREADS; i++) {
+        send_args_[i] = (mpmc_args){channel, i, seen, GEN_ERROR};
+        pthread_create(&send_pid[i], NULL, (void *)helper_mpmc_producer, &send_args_[i]);
+    }
+    for (size_t i = 0; i < MPMC_THREADS; i++) {
+        pthread_join(send_pid[i], NULL);
+        mu_assert("test_mpmc: Send failed", send_args_[i].out == SUCCESS);
+    }
+    for (size_t i = 0; i < MPMC_THREADS; i++) {
+        // NULL tells a consumer to stop
+        mu_assert("test_mpmc: Send failed", channel_send(channel, NULL) == SUCCESS);
+    }
+    for (size_t i = 0; i < MPMC_THREADS; i++) {
+        pthread_join(rec_pid[i], NULL);
+        mu_assert("test_mpmc: Receive failed or message duplicated", rec_args_[i].out == SUCCESS);
+    }
+    for (size_t i = 1; i <= MPMC_THREADS * MPMC_MESSAGES; i++) {
+        mu_assert("test_mpmc: Message was lost", seen[i]);
+    }
+    free(seen);
+
+    /* A receiver parked on the empty ring must be released by close */
+    pthread_t pid;
+    receive_args rec_;
+    init_object_for_receive_api(&rec_, channel, NULL);
+    pthread_create(&pid, NULL, (void *)helper_receive, &rec_);
+    usleep(10000);
+    mu_assert("test_mpmc: It isn't blocked as expected", rec_.out == GEN_ERROR);
+    mu_assert("test_mpmc: Can't close channel", channel_close(channel) == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_mpmc: Channel is closed, receive should return CLOSED_ERROR", rec_.out == CLOSED_ERROR);
+    mu_assert("test_mpmc: Channel is closed, send should return CLOSED_ERROR", channel_non_blocking_send(channel, "Message") == CLOSED_ERROR);
+
+    channel_destroy(channel);
+    return NULL;
+}
+
+#define WAIT_POLICY_ROUNDS 100
+
+void* helper_echo(send_args *myargs) {
+    // Bounces every message received on channel back on the channel passed in data
+    channel_t* reply = myargs->data;
+    myargs->out = SUCCESS;
+    while (true) {
+        void* data = NULL;
+        enum channel_status status = channel_receive(myargs->channel, &data);
+        if (status != SUCCESS) {
+            if (status != CLOSED_ERROR) {
+                myargs->out = status;
+            }
+            break;
+        }
+        status = channel_send(reply, data);
+        if (status != SUCCESS) {
+            myargs->out = status;
+            break;
+        }
+    }
+    return NULL;
+}
+
+char* test_wait_policy() {
+    print_test_details(__func__, "Testing spin/yield/park wait policy");
+
+    channel_attr_t attr;
+    channel_attr_init(&attr);
+    mu_assert("test_wait_policy: Default policy should park", attr.wait_policy == CHANNEL_WAIT_PARK);
+
+    /* A parker completed before its owner gets to sleep was not slept on */
+    futex_parker_t parker;
+    enum futex_wait_phase phase;
+    futex_parker_init(&parker);
+    mu_assert("test_wait_policy: Completing a waiting parker failed", futex_parker_complete(&parker, FUTEX_PARKER_DONE));
+    mu_assert("test_wait_policy: Completed parker returned the wrong value", futex_parker_wait(&parker, 0, 0, NULL, &phase) == FUTEX_PARKER_DONE);
+    mu_assert("test_wait_policy: Parker completed before the sleep should not count as parked", phase == FUTEX_WAIT_NONE);
+
+    /* A blocked receive on a default channel is always resolved by parking */
+    channel_t* channel = channel_create_with_attr(1, NULL);
+    pthread_t pid;
+    receive_args rec_;
+    init_object_for_receive_api(&rec_, channel, NULL);
+    pthread_create(&pid, NULL, (void *)helper_receive, &rec_);
+    usleep(10000);
+    mu_assert("test_wait_policy: Send failed", channel_send(channel, "Message") == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_wait_policy: Receive failed", rec_.out == SUCCESS && string_equal(rec_.data, "Message"));
+    channel_wait_stats_t stats;
+    channel_get_wait_stats(channel, &stats);
+    mu_assert("test_wait_policy: Default channel should never spin or yield", stats.spin == 0 && stats.yield == 0);
+    mu_assert("test_wait_policy: Blocked receive was not counted", stats.park >= 1);
+    channel_close(channel);
+    channel_destroy(channel);
+
+    /* Ping-pong through two adaptive channels, every wait must be accounted to one phase */
+    attr.wait_policy = CHANNEL_WAIT_ADAPTIVE;
+    attr.spin_count = 100;
+    attr.yield_count = 16;
+    channel_t* request = channel_create_with_attr(1, &attr);
+    channel_t* reply = channel_create_with_attr(1, &attr);
+    send_args echo;
+    init_object_for_send_api(&echo, request, (char*)reply, NULL);
+    pthread_create(&pid, NULL, (void *)helper_echo, &echo);
+    for (size_t i = 1; i <= WAIT_POLICY_ROUNDS; i++) {
+        void* data = NULL;
+        mu_assert("test_wait_policy: Send failed", channel_send(request, (void*)i) == SUCCESS);
+        mu_assert("test_wait_policy: Receive failed", channel_receive(reply, &data) == SUCCESS);
+        mu_assert("test_wait_policy: Received wrong message", (size_t)data == i);
+    }
+    channel_close(request);
+    pthread_join(pid, NULL);
+    mu_assert("test_wait_policy: Echo thread failed", echo.out == SUCCESS);
+    channel_get_wait_stats(reply, &stats);
+    mu_assert("test_wait_policy: Waits on reply channel were not counted", stats.spin + stats.yield + stats.park >= 1);
+
+    channel_destroy(request);
+    channel_close(reply);
+    channel_destroy(reply);
+
+    /* Lock-free channels poll the ring itself: the same ping-pong must see waits resolved while spinning or yielding */
+    for (int mpmc = 0; mpmc < 2; mpmc++) {
+        request = mpmc ? channel_create_mpmc_with_attr(1, &attr) : channel_create_spsc_with_attr(1, &attr);
+        reply = mpmc ? channel_create_mpmc_with_attr(1, &attr) : channel_create_spsc_with_attr(1, &attr);
+        mu_assert("test_wait_policy: Create failed", request != NULL && reply != NULL && reply->lock_free);
+        init_object_for_send_api(&echo, request, (char*)reply, NULL);
+        pthread_create(&pid, NULL, (void *)helper_echo, &echo);
+        for (size_t i = 1; i <= WAIT_POLICY_ROUNDS; i++) {
+            void* data = NULL;
+            mu_assert("test_wait_policy: Send failed", channel_send(request, (void*)i) == SUCCESS);
+            mu_assert("test_wait_policy: Receive failed", channel_receive(reply, &data) == SUCCESS);
+            mu_assert("test_wait_policy: Received wrong message", (size_t)data == i);
+        }
+        channel_close(request);
+        pthread_join(pid, NULL);
+        mu_assert("test_wait_policy: Echo thread failed", echo.out == SUCCESS);
+        channel_get_wait_stats(reply, &stats);
+        mu_assert("test_wait_policy: Lock-free channel never resolved a wait by polling", stats.spin + stats.yield >= 1);
+        channel_destroy(request);
+        channel_close(reply);
+        channel_destroy(reply);
+    }
+
+    /* With the default policy a lock-free channel only parks, and only counts the waits that did */
+    channel = channel_create_spsc_with_attr(1, NULL);
+    init_object_for_receive_api(&rec_, channel, NULL);
+    pthread_create(&pid, NULL, (void *)helper_receive, &rec_);
+    usleep(10000);
+    mu_assert("test_wait_policy: Send failed", channel_send(channel, "Message") == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_wait_policy: Receive failed", rec_.out == SUCCESS && string_equal(rec_.data, "Message"));
+    channel_get_wait_stats(channel, &stats);
+    mu_assert("test_wait_policy: Default lock-free channel should never spin or yield", stats.spin == 0 && stats.yield == 0);
+    mu_assert("test_wait_policy: Parked receive was not counted", stats.park == 1);
+    channel_close(channel);
+    channel_destroy(channel);
+    return NULL;
+}
+
+char* test_wake_without_waiters() {
+    print_test_details(__func__, "Testing that sends and receives nobody waits for make no futex wake");
+
+    /* seq only moves once a signal got past the waiter count, so an unchanged seq means no FUTEX_WAKE was made */
+    futex_cond_t cond = {0};
+    futex_cond_signal(&cond);
+    futex_cond_broadcast(&cond);
+    mu_assert("test_wake_without_waiters: Signal without waiters reached the futex", atomic_load(&cond.seq) == 0);
+
+    channel_t* channels[2] = {channel_create_spsc(4), channel_create_mpmc(4)};
+    for (size_t c = 0; c < 2; c++) {
+        channel_t* channel = channels[c];
+        void* data;
+        for (size_t round = 0; round < 100; round++) {
+            mu_assert("test_wake_without_waiters: Send failed", channel_send(channel, "Message") == SUCCESS);
+            mu_assert("test_wake_without_waiters: Non-blocking send failed", channel_non_blocking_send(channel, "Message") == SUCCESS);
+            mu_assert("test_wake_without_waiters: Receive failed", channel_receive(channel, &data) == SUCCESS);
+            mu_assert("test_wake_without_waiters: Non-blocking receive failed", channel_non_blocking_receive(channel, &data) == SUCCESS);
+        }
+        mu_assert("test_wake_without_waiters: Uncontended send signalled receivers", atomic_load(&channel->full.seq) == 0);
+        mu_assert("test_wake_without_waiters: Uncontended receive signalled senders", atomic_load(&channel->empty.seq) == 0);
+        mu_assert("test_wake_without_waiters: Nobody should have slept",
+                  atomic_load(&channel->full.sleepers) == 0 && atomic_load(&channel->empty.sleepers) == 0);
+        channel_close(channel);
+        channel_destroy(channel);
+    }
+
+    /* Locked channels only wake a waiter they dequeued, and there is none to dequeue */
+    channel_t* channel = channel_create(4);
+    void* data;
+    for (size_t round = 0; round < 100; round++) {
+        mu_assert("test_wake_without_waiters: Send failed", channel_send(channel, "Message") == SUCCESS);
+        mu_assert("test_wake_without_waiters: Receive failed", channel_receive(channel, &data) == SUCCESS);
+    }
+    mu_assert("test_wake_without_waiters: Uncontended operations queued waiters", channel->sendq->count == 0 && channel->recvq->count == 0);
+    channel_close(channel);
+    channel_destroy(channel);
+    return NULL;
+}
+
+char* test_handoff() {
+    print_test_details(__func__, "Testing direct handoff to parked receivers and senders");
+
+    /* Receivers parked on an empty channel get the message directly in the order they arrived */
+    channel_t* channel = channel_create(1);
+    pthread_t pid[2];
+    receive_args data_rec[2];
+    for (int i = 0; i < 2; i++) {
+        init_object_for_receive_api(&data_rec[i], channel, NULL);
+        pthread_create(&pid[i], NULL, (void *)helper_receive, &data_rec[i]);
+        usleep(10000);
+    }
+    mu_assert("test_handoff: Send failed", channel_send(channel, "Message1") == SUCCESS);
+    pthread_join(pid[0], NULL);
+    mu_assert("test_handoff: Oldest receiver did not get the message", data_rec[0].out == SUCCESS && string_equal(data_rec[0].data, "Message1"));
+    mu_assert("test_handoff: Handed off message went through the buffer", buffer_current_size(channel->buffer) == 0);
+    mu_assert("test_handoff: Send failed", channel_send(channel, "Message2") == SUCCESS);
+    pthread_join(pid[1], NULL);
+    mu_assert("test_handoff: Second receiver did not get the message", data_rec[1].out == SUCCESS && string_equal(data_rec[1].data, "Message2"));
+
+    /* A receive on a full channel refills the freed slot from the parked sender and releases it */
+    mu_assert("test_handoff: Send failed", channel_send(channel, "Message3") == SUCCESS);
+    send_args data_send;
+    init_object_for_send_api(&data_send, channel, "Message4", NULL);
+    pthread_create(&pid[0], NULL, (void *)helper_send, &data_send);
+    usleep(10000);
+    void* data = NULL;
+    mu_assert("test_handoff: Receive failed", channel_receive(channel, &data) == SUCCESS && string_equal(data, "Message3"));
+    pthread_join(pid[0], NULL);
+    mu_assert("test_handoff: Parked sender was not released", data_send.out == SUCCESS);
+    mu_assert("test_handoff: Parked sender's message is not buffered", buffer_current_size(channel->buffer) == 1);
+    mu_assert("test_handoff: Receive failed", channel_receive(channel, &data) == SUCCESS && string_equal(data, "Message4"));
+
+    channel_close(channel);
+    channel_destroy(channel);
+    return NULL;
+}
+
+char* test_rendezvous() {
+    print_test_details(__func__, "Testing that unbuffered sends complete only when a receiver takes the message");
+
+    channel_t* channel = channel_create(0);
+    pthread_t pid;
+    sem_t done;
+    sem_init(&done, 0, 0);
+
+    /* The sender stays blocked until a receive matches it, without the message ever entering the buffer */
+    send_args data_send;
+    init_object_for_send_api(&data_send, channel, "Message1", &done);
+    pthread_create(&pid, NULL, (void *)helper_send, &data_send);
+    usleep(10000);
+    mu_assert("test_rendezvous: Send returned before a receiver arrived", sem_trywait(&done) == -1);
+    mu_assert("test_rendezvous: Message went through the buffer", buffer_current_size(channel->buffer) == 0);
+    void* data = NULL;
+    mu_assert("test_rendezvous: Receive failed", channel_receive(channel, &data) == SUCCESS && string_equal(data, "Message1"));
+    sem_wait(&done);
+    pthread_join(pid, NULL);
+    mu_assert("test_rendezvous: Send failed", data_send.out == SUCCESS);
+
+    /* A blocked select matches a plain send on the other side */
+    select_t list[1] = {{.channel = channel, .dir = RECV, .data = NULL}};
+    select_args data_select;
+    init_object_for_select_api(&data_select, list, 1, &done);
+    pthread_create(&pid, NULL, (void *)helper_select, &data_select);
+    usleep(10000);
+    mu_assert("test_rendezvous: Select returned before a sender arrived", sem_trywait(&done) == -1);
+    mu_assert("test_rendezvous: Send failed", channel_send(channel, "Message2") == SUCCESS);
+    sem_wait(&done);
+    pthread_join(pid, NULL);
+    mu_assert("test_rendezvous: Select failed", data_select.out == SUCCESS && data_select.index == 0);
+    mu_assert("test_rendezvous: Select received wrong message", string_equal(list[0].data, "Message2"));
+
+    /* Close releases a sender that no receiver will ever match */
+    init_object_for_send_api(&data_send, channel, "Message3", NULL);
+    pthread_create(&pid, NULL, (void *)helper_send, &data_send);
+    usleep(10000);
+    channel_close(channel);
+    pthread_join(pid, NULL);
+    mu_assert("test_rendezvous: Close did not release the sender", data_send.out == CLOSED_ERROR);
+
+    channel_destroy(channel);
+    sem_destroy(&done);
+    return NULL;
+}
+
+#define BATCH_MESSAGES 1000
+
+typedef struct {
+    channel_t *channel;
+    void **items;
+    size_t n;
+    size_t sent;
+    enum channel_status out;
+} send_many_args;
+
+void* helper_send_many(send_many_args *myargs) {
+    myargs->out = channel_send_many(myargs->channel, myargs->items, myargs->n, &myargs->sent);
+    return NULL;
+}
+
+char* test_send_receive_many() {
+    print_test_details(__func__, "Testing batched send/receive");
+
+    void* items[BATCH_MESSAGES];
+    for (size_t i = 0; i < BATCH_MESSAGES; i++) {
+        items[i] = (void*)(i + 1);
+    }
+    /* Batches wrap around the buffered ring and pass through the parked-sender path on the unbuffered one */
+    size_t capacities[] = {7, 0};
+    for (size_t c = 0; c < 2; c++) {
+        channel_t* channel = channel_create(capacities[c]);
+        pthread_t pid;
+        send_many_args args = {.channel = channel, .items = items, .n = BATCH_MESSAGES, .sent = 0, .out = GEN_ERROR};
+        pthread_create(&pid, NULL, (void *)helper_send_many, &args);
+        size_t received = 0;
+        while (received < BATCH_MESSAGES) {
+            void* out[5];
+            size_t got = 0;
+            mu_assert("test_send_receive_many: Receive failed", channel_receive_many(channel, out, 5, &got) == SUCCESS);
+            mu_assert("test_send_receive_many: Received an invalid count", got >= 1 && got <= 5);
+            for (size_t i = 0; i < got; i++) {
+                mu_assert("test_send_receive_many: Messages out of order", (size_t)out[i] == ++received);
+            }
+        }
+        pthread_join(pid, NULL);
+        mu_assert("test_send_receive_many: Send failed", args.out == SUCCESS && args.sent == BATCH_MESSAGES);
+        mu_assert("test_send_receive_many: Channel not drained", buffer_current_size(channel->buffer) == 0);
+        channel_close(channel);
+        channel_destroy(channel);
+    }
+
+    /* Close stops a batch part way and reports how much of it was written */
+    channel_t* channel = channel_create(2);
+    pthread_t pid;
+    send_many_args args = {.channel = channel, .items = items, .n = 5, .sent = 0, .out = GEN_ERROR};
+    pthread_create(&pid, NULL, (void *)helper_send_many, &args);
+    usleep(10000);
+    channel_close(channel);
+    pthread_join(pid, NULL);
+    mu_assert("test_send_receive_many: Close did not stop the batch", args.out == CLOSED_ERROR && args.sent == 2);
+    void* out[2];
+    size_t got = 1;
+    mu_assert("test_send_receive_many: Receive on closed channel", channel_receive_many(channel, out, 2, &got) == CLOSED_ERROR && got == 0);
+    channel_destroy(channel);
+    return NULL;
+}
+
+char* test_for_too_many_select_wakeups() {
+    print_test_details(__func__, "Testing that a message wakes only one of many blocked selects");
+
+    /* Every message can satisfy exactly one select, so waking the others would only show up as context switches */
+    size_t THREADS = 100;
+    pthread_t pid[THREADS];
+    select_args args[THREADS];
+    select_t list[THREADS][1];
+    channel_t* channel = channel_create(1);
+
+    sem_t done;
+    sem_init(&done, 0, 0);
+
+    for (size_t i = 0; i < THREADS; i++) {
+        list[i][0].channel = channel;
+        list[i][0].dir = RECV;
+        list[i][0].data = NULL;
+        init_object_for_select_api(&args[i], list[i], 1, &done);
+        pthread_create(&pid[i], NULL, (void *)helper_select, &args[i]);
+    }
+
+    usleep(200000);
+
+    struct rusage usage1;
+    getrusage(RUSAGE_SELF, &usage1);
+    for (size_t i = 0; i < THREADS; i++) {
+        channel_send(channel, "Message");
+        sem_wait(&done);
+    }
+    struct rusage usage2;
+    getrusage(RUSAGE_SELF, &usage2);
+
+    long switches = (usage2.ru_nvcsw - usage1.ru_nvcsw) + (usage2.ru_nivcsw - usage1.ru_nivcsw);
+    mu_assert("test_for_too_many_select_wakeups: Too many context switches", switches < (long)(10 * THREADS));
+
+    for (size_t i = 0; i < THREADS; i++) {
+        pthread_join(pid[i], NULL);
+        mu_assert("test_for_too_many_select_wakeups: Select failed", args[i].out == SUCCESS && string_equal(list[i][0].data, "Message"));
+    }
+
+    channel_close(channel);
+    channel_destroy(channel);
+    sem_destroy(&done);
+    return NULL;
+}
+
+#define SELECT_MANY_CHANNELS 40
+
+char* test_select_direct_completion() {
+    print_test_details(__func__, "Testing that the channel a blocked select waits on completes its case directly");
+
+    channel_t* channels[SELECT_MANY_CHANNELS];
+    select_t list[SELECT_MANY_CHANNELS];
+    pthread_t pid;
+    select_args args;
+    sem_t done;
+    sem_init(&done, 0, 0);
+
+    /* RECV on many empty channels: the send hands its message to the select without touching the buffer */
+    for (size_t i = 0; i < SELECT_MANY_CHANNELS; i++) {
+        channels[i] = channel_create(1);
+        list[i].channel = channels[i];
+        list[i].dir = RECV;
+        list[i].data = NULL;
+    }
+    init_object_for_select_api(&args, list, SELECT_MANY_CHANNELS, &done);
+    pthread_create(&pid, NULL, (void *)helper_select, &args);
+    usleep(10000);
+    mu_assert("test_select_direct_completion: Send failed", channel_send(channels[23], "Message1") == SUCCESS);
+    sem_wait(&done);
+    pthread_join(pid, NULL);
+    mu_assert("test_select_direct_completion: Select received from wrong channel", args.out == SUCCESS && args.index == 23);
+    mu_assert("test_select_direct_completion: Select received wrong message", string_equal(list[23].data, "Message1"));
+    mu_assert("test_select_direct_completion: Handed off message went through the buffer", buffer_current_size(channels[23]->buffer) == 0);
+
+    /* SEND on many full channels: a receive frees a slot and the select's message takes it in the same step */
+    for (size_t i = 0; i < SELECT_MANY_CHANNELS; i++) {
+        channel_send(channels[i], "Message2");
+        list[i].dir = SEND;
+        list[i].data = "Message3";
+    }
+    init_object_for_select_api(&args, list, SELECT_MANY_CHANNELS, &done);
+    pthread_create(&pid, NULL, (void *)helper_select, &args);
+    usleep(10000);
+    void* data = NULL;
+    mu_assert("test_select_direct_completion: Receive failed", channel_receive(channels[37], &data) == SUCCESS && string_equal(data, "Message2"));
+    sem_wait(&done);
+    pthread_join(pid, NULL);
+    mu_assert("test_select_direct_completion: Select sent to wrong channel", args.out == SUCCESS && args.index == 37);
+    mu_assert("test_select_direct_completion: Select's message is not buffered", buffer_current_size(channels[37]->buffer) == 1);
+    mu_assert("test_select_direct_completion: Receive failed", channel_receive(channels[37], &data) == SUCCESS && string_equal(data, "Message3"));
+
+    for (size_t i = 0; i < SELECT_MANY_CHANNELS; i++) {
+        channel_close(channels[i]);
+        channel_destroy(channels[i]);
+    }
+    sem_destroy(&done);
+    return NULL;
+}
+
+#define FAIR_BRANCHES 8
+#define FAIR_ROUNDS 8000
+
+char* test_select_fair() {
+    print_test_details(__func__, "Testing that fair select does not starve ready channels");
+
+    /* Every channel is refilled right after it is selected, so all of them are always ready */
+    channel_t* channels[FAIR_BRANCHES];
+    select_t list[FAIR_BRANCHES];
+    size_t counts[FAIR_BRANCHES];
+    for (size_t i = 0; i < FAIR_BRANCHES; i++) {
+        channels[i] = channel_create(1);
+        channel_send(channels[i], "Message");
+        list[i].channel = channels[i];
+        list[i].dir = RECV;
+        list[i].data = NULL;
+        counts[i] = 0;
+    }
+    size_t index = FAIR_BRANCHES;
+    mu_assert("test_select_fair: Select failed", channel_select(list, FAIR_BRANCHES, &index) == SUCCESS);
+    mu_assert("test_select_fair: Plain select should pick the first ready channel", index == 0);
+    channel_send(channels[0], "Message");
+    for (size_t round = 0; round < FAIR_ROUNDS; round++) {
+        mu_assert("test_select_fair: Fair select failed", channel_select_fair(list, FAIR_BRANCHES, &index) == SUCCESS);
+        mu_assert("test_select_fair: Invalid index", index < FAIR_BRANCHES);
+        mu_assert("test_select_fair: Received wrong message", string_equal(list[index].data, "Message"));
+        counts[index]++;
+        channel_send(channels[index], "Message");
+    }
+    /* Each channel is expected FAIR_ROUNDS / FAIR_BRANCHES times; allow for plenty of randomness */
+    for (size_t i = 0; i < FAIR_BRANCHES; i++) {
+        mu_assert("test_select_fair: A channel was starved", counts[i] > FAIR_ROUNDS / FAIR_BRANCHES / 2);
+        channel_close(channels[i]);
+        channel_destroy(channels[i]);
+    }
+    mu_assert("test_select_fair: Empty select should fail", channel_select_fair(list, 0, &index) == GEN_ERROR);
+    return NULL;
+}
+
+char* test_try_select() {
+    print_test_details(__func__, "Testing the non-blocking select");
+
+    channel_t* empty = channel_create(1);
+    channel_t* full = channel_create(1);
+    channel_t* unbuffered = channel_create(0);
+    channel_send(full, "Message1");
+    select_t list[3];
+    list[0].channel = empty;
+    list[0].dir = RECV;
+    list[1].channel = full;
+    list[1].dir = SEND;
+    list[1].data = "Message2";
+    list[2].channel = unbuffered;
+    list[2].dir = RECV;
+
+    /* Nothing is ready, so nothing may be performed or left queued on any channel */
+    size_t index = 3;
+    mu_assert("test_try_select: Select should find nothing ready", channel_try_select(list, 3, &index) == CHANNEL_EMPTY);
+    mu_assert("test_try_select: Index should be untouched", index == 3);
+    mu_assert("test_try_select: Full channel changed", buffer_current_size(full->buffer) == 1);
+    for (size_t i = 0; i < 3; i++) {
+        mu_assert("test_try_select: Select left a waiter queued", list[i].channel->sendq->count == 0 && list[i].channel->recvq->count == 0);
+    }
+
+    /* Once one case is ready it is performed */
+    channel_send(empty, "Message3");
+    mu_assert("test_try_select: Select failed", channel_try_select(list, 3, &index) == SUCCESS);
+    mu_assert("test_try_select: Wrong index", index == 0);
+    mu_assert("test_try_select: Received wrong message", string_equal(list[0].data, "Message3"));
+    mu_assert("test_try_select: Select should find nothing ready again", channel_try_select(list, 3, &index) == CHANNEL_EMPTY);
+
+    void* data;
+    mu_assert("test_try_select: Receive failed", channel_receive(full, &data) == SUCCESS && string_equal(data, "Message1"));
+    mu_assert("test_try_select: Select failed", channel_try_select(list, 3, &index) == SUCCESS);
+    mu_assert("test_try_select: Wrong index", index == 1);
+
+    /* A closed channel is reported like in channel_select */
+    channel_close(unbuffered);
+    mu_assert("test_try_select: Select should report the closed channel", channel_try_select(list, 3, &index) == CLOSED_ERROR);
+    mu_assert("test_try_select: Wrong index", index == 2);
+    mu_assert("test_try_select: Receive failed", channel_receive(full, &data) == SUCCESS && string_equal(data, "Message2"));
+    mu_assert("test_try_select: Empty select should find nothing ready", channel_try_select(list, 0, &index) == CHANNEL_EMPTY);
+
+    /* Selects with more cases than fit on the stack behave the same */
+    channel_t* many[SELECT_STACK_CASES + 1];
+    select_t large[SELECT_STACK_CASES + 1];
+    for (size_t i = 0; i <= SELECT_STACK_CASES; i++) {
+        many[i] = channel_create(1);
+        large[i].channel = many[i];
+        large[i].dir = RECV;
+    }
+    mu_assert("test_try_select: Large select should find nothing ready", channel_try_select(large, SELECT_STACK_CASES + 1, &index) == CHANNEL_EMPTY);
+    channel_send(many[SELECT_STACK_CASES], "Message4");
+    mu_assert("test_try_select: Large select failed", channel_select(large, SELECT_STACK_CASES + 1, &index) == SUCCESS);
+    mu_assert("test_try_select: Large select picked the wrong case", index == SELECT_STACK_CASES && string_equal(large[index].data, "Message4"));
+    for (size_t i = 0; i <= SELECT_STACK_CASES; i++) {
+        channel_close(many[i]);
+        channel_destroy(many[i]);
+    }
+
+    channel_close(empty);
+    channel_close(full);
+    channel_destroy(empty);
+    channel_destroy(full);
+    channel_destroy(unbuffered);
+    return NULL;
+}
+
+/* Absolute CLOCK_MONOTONIC deadline ms milliseconds from now */
+struct timespec deadline_after(long ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += ms / 1000;
+    deadline.tv_nsec += (ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    return deadline;
+}
+
+/* True once the monotonic clock has reached deadline */
+bool deadline_passed(const struct timespec* deadline) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec > deadline->tv_sec || (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec);
+}
+
+void* helper_receive_timeout(receive_args *myargs) {
+    struct timespec deadline = deadline_after(5000);
+    myargs->out = channel_receive_timeout(myargs->channel, &myargs->data, &deadline);
+    return NULL;
+}
+
+char* test_timeout() {
+    print_test_details(__func__, "Testing the timed send, receive and select");
+
+    channel_t* channel = channel_create(1);
+    channel_t* unbuffered = channel_create(0);
+    channel_t* mpmc = channel_create_mpmc(1);
+    void* data = NULL;
+
+    /* Waits that cannot complete return TIMEOUT, no earlier than the deadline, and leave nothing queued */
+    struct timespec deadline = deadline_after(5);
+    mu_assert("test_timeout: Receive should time out", channel_receive_timeout(channel, &data, &deadline) == TIMEOUT);
+    mu_assert("test_timeout: Receive returned before the deadline", deadline_passed(&deadline));
+    mu_assert("test_timeout: Receive stored data", data == NULL);
+    mu_assert("test_timeout: Receive left a waiter queued", channel->recvq->count == 0);
+
+    mu_assert("test_timeout: Send failed", channel_send_timeout(channel, "Message1", &deadline) == SUCCESS);
+    deadline = deadline_after(5);
+    mu_assert("test_timeout: Send should time out", channel_send_timeout(channel, "Message2", &deadline) == TIMEOUT);
+    mu_assert("test_timeout: Send returned before the deadline", deadline_passed(&deadline));
+    mu_assert("test_timeout: Send left a waiter queued", channel->sendq->count == 0);
+    mu_assert("test_timeout: Timed out message was sent", buffer_current_size(channel->buffer) == 1);
+
+    deadline = deadline_after(5);
+    mu_assert("test_timeout: Unbuffered send should time out", channel_send_timeout(unbuffered, "Message2", &deadline) == TIMEOUT);
+    mu_assert("test_timeout: Unbuffered send left a waiter queued", unbuffered->sendq->count == 0);
+    deadline = deadline_after(5);
+    mu_assert("test_timeout: MPMC receive should time out", channel_receive_timeout(mpmc, &data, &deadline) == TIMEOUT);
+    mu_assert("test_timeout: MPMC receive returned before the deadline", deadline_passed(&deadline));
+
+    select_t list[2];
+    list[0].channel = channel;
+    list[0].dir = SEND;
+    list[0].data = "Message2";
+    list[1].channel = unbuffered;
+    list[1].dir = RECV;
+    list[1].data = NULL;
+    size_t index = 2;
+    deadline = deadline_after(5);
+    mu_assert("test_timeout: Select should time out", channel_select_timeout(list, 2, &index, &deadline) == TIMEOUT);
+    mu_assert("test_timeout: Select returned before the deadline", deadline_passed(&deadline));
+    mu_assert("test_timeout: Select changed the index", index == 2);
+    mu_assert("test_timeout: Select left a waiter queued", channel->sendq->count == 0 && unbuffered->recvq->count == 0);
+
+    /* A deadline in the past still lets ready operations complete */
+    struct timespec past = {0, 0};
+    mu_assert("test_timeout: Ready receive failed", channel_receive_timeout(channel, &data, &past) == SUCCESS);
+    mu_assert("test_timeout: Received wrong message", string_equal(data, "Message1"));
+    mu_assert("test_timeout: Expired receive should time out", channel_receive_timeout(channel, &data, &past) == TIMEOUT);
+
+    /* Operations completed by another thread before the deadline succeed */
+    pthread_t pid;
+    sem_t done;
+    sem_init(&done, 0, 0);
+    send_args args;
+    init_object_for_send_api(&args, unbuffered, "Message3", &done);
+    pthread_create(&pid, NULL, (void *)helper_send, &args);
+    deadline = deadline_after(5000);
+    mu_assert("test_timeout: Select failed", channel_select_timeout(list, 2, &index, &deadline) == SUCCESS);
+    mu_assert("test_timeout: Select should pick the ready channel", index == 0);
+    mu_assert("test_timeout: Receive failed", channel_receive_timeout(channel, &data, &deadline) == SUCCESS && string_equal(data, "Message2"));
+    mu_assert("test_timeout: Receive failed", channel_receive_timeout(unbuffered, &data, &deadline) == SUCCESS && string_equal(data, "Message3"));
+    sem_wait(&done);
+    pthread_join(pid, NULL);
+    mu_assert("test_timeout: Send failed", args.out == SUCCESS);
+
+    /* Closing the channel ends a timed wait with CLOSED_ERROR */
+    receive_args rec_args;
+    init_object_for_receive_api(&rec_args, unbuffered, NULL);
+    pthread_create(&pid, NULL, (void *)helper_receive_timeout, &rec_args);
+    usleep(10000);
+    channel_close(unbuffered);
+    pthread_join(pid, NULL);
+    mu_assert("test_timeout: Receive should be closed", rec_args.out == CLOSED_ERROR);
+    deadline = deadline_after(5);
+    mu_assert("test_timeout: Send should be closed", channel_send_timeout(unbuffered, "Message4", &deadline) == CLOSED_ERROR);
+
+    channel_close(channel);
+    channel_close(mpmc);
+    channel_destroy(channel);
+    channel_destroy(unbuffered);
+    channel_destroy(mpmc);
+    sem_destroy(&done);
+    return NULL;
+}
+
+char* test_select_set() {
+    print_test_details(__func__, "Testing persistent select sets");
+
+    channel_t* buffered = channel_create(1);
+    channel_t* unbuffered = channel_create(0);
+    channel_t* full = channel_create(1);
+    channel_send(full, "Message1");
+    select_t list[3];
+    list[0].channel = buffered;
+    list[0].dir = RECV;
+    list[0].data = NULL;
+    list[1].channel = unbuffered;
+    list[1].dir = RECV;
+    list[1].data = NULL;
+    list[2].channel = full;
+    list[2].dir = SEND;
+    list[2].data = "Message2";
+    select_set_t* set = select_set_create(list, 3);
+    mu_assert("test_select_set: Create failed", set != NULL && set->count == 3 && set->capacity == 3);
+
+    /* Every case is registered once, and an idle set does not act as a counterpart */
+    mu_assert("test_select_set: Waiters not registered", buffered->recvq->count == 1 && unbuffered->recvq->count == 1 && full->sendq->count == 1);
+    mu_assert("test_select_set: Idle set received a message", channel_non_blocking_send(unbuffered, "Message3") == CHANNEL_FULL);
+    void* data;
+    mu_assert("test_select_set: Idle set sent a message", channel_non_blocking_receive(full, &data) == SUCCESS && string_equal(data, "Message1"));
+    mu_assert("test_select_set: Idle set sent a message", channel_non_blocking_receive(full, &data) == CHANNEL_EMPTY);
+
+    /* The freed slot makes the SEND case ready */
+    size_t index = 3;
+    mu_assert("test_select_set: Wait failed", select_set_wait(set, &index) == SUCCESS);
+    mu_assert("test_select_set: Wrong index", index == 2);
+    mu_assert("test_select_set: Message not sent", channel_receive(full, &data) == SUCCESS && string_equal(data, "Message2"));
+    channel_send(full, "Message1");
+
+    /* A parked wait is completed by a counterpart and the registrations stay in place */
+    pthread_t pid;
+    send_args args;
+    init_object_for_send_api(&args, unbuffered, "Message4", NULL);
+    pthread_create(&pid, NULL, (void *)helper_send, &args);
+    mu_assert("test_select_set: Wait failed", select_set_wait(set, &index) == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_select_set: Wrong index", index == 1);
+    mu_assert("test_select_set: Received wrong message", string_equal(set->list[1].data, "Message4") && args.out == SUCCESS);
+    mu_assert("test_select_set: Waiters not kept", buffered->recvq->count == 1 && unbuffered->recvq->count == 1 && full->sendq->count == 1);
+
+    /* Disabling swaps the case with the last enabled one, and a disabled case is never performed */
+    mu_assert("test_select_set: Disable failed", select_set_disable(set, 0) == SUCCESS);
+    mu_assert("test_select_set: Disable did not swap", set->count == 2 && set->list[0].channel == full && set->list[2].channel == buffered);
+    mu_assert("test_select_set: Disable of a disabled case should fail", select_set_disable(set, 2) == GEN_ERROR);
+    channel_send(buffered, "Message5");
+    init_object_for_send_api(&args, unbuffered, "Message6", NULL);
+    pthread_create(&pid, NULL, (void *)helper_send, &args);
+    mu_assert("test_select_set: Wait failed", select_set_wait(set, &index) == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_select_set: Disabled case was performed", index == 1 && string_equal(set->list[1].data, "Message6"));
+    mu_assert("test_select_set: Disabled case was performed", buffer_current_size(buffered->buffer) == 1);
+
+    /* Enabling brings it back, and with every case ready each of them gets its turn */
+    mu_assert("test_select_set: Enable of an enabled case should fail", select_set_enable(set, 0) == GEN_ERROR);
+    mu_assert("test_select_set: Enable failed", select_set_enable(set, 2) == SUCCESS && set->count == 3);
+    mu_assert("test_select_set: Disable failed", select_set_disable(set, 1) == SUCCESS);
+    mu_assert("test_select_set: Disable did not swap", set->count == 2 && set->list[1].channel == buffered && set->list[2].channel == unbuffered);
+    channel_receive(full, &data);
+    size_t counts[2] = {0, 0};
+    for (size_t round = 0; round < 100; round++) {
+        mu_assert("test_select_set: Wait failed", select_set_wait(set, &index) == SUCCESS && index < 2);
+        counts[index]++;
+        if (index == 0) {
+            channel_receive(full, &data);
+        } else {
+            channel_send(buffered, "Message5");
+        }
+    }
+    mu_assert("test_select_set: A case was starved", counts[0] == 50 && counts[1] == 50);
+
+    /* A closed channel is reported like in channel_select */
+    channel_send(full, "Message1");
+    channel_close(buffered);
+    mu_assert("test_select_set: Wait should report the closed channel", select_set_wait(set, &index) == CLOSED_ERROR);
+    mu_assert("test_select_set: Wrong index", index == 1);
+
+    mu_assert("test_select_set: Destroy failed", select_set_destroy(set) == SUCCESS);
+    mu_assert("test_select_set: Waiters not unregistered", buffered->recvq->count == 0 && unbuffered->recvq->count == 0 && full->sendq->count == 0);
+    channel_close(unbuffered);
+    channel_close(full);
+    channel_destroy(buffered);
+    channel_destroy(unbuffered);
+    channel_destroy(full);
+
+    list[0].channel = channel_create_mpmc(1);
+    mu_assert("test_select_set: Create should fail for lock-free channels", select_set_create(list, 1) == NULL);
+    channel_close(list[0].channel);
+    channel_destroy(list[0].channel);
+    return NULL;
+}
+
+/* True if fd becomes readable within timeout_ms */
+bool fd_readable(int fd, int timeout_ms) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    return poll(&pfd, 1, timeout_ms) == 1 && (pfd.revents & POLLIN);
+}
+
+char* test_channel_fd() {
+    print_test_details(__func__, "Testing the eventfd readiness of channels");
+
+    channel_t* channel = channel_create(1);
+    int recv_fd = channel_get_fd(channel, RECV);
+    int send_fd = channel_get_fd(channel, SEND);
+    mu_assert("test_channel_fd: Getting the fds failed", recv_fd >= 0 && send_fd >= 0 && recv_fd != send_fd);
+    mu_assert("test_channel_fd: Fds should be reused", channel_get_fd(channel, RECV) == recv_fd);
+
+    /* The fds follow the buffer, and stay readable until the state changes again */
+    mu_assert("test_channel_fd: Empty channel should not be receivable", !fd_readable(recv_fd, 0));
+    mu_assert("test_channel_fd: Empty channel should be sendable", fd_readable(send_fd, 0));
+    channel_send(channel, "Message1");
+    mu_assert("test_channel_fd: Full channel should be receivable", fd_readable(recv_fd, 0) && fd_readable(recv_fd, 0));
+    mu_assert("test_channel_fd: Full channel should not be sendable", !fd_readable(send_fd, 0));
+    void* data;
+    mu_assert("test_channel_fd: Receive failed", channel_non_blocking_receive(channel, &data) == SUCCESS);
+    mu_assert("test_channel_fd: Empty channel should not be receivable", !fd_readable(recv_fd, 0));
+    mu_assert("test_channel_fd: Empty channel should be sendable", fd_readable(send_fd, 0));
+
+    /* On an unbuffered channel a parked counterpart makes the other direction ready */
+    channel_t* unbuffered = channel_create(0);
+    recv_fd = channel_get_fd(unbuffered, RECV);
+    send_fd = channel_get_fd(unbuffered, SEND);
+    mu_assert("test_channel_fd: Unbuffered channel should not be receivable", !fd_readable(recv_fd, 0));
+    mu_assert("test_channel_fd: Unbuffered channel should not be sendable", !fd_readable(send_fd, 0));
+    pthread_t pid;
+    receive_args args;
+    init_object_for_receive_api(&args, unbuffered, NULL);
+    pthread_create(&pid, NULL, (void *)helper_receive, &args);
+    mu_assert("test_channel_fd: Parked receiver should make the channel sendable", fd_readable(send_fd, 5000));
+    mu_assert("test_channel_fd: Send failed", channel_non_blocking_send(unbuffered, "Message2") == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_channel_fd: Received wrong message", args.out == SUCCESS && string_equal(args.data, "Message2"));
+    mu_assert("test_channel_fd: Channel should not be sendable anymore", !fd_readable(send_fd, 0));
+
+    /* A closed channel is ready in both directions, since the calls return CLOSED_ERROR right away */
+    channel_close(unbuffered);
+    mu_assert("test_channel_fd: Closed channel should be receivable", fd_readable(recv_fd, 0));
+    mu_assert("test_channel_fd: Closed channel should be sendable", fd_readable(send_fd, 0));
+
+    channel_t* mpmc = channel_create_mpmc(1);
+    mu_assert("test_channel_fd: Lock-free channels have no fd", channel_get_fd(mpmc, RECV) == -1);
+
+    channel_close(channel);
+    channel_close(mpmc);
+    channel_destroy(channel);
+    channel_destroy(unbuffered);
+    channel_destroy(mpmc);
+    return NULL;
+}
+
+#define CHAIN_LENGTH 40
+#define CHAIN_ROUNDS 20
+
+typedef struct {
+    channel_t* in;
+    channel_t* out;
+} chain_args;
+
+/* Passes every value on to the next link plus one, until in is closed */
+void coroutine_chain_link(void* arg) {
+    chain_args* args = arg;
+    void* data;
+    while (channel_receive(args->in, &data) == SUCCESS) {
+        channel_send(args->out, (void*)((uintptr_t)data + 1));
+    }
+    channel_close(args->out);
+}
+
+typedef struct {
+    channel_t* channel;
+    enum channel_status status;
+    bool waited;
+} coroutine_timeout_args;
+
+void coroutine_receive_timeout(void* arg) {
+    coroutine_timeout_args* args = arg;
+    struct timespec deadline = deadline_after(20);
+    void* data;
+    args->status = channel_receive_timeout(args->channel, &data, &deadline);
+    args->waited = deadline_passed(&deadline);
+}
+
+typedef struct {
+    select_t list[2];
+    enum channel_status status;
+    size_t index;
+} coroutine_select_args;
+
+void coroutine_select(void* arg) {
+    coroutine_select_args* args = arg;
+    args->status = channel_select(args->list, 2, &args->index);
+}
+
+char* test_coroutines() {
+    print_test_details(__func__, "Testing channel operations that block inside coroutines");
+
+    /* Far more coroutines than workers block at the same time, so each must park without its worker */
+    sched_t* sched = sched_create(2);
+    mu_assert("test_coroutines: Creating the scheduler failed", sched != NULL);
+    mu_assert("test_coroutines: Outside of coroutines there is no current one", sched_current() == NULL);
+
+    /* A chain of coroutines on unbuffered channels, fed and drained by this thread */
+    channel_t* chain[CHAIN_LENGTH + 1];
+    chain_args links[CHAIN_LENGTH];
+    for (size_t i = 0; i <= CHAIN_LENGTH; i++) {
+        chain[i] = channel_create(0);
+    }
+    for (size_t i = 0; i < CHAIN_LENGTH; i++) {
+        links[i].in = chain[i];
+        links[i].out = chain[i + 1];
+        mu_assert("test_coroutines: Spawn failed", sched_spawn(sched, coroutine_chain_link, &links[i]));
+    }
+
+    /* Timed waits expire inside coroutines while the chain keeps the workers busy */
+    channel_t* idle = channel_create(0);
+    coroutine_timeout_args timeouts[4];
+    for (size_t i = 0; i < 4; i++) {
+        timeouts[i].channel = idle;
+        timeouts[i].waited = false;
+        mu_assert("test_coroutines: Spawn failed", sched_spawn(sched, coroutine_receive_timeout, &timeouts[i]));
+    }
+
+    /* A select parked in a coroutine is completed by this thread */
+    channel_t* first = channel_create(0);
+    channel_t* second = channel_create(0);
+    coroutine_select_args select_args = {{{first, RECV, NULL}, {second, RECV, NULL}}, GEN_ERROR, 2};
+    mu_assert("test_coroutines: Spawn failed", sched_spawn(sched, coroutine_select, &select_args));
+
+    for (uintptr_t round = 0; round < CHAIN_ROUNDS; round++) {
+        void* data;
+        mu_assert("test_coroutines: Send failed", channel_send(chain[0], (void*)round) == SUCCESS);
+        mu_assert("test_coroutines: Receive failed", channel_receive(chain[CHAIN_LENGTH], &data) == SUCCESS);
+        mu_assert("test_coroutines: Value went through the wrong number of links", (uintptr_t)data == round + CHAIN_LENGTH);
+    }
+    mu_assert("test_coroutines: Send failed", channel_send(second, "Message1") == SUCCESS);
+    channel_close(chain[0]);
+    sched_wait(sched);
+
+    void* data;
+    mu_assert("test_coroutines: Chain should be closed", channel_receive(chain[CHAIN_LENGTH], &data) == CLOSED_ERROR);
+    for (size_t i = 0; i < 4; i++) {
+        mu_assert("test_coroutines: Receive should time out", timeouts[i].status == TIMEOUT);
+        mu_assert("test_coroutines: Receive returned before the deadline", timeouts[i].waited);
+    }
+    mu_assert("test_coroutines: Timed out receives left waiters queued", idle->recvq->count == 0);
+    mu_assert("test_coroutines: Select failed", select_args.status == SUCCESS && select_args.index == 1);
+    mu_assert("test_coroutines: Select received the wrong message", string_equal(select_args.list[1].data, "Message1"));
+
+    sched_destroy(sched);
+    for (size_t i = 0; i <= CHAIN_LENGTH; i++) {
+        channel_destroy(chain[i]);
+    }
+    channel_close(idle);
+    channel_close(first);
+    channel_close(second);
+    channel_destroy(idle);
+    channel_destroy(first);
+    channel_destroy(second);
+    return NULL;
+}
+
+#define BYTES_RECORDS 1000
+
+/* Writes the numbers 0..BYTES_RECORDS-1 as records of varying length */
+void coroutine_bytes_producer(void* arg) {
+    channel_t* channel = arg;
+    for (size_t i = 0; i < BYTES_RECORDS; i++) {
+        channel_slot_t slot;
+        if (channel_reserve(channel, sizeof(size_t) + i % 24, &slot) != SUCCESS) {
+            return;
+        }
+        memcpy(slot.data, &i, sizeof(size_t));
+        channel_commit(channel, slot);
+    }
+}
+
+typedef struct {
+    channel_t* channel;
+    size_t received;
+    bool in_order;
+} coroutine_bytes_args;
+
+void coroutine_bytes_consumer(void* arg) {
+    coroutine_bytes_args* args = arg;
+    channel_slot_t slot;
+    while (args->received < BYTES_RECORDS && channel_peek(args->channel, &slot) == SUCCESS) {
+        size_t value;
+        memcpy(&value, slot.data, sizeof(size_t));
+        args->in_order &= value == args->received && slot.size == sizeof(size_t) + value % 24;
+        args->received++;
+        channel_release(args->channel, slot);
+    }
+}
+
+char* test_coroutine_bytes() {
+    print_test_details(__func__, "Testing byte channel waits that only suspend the coroutine");
+
+    /* With one worker, a reserve or peek that blocked the worker would never be completed by the other side */
+    sched_t* sched = sched_create(1);
+    mu_assert("test_coroutine_bytes: Creating the scheduler failed", sched != NULL);
+    channel_t* channel = channel_create_bytes(64);
+    coroutine_bytes_args args = {channel, 0, true};
+    mu_assert("test_coroutine_bytes: Spawn failed", sched_spawn(sched, coroutine_bytes_consumer, &args));
+    mu_assert("test_coroutine_bytes: Spawn failed", sched_spawn(sched, coroutine_bytes_producer, channel));
+    sched_wait(sched);
+
+    mu_assert("test_coroutine_bytes: Not every record was received", args.received == BYTES_RECORDS);
+    mu_assert("test_coroutine_bytes: Records were received out of order or resized", args.in_order);
+    mu_assert("test_coroutine_bytes: Waiters were left queued", channel->sendq->count == 0 && channel->recvq->count == 0);
+
+    sched_destroy(sched);
+    channel_close(channel);
+    channel_destroy(channel);
+    return NULL;
+}
+
+char* test_stress_coroutines() {
+    print_test_details(__func__, "Testing the stress topologies with the routers as coroutines");
+    run_stress_coroutines(0, 0, "topology.txt", 2);
+    run_stress_coroutines(1, 1, "connected_topology.txt", 2);
+    run_stress_coroutines(0, 1, "random_topology.txt", 4);
+    run_stress_coroutines(0, 0, "big_graph.txt", 4);
+    return NULL;
+}
+
+#define POOL_TEST_CHILDREN 1000
+
+typedef struct {
+    pool_t* pool;
+    atomic_uint runs[POOL_TEST_CHILDREN + 3];
+    atomic_size_t remaining;
+    channel_t* done;
+} pool_test_args;
+
+/* Task 1 submits POOL_TEST_CHILDREN children from its worker, more than a deque starts out with */
+void pool_test_handler(void* task, void* context) {
+    pool_test_args* args = context;
+    size_t value = (size_t)task;
+    if (value == 1) {
+        for (size_t i = 3; i < POOL_TEST_CHILDREN + 3; i++) {
+            pool_submit(args->pool, (void*)i);
+        }
+    }
+    atomic_fetch_add(&args->runs[value], 1);
+    if (atomic_fetch_sub(&args->remaining, 1) == 1) {
+        channel_send(args->done, NULL);
+    }
+}
+
+char* test_pool() {
+    print_test_details(__func__, "Testing the work-stealing pool");
+
+    channel_t* source = channel_create(4);
+    pool_test_args args;
+    mu_assert("test_pool: Create should fail without a source", pool_create(NULL, 2, pool_test_handler, &args) == NULL);
+    mu_assert("test_pool: Create should fail without workers", pool_create(source, 0, pool_test_handler, &args) == NULL);
+
+    for (size_t i = 0; i < POOL_TEST_CHILDREN + 3; i++) {
+        atomic_init(&args.runs[i], 0);
+    }
+    atomic_init(&args.remaining, POOL_TEST_CHILDREN + 2);
+    args.done = channel_create(1);
+    args.pool = pool_create(source, 4, pool_test_handler, &args);
+    mu_assert("test_pool: Create failed", args.pool != NULL);
+
+    /* Tasks arrive both through pool_submit and directly through the source channel */
+    mu_assert("test_pool: Submit failed", pool_submit(args.pool, (void*)1) == SUCCESS);
+    mu_assert("test_pool: Send failed", channel_send(source, (void*)2) == SUCCESS);
+    void* data;
+    mu_assert("test_pool: Waiting for the tasks failed", channel_receive(args.done, &data) == SUCCESS);
+    for (size_t i = 1; i < POOL_TEST_CHILDREN + 3; i++) {
+        mu_assert("test_pool: Every task should run exactly once", atomic_load(&args.runs[i]) == 1);
+    }
+
+    /* Destroying the pool closes its source */
+    pool_destroy(args.pool);
+    mu_assert("test_pool: Source should be closed", channel_send(source, (void*)1) == CLOSED_ERROR);
+
+    channel_destroy(source);
+    channel_close(args.done);
+    channel_destroy(args.done);
+    return NULL;
+}
+
+char* test_stress_pool() {
+    print_test_details(__func__, "Stress Testing the work-stealing pool");
+    run_stress_pool(0, 4, 20000, 0);
+    run_stress_pool(1, 8, 20000, 0);
+    run_stress_pool(64, 4, 5000, 16);
+    run_stress_pool(64, 16, 5000, 16);
+    return NULL;
+}
+
+#define SHARDED_PRODUCERS 8
+#define SHARDED_MESSAGES 250
+
+typedef struct {
+    sharded_channel_t* channel;
+    size_t id;
+} sharded_producer_args;
+
+/* Sends 1..SHARDED_MESSAGES, tagged with the producer id in the upper half */
+void* sharded_producer(sharded_producer_args* args) {
+    for (size_t seq = 1; seq <= SHARDED_MESSAGES; seq++) {
+        sharded_channel_send(args->channel, (void*)((args->id << 32) | seq));
+    }
+    return NULL;
+}
+
+typedef struct {
+    sharded_channel_t* channel;
+    void* data;
+    enum channel_status out;
+} sharded_receive_args;
+
+void* sharded_receiver(sharded_receive_args* args) {
+    args->out = sharded_channel_receive(args->channel, &args->data);
+    return NULL;
+}
+
+char* check_sharded_producers(sharded_channel_t* channel) {
+    pthread_t pid[SHARDED_PRODUCERS];
+    sharded_producer_args args[SHARDED_PRODUCERS];
+    size_t last[SHARDED_PRODUCERS] = {0};
+    for (size_t i = 0; i < SHARDED_PRODUCERS; i++) {
+        args[i].channel = channel;
+        args[i].id = i;
+        pthread_create(&pid[i], NULL, (void *)sharded_producer, &args[i]);
+    }
+    char* result = NULL;
+    /* Drains every message even after a failure, so that the producers can finish */
+    for (size_t n = 0; n < SHARDED_PRODUCERS * SHARDED_MESSAGES; n++) {
+        void* data;
+        if (sharded_channel_receive(channel, &data) != SUCCESS) {
+            result = "FAILURE: test_sharded_channel: Receive failed";
+            break;
+        }
+        size_t id = (size_t)data >> 32;
+        size_t seq = (size_t)data & 0xffffffff;
+        if (id >= SHARDED_PRODUCERS || seq != last[id] + 1) {
+            result = "FAILURE: test_sharded_channel: Producer's messages out of order";
+        }
+        if (id < SHARDED_PRODUCERS) {
+            last[id] = seq;
+        }
+    }
+    for (size_t i = 0; i < SHARDED_PRODUCERS; i++) {
+        pthread_join(pid[i], NULL);
+    }
+    return result;
+}
+
+char* test_sharded_channel() {
+    print_test_details(__func__, "Testing the sharded multi-lane channel");
+
+    mu_assert("test_sharded_channel: Create should fail without lanes", sharded_channel_create(0, 1) == NULL);
+    mu_assert("test_sharded_channel: Create should fail with too many lanes", sharded_channel_create(SHARDED_CHANNEL_MAX_LANES + 1, 1) == NULL);
+    mu_assert("test_sharded_channel: Create should fail with unbuffered lanes", sharded_channel_create(4, 0) == NULL);
+
+    sharded_channel_t* channel = sharded_channel_create(4, 8);
+    mu_assert("test_sharded_channel: Create failed", channel != NULL);
+    void* data;
+    mu_assert("test_sharded_channel: Empty channel should not receive", sharded_channel_non_blocking_receive(channel, &data) == CHANNEL_EMPTY);
+
+    /* One thread always uses the same lane, so its messages arrive in order and fill only that lane */
+    for (size_t i = 1; i <= 8; i++) {
+        mu_assert("test_sharded_channel: Send failed", sharded_channel_non_blocking_send(channel, (void*)i) == SUCCESS);
+    }
+    mu_assert("test_sharded_channel: Lane should be full", sharded_channel_non_blocking_send(channel, (void*)9) == CHANNEL_FULL);
+    for (size_t i = 1; i <= 8; i++) {
+        mu_assert("test_sharded_channel: Receive failed", sharded_channel_receive(channel, &data) == SUCCESS);
+        mu_assert("test_sharded_channel: Messages of one sender should stay in order", (size_t)data == i);
+    }
+
+    /* Many producers: each one's messages stay in order, whatever the interleaving, also on one-slot lanes */
+    sharded_channel_t* narrow = sharded_channel_create(4, 1);
+    char* result = check_sharded_producers(channel);
+    if (result == NULL) {
+        result = check_sharded_producers(narrow);
+    }
+    sharded_channel_close(narrow);
+    sharded_channel_destroy(narrow);
+    if (result != NULL) {
+        return result;
+    }
+    pthread_t pid[1];
+
+    /* A receiver blocked on all lanes gets the next message, whichever lane it lands in */
+    sharded_receive_args rec_args = {channel, NULL, GEN_ERROR};
+    pthread_create(&pid[0], NULL, (void *)sharded_receiver, &rec_args);
+    usleep(10000);
+    mu_assert("test_sharded_channel: Send failed", sharded_channel_send(channel, "Message1") == SUCCESS);
+    pthread_join(pid[0], NULL);
+    mu_assert("test_sharded_channel: Blocked receive failed", rec_args.out == SUCCESS && string_equal(rec_args.data, "Message1"));
+
+    /* Close ends blocked receives */
+    pthread_create(&pid[0], NULL, (void *)sharded_receiver, &rec_args);
+    usleep(10000);
+    mu_assert("test_sharded_channel: Destroy should fail while open", sharded_channel_destroy(channel) == DESTROY_ERROR);
+    mu_assert("test_sharded_channel: Close failed", sharded_channel_close(channel) == SUCCESS);
+    pthread_join(pid[0], NULL);
+    mu_assert("test_sharded_channel: Blocked receive should be closed", rec_args.out == CLOSED_ERROR);
+    mu_assert("test_sharded_channel: Second close should fail", sharded_channel_close(channel) == CLOSED_ERROR);
+    mu_assert("test_sharded_channel: Send should be closed", sharded_channel_send(channel, "Message2") == CLOSED_ERROR);
+    mu_assert("test_sharded_channel: Destroy failed", sharded_channel_destroy(channel) == SUCCESS);
+    return NULL;
+}
+
+#define SHARDED_DRAIN_PRODUCERS 4
+#define SHARDED_DRAIN_ROUNDS 2000
+
+typedef struct {
+    sharded_channel_t* channel;
+    pthread_barrier_t* round;
+} sharded_drain_args;
+
+/* Sends one message per round, each round starting once the receiver has drained the previous one */
+void* sharded_drain_producer(sharded_drain_args* args) {
+    for (size_t round = 0; round < SHARDED_DRAIN_ROUNDS; round++) {
+        pthread_barrier_wait(args->round);
+        sharded_channel_send(args->channel, (void*)(round + 1));
+    }
+    return NULL;
+}
+
+char* test_sharded_wakeup() {
+    print_test_details(__func__, "Testing that a sharded channel receiver drained to empty is always woken");
+
+    /* Every round empties the channel, so the receiver keeps going to sleep while the producers race to wake it */
+    sharded_channel_t* channel = sharded_channel_create(SHARDED_DRAIN_PRODUCERS, 4);
+    pthread_barrier_t round;
+    pthread_barrier_init(&round, NULL, SHARDED_DRAIN_PRODUCERS + 1);
+    sharded_drain_args args = {channel, &round};
+    pthread_t pid[SHARDED_DRAIN_PRODUCERS];
+    for (size_t i = 0; i < SHARDED_DRAIN_PRODUCERS; i++) {
+        pthread_create(&pid[i], NULL, (void *)sharded_drain_producer, &args);
+    }
+    char* result = NULL;
+    for (size_t r = 0; r < SHARDED_DRAIN_ROUNDS; r++) {
+        pthread_barrier_wait(&round);
+        for (size_t n = 0; n < SHARDED_DRAIN_PRODUCERS; n++) {
+            void* data;
+            if (sharded_channel_receive(channel, &data) != SUCCESS || (size_t)data != r + 1) {
+                result = "FAILURE: test_sharded_wakeup: Receive failed";
+            }
+        }
+    }
+    for (size_t i = 0; i < SHARDED_DRAIN_PRODUCERS; i++) {
+        pthread_join(pid[i], NULL);
+    }
+    pthread_barrier_destroy(&round);
+    sharded_channel_close(channel);
+    sharded_channel_destroy(channel);
+    return result;
+}
+
+typedef struct {
+    broadcast_sub_t* sub;
+    void* data;
+    enum channel_status out;
+} broadcast_receive_args;
+
+void* helper_broadcast_receive(broadcast_receive_args* args) {
+    args->out = broadcast_receive(args->sub, &args->data);
+    return NULL;
+}
+
+typedef struct {
+    broadcast_t* broadcast;
+    void* data;
+    enum channel_status out;
+} broadcast_publish_args;
+
+void* helper_broadcast_publish(broadcast_publish_args* args) {
+    args->out = broadcast_publish(args->broadcast, args->data);
+    return NULL;
+}
+
+char* test_broadcast() {
+    print_test_details(__func__, "Testing the broadcast channel");
+
+    mu_assert("test_broadcast: Create should fail without capacity", broadcast_create(0, BROADCAST_BLOCK) == NULL);
+    broadcast_t* broadcast = broadcast_create(2, BROADCAST_BLOCK);
+    mu_assert("test_broadcast: Create failed", broadcast != NULL);
+
+    /* Every subscriber receives every message published after it subscribed */
+    broadcast_sub_t* first = broadcast_subscribe(broadcast);
+    broadcast_sub_t* second = broadcast_subscribe(broadcast);
+    void* data;
+    mu_assert("test_broadcast: Nothing should be published yet", broadcast_non_blocking_receive(first, &data) == CHANNEL_EMPTY);
+    mu_assert("test_broadcast: Publish failed", broadcast_publish(broadcast, "Message1") == SUCCESS);
+    broadcast_sub_t* late = broadcast_subscribe(broadcast);
+    mu_assert("test_broadcast: Publish failed", broadcast_publish(broadcast, "Message2") == SUCCESS);
+    mu_assert("test_broadcast: Receive failed", broadcast_receive(first, &data) == SUCCESS && string_equal(data, "Message1"));
+    mu_assert("test_broadcast: Receive failed", broadcast_receive(first, &data) == SUCCESS && string_equal(data, "Message2"));
+    mu_assert("test_broadcast: Late subscriber should start at its subscription", broadcast_receive(late, &data) == SUCCESS && string_equal(data, "Message2"));
+
+    /* The slowest subscriber holds up publishers, until it reads or leaves */
+    mu_assert("test_broadcast: Ring should be full", broadcast_non_blocking_publish(broadcast, "Message3") == CHANNEL_FULL);
+    mu_assert("test_broadcast: Receive failed", broadcast_receive(second, &data) == SUCCESS && string_equal(data, "Message1"));
+    mu_assert("test_broadcast: Publish failed", broadcast_non_blocking_publish(broadcast, "Message3") == SUCCESS);
+    mu_assert("test_broadcast: Ring should be full", broadcast_non_blocking_publish(broadcast, "Message4") == CHANNEL_FULL);
+    pthread_t pid;
+    broadcast_publish_args pub_args = {broadcast, "Message4", GEN_ERROR};
+    pthread_create(&pid, NULL, (void *)helper_broadcast_publish, &pub_args);
+    usleep(10000);
+    broadcast_unsubscribe(second);
+    pthread_join(pid, NULL);
+    mu_assert("test_broadcast: Blocked publish failed", pub_args.out == SUCCESS);
+    mu_assert("test_broadcast: Receive failed", broadcast_receive(late, &data) == SUCCESS && string_equal(data, "Message3"));
+    mu_assert("test_broadcast: Receive failed", broadcast_receive(late, &data) == SUCCESS && string_equal(data, "Message4"));
+
+    /* A blocked subscriber is woken by the next publish */
+    broadcast_receive_args rec_args = {late, NULL, GEN_ERROR};
+    pthread_create(&pid, NULL, (void *)helper_broadcast_receive, &rec_args);
+    usleep(10000);
+    mu_assert("test_broadcast: Receive failed", broadcast_receive(first, &data) == SUCCESS && string_equal(data, "Message3"));
+    mu_assert("test_broadcast: Receive failed", broadcast_receive(first, &data) == SUCCESS && string_equal(data, "Message4"));
+    mu_assert("test_broadcast: Publish failed", broadcast_publish(broadcast, "Message5") == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_broadcast: Blocked receive failed", rec_args.out == SUCCESS && string_equal(rec_args.data, "Message5"));
+
+    /* Messages published before the close are still delivered */
+    mu_assert("test_broadcast: Destroy should fail while open", broadcast_destroy(broadcast) == DESTROY_ERROR);
+    mu_assert("test_broadcast: Close failed", broadcast_close(broadcast) == SUCCESS);
+    mu_assert("test_broadcast: Second close should fail", broadcast_close(broadcast) == CLOSED_ERROR);
+    mu_assert("test_broadcast: Publish should be closed", broadcast_publish(broadcast, "Message6") == CLOSED_ERROR);
+    mu_assert("test_broadcast: Subscribe should fail once closed", broadcast_subscribe(broadcast) == NULL);
+    mu_assert("test_broadcast: Receive failed", broadcast_receive(first, &data) == SUCCESS && string_equal(data, "Message5"));
+    mu_assert("test_broadcast: Receive should be closed", broadcast_receive(first, &data) == CLOSED_ERROR);
+    mu_assert("test_broadcast: Receive should be closed", broadcast_non_blocking_receive(late, &data) == CLOSED_ERROR);
+    mu_assert("test_broadcast: Destroy should fail with subscribers", broadcast_destroy(broadcast) == GEN_ERROR);
+    broadcast_unsubscribe(first);
+    broadcast_unsubscribe(late);
+    mu_assert("test_broadcast: Destroy failed", broadcast_destroy(broadcast) == SUCCESS);
+
+    /* With BROADCAST_DROP publishers never wait, and a slow subscriber skips to the oldest message kept */
+    broadcast = broadcast_create(2, BROADCAST_DROP);
+    first = broadcast_subscribe(broadcast);
+    for (size_t i = 1; i <= 5; i++) {
+        mu_assert("test_broadcast: Publish should not block", broadcast_non_blocking_publish(broadcast, (void*)i) == SUCCESS);
+    }
+    mu_assert("test_broadcast: Receive failed", broadcast_receive(first, &data) == SUCCESS && (size_t)data == 4);
+    mu_assert("test_broadcast: Dropped messages not counted", first->dropped == 3);
+    mu_assert("test_broadcast: Receive failed", broadcast_receive(first, &data) == SUCCESS && (size_t)data == 5);
+    broadcast_unsubscribe(first);
+    broadcast_close(broadcast);
+    broadcast_destroy(broadcast);
+    return NULL;
+}
+
+char* test_stress_broadcast() {
+    print_test_details(__func__, "Stress Testing the broadcast channel");
+    run_stress_broadcast(1, 4, 20000);
+    run_stress_broadcast(16, 16, 20000);
+    run_stress_broadcast(64, 32, 10000);
+    return NULL;
+}
+
+typedef struct {
+    size_t node;
+    double distance;
+} typed_update_t;
+
+typedef struct {
+    channel_t* channel;
+    typed_update_t value;
+    enum channel_status out;
+} typed_args;
+
+void* helper_send_value(typed_args* args) {
+    args->out = channel_send_value(args->channel, &args->value);
+    return NULL;
+}
+
+void* helper_receive_value(typed_args* args) {
+    args->out = channel_receive_value(args->channel, &args->value);
+    return NULL;
+}
+
+char* test_typed_channel() {
+    print_test_details(__func__, "Testing channels of fixed-size values");
+
+    mu_assert("test_typed_channel: Create should fail without an element size", channel_create_typed(0, 2) == NULL);
+    channel_t* channel = channel_create_typed(sizeof(typed_update_t), 2);
+    mu_assert("test_typed_channel: Create failed", channel != NULL);
+
+    /* Values are copied in and out in FIFO order, so the sender's copy can change right after the send */
+    typed_update_t value = {1, 1.5};
+    mu_assert("test_typed_channel: Send failed", channel_send_value(channel, &value) == SUCCESS);
+    value.node = 2;
+    value.distance = 2.5;
+    mu_assert("test_typed_channel: Send failed", channel_non_blocking_send_value(channel, &value) == SUCCESS);
+    mu_assert("test_typed_channel: Channel should be full", channel_non_blocking_send_value(channel, &value) == CHANNEL_FULL);
+    mu_assert("test_typed_channel: Buffer should hold two values", buffer_current_size(channel->buffer) == 2);
+    typed_update_t got;
+    mu_assert("test_typed_channel: Receive failed", channel_receive_value(channel, &got) == SUCCESS && got.node == 1 && got.distance == 1.5);
+    mu_assert("test_typed_channel: Receive failed", channel_non_blocking_receive_value(channel, &got) == SUCCESS && got.node == 2 && got.distance == 2.5);
+    mu_assert("test_typed_channel: Channel should be empty", channel_non_blocking_receive_value(channel, &got) == CHANNEL_EMPTY);
+
+    /* The void* calls and select do not apply to typed channels, nor the value calls to other channels */
+    void* data;
+    mu_assert("test_typed_channel: Pointer send should fail", channel_send(channel, "Message") == GEN_ERROR);
+    mu_assert("test_typed_channel: Pointer receive should fail", channel_non_blocking_receive(channel, &data) == GEN_ERROR);
+    select_t list[] = {{channel, RECV, NULL}};
+    size_t index;
+    mu_assert("test_typed_channel: Select should fail", channel_select(list, 1, &index) == GEN_ERROR);
+    channel_t* plain = channel_create(1);
+    mu_assert("test_typed_channel: Value send should fail", channel_send_value(plain, &value) == GEN_ERROR);
+    channel_close(plain);
+    channel_destroy(plain);
+
+    /* A blocked sender's value lands in the slot freed by a receive */
+    value.node = 3;
+    channel_send_value(channel, &value);
+    value.node = 4;
+    channel_send_value(channel, &value);
+    pthread_t pid;
+    typed_args args = {channel, {5, 5.5}, GEN_ERROR};
+    pthread_create(&pid, NULL, (void *)helper_send_value, &args);
+    usleep(10000);
+    mu_assert("test_typed_channel: Receive failed", channel_receive_value(channel, &got) == SUCCESS && got.node == 3);
+    pthread_join(pid, NULL);
+    mu_assert("test_typed_channel: Blocked send failed", args.out == SUCCESS);
+    mu_assert("test_typed_channel: Receive failed", channel_receive_value(channel, &got) == SUCCESS && got.node == 4);
+    mu_assert("test_typed_channel: Receive failed", channel_receive_value(channel, &got) == SUCCESS && got.node == 5 && got.distance == 5.5);
+
+    /* Close ends blocked receives */
+    args = (typed_args){channel, {0, 0}, GEN_ERROR};
+    pthread_create(&pid, NULL, (void *)helper_receive_value, &args);
+    usleep(10000);
+    mu_assert("test_typed_channel: Close failed", channel_close(channel) == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_typed_channel: Blocked receive should be closed", args.out == CLOSED_ERROR);
+    mu_assert("test_typed_channel: Send should be closed", channel_send_value(channel, &value) == CLOSED_ERROR);
+    mu_assert("test_typed_channel: Destroy failed", channel_destroy(channel) == SUCCESS);
+
+    /* Unbuffered: the value is copied straight into the parked receiver, and a sender waits for a receiver */
+    channel = channel_create_typed(sizeof(typed_update_t), 0);
+    args = (typed_args){channel, {0, 0}, GEN_ERROR};
+    pthread_create(&pid, NULL, (void *)helper_receive_value, &args);
+    usleep(10000);
+    value.node = 6;
+    value.distance = 6.5;
+    mu_assert("test_typed_channel: Send failed", channel_send_value(channel, &value) == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_typed_channel: Blocked receive failed", args.out == SUCCESS && args.value.node == 6 && args.value.distance == 6.5);
+    mu_assert("test_typed_channel: Send should need a receiver", channel_non_blocking_send_value(channel, &value) == CHANNEL_FULL);
+    args = (typed_args){channel, {7, 7.5}, GEN_ERROR};
+    pthread_create(&pid, NULL, (void *)helper_send_value, &args);
+    usleep(10000);
+    mu_assert("test_typed_channel: Receive failed", channel_receive_value(channel, &got) == SUCCESS && got.node == 7 && got.distance == 7.5);
+    pthread_join(pid, NULL);
+    mu_assert("test_typed_channel: Blocked send failed", args.out == SUCCESS);
+    channel_close(channel);
+    channel_destroy(channel);
+    return NULL;
+}
+
+#define ZERO_COPY_PRODUCERS 4
+#define ZERO_COPY_RECORDS 800
+
+/* Writes records of 1 to 100 bytes in place, each filled with a byte derived from its first size_t */
+void* zero_copy_producer(channel_t* channel) {
+    for (size_t i = 0; i < ZERO_COPY_RECORDS; i++) {
+        channel_slot_t slot;
+        size_t size = sizeof(size_t) + i % 100;
+        if (channel_reserve(channel, size, &slot) != SUCCESS) {
+            return NULL;
+        }
+        *(size_t*)slot.data = i;
+        memset((char*)slot.data + sizeof(size_t), (int)(i & 0xff), size - sizeof(size_t));
+        channel_commit(channel, slot);
+    }
+    return NULL;
+}
+
+/* Reads records in place until it has seen count of them; returns the number that were intact */
+size_t zero_copy_check(channel_t* channel, size_t count) {
+    size_t intact = 0;
+    for (size_t n = 0; n < count; n++) {
+        channel_slot_t slot;
+        if (channel_peek(channel, &slot) != SUCCESS) {
+            break;
+        }
+        size_t i = *(size_t*)slot.data;
+        bool ok = slot.size == sizeof(size_t) + i % 100 && (size_t)slot.data % BUFFER_RECORD_ALIGN == 0;
+        for (size_t b = sizeof(size_t); ok && b < slot.size; b++) {
+            ok = ((unsigned char*)slot.data)[b] == (i & 0xff);
+        }
+        intact += ok;
+        channel_release(channel, slot);
+    }
+    return intact;
+}
+
+char* test_zero_copy() {
+    print_test_details(__func__, "Testing reserve/commit and peek/release on byte channels");
+
+    mu_assert("test_zero_copy: Create should fail without capacity", channel_create_bytes(0) == NULL);
+    channel_t* channel = channel_create_bytes(128);
+    mu_assert("test_zero_copy: Create failed", channel != NULL);
+    channel_slot_t slot;
+    mu_assert("test_zero_copy: Reserve should fail for a record larger than the channel", channel_reserve(channel, 128, &slot) == GEN_ERROR);
+    mu_assert("test_zero_copy: Nothing should be committed yet", channel_non_blocking_peek(channel, &slot) == CHANNEL_EMPTY);
+
+    /* Records are peeked in reservation order, each only once committed */
+    channel_slot_t first, second;
+    mu_assert("test_zero_copy: Reserve failed", channel_reserve(channel, 6, &first) == SUCCESS && first.size == 6);
+    mu_assert("test_zero_copy: Reserve failed", channel_non_blocking_reserve(channel, 40, &second) == SUCCESS);
+    strcpy(second.data, "Second");
+    channel_commit(channel, second);
+    mu_assert("test_zero_copy: First record is not committed yet", channel_non_blocking_peek(channel, &slot) == CHANNEL_EMPTY);
+    strcpy(first.data, "First");
+    channel_commit(channel, first);
+    mu_assert("test_zero_copy: Peek failed", channel_peek(channel, &slot) == SUCCESS && slot.size == 6 && string_equal(slot.data, "First"));
+    mu_assert("test_zero_copy: Record should be read in place", slot.data == first.data);
+    channel_slot_t peeked;
+    mu_assert("test_zero_copy: Peek failed", channel_peek(channel, &peeked) == SUCCESS && string_equal(peeked.data, "Second"));
+
+    /* Space only comes back once the oldest record is released, and a record never wraps around the end */
+    mu_assert("test_zero_copy: Channel should be full", channel_non_blocking_reserve(channel, 48, &first) == CHANNEL_FULL);
+    channel_release(channel, peeked);
+    mu_assert("test_zero_copy: Oldest record still held", channel_non_blocking_reserve(channel, 48, &first) == CHANNEL_FULL);
+    channel_release(channel, slot);
+    mu_assert("test_zero_copy: Reserve failed", channel_non_blocking_reserve(channel, 48, &first) == SUCCESS);
+    mu_assert("test_zero_copy: Record should be contiguous", (char*)first.data + 48 <= (char*)slot.data + 128);
+    memset(first.data, 'x', 48);
+    channel_commit(channel, first);
+    mu_assert("test_zero_copy: Peek failed", channel_peek(channel, &slot) == SUCCESS && slot.size == 48 && ((char*)slot.data)[47] == 'x');
+    channel_release(channel, slot);
+
+    /* The void* calls do not apply to byte channels */
+    void* data;
+    mu_assert("test_zero_copy: Pointer send should fail", channel_send(channel, "Message") == GEN_ERROR);
+    mu_assert("test_zero_copy: Pointer receive should fail", channel_non_blocking_receive(channel, &data) == GEN_ERROR);
+    mu_assert("test_zero_copy: No fd for byte channels", channel_get_fd(channel, RECV) == -1);
+
+    /* Many producers and consumers, with records of every size wrapping around the ring */
+    pthread_t producers[ZERO_COPY_PRODUCERS];
+    for (size_t i = 0; i < ZERO_COPY_PRODUCERS; i++) {
+        pthread_create(&producers[i], NULL, (void *)zero_copy_producer, channel);
+    }
+    size_t intact = zero_copy_check(channel, ZERO_COPY_PRODUCERS * ZERO_COPY_RECORDS);
+    for (size_t i = 0; i < ZERO_COPY_PRODUCERS; i++) {
+        pthread_join(producers[i], NULL);
+    }
+    mu_assert("test_zero_copy: Records were corrupted", intact == ZERO_COPY_PRODUCERS * ZERO_COPY_RECORDS);
+
+    /* Close ends blocked reserves and peeks */
+    mu_assert("test_zero_copy: Close failed", channel_close(channel) == SUCCESS);
+    mu_assert("test_zero_copy: Peek should be closed", channel_peek(channel, &slot) == CLOSED_ERROR);
+    mu_assert("test_zero_copy: Reserve should be closed", channel_reserve(channel, 8, &slot) == CLOSED_ERROR);
+    mu_assert("test_zero_copy: Destroy failed", channel_destroy(channel) == SUCCESS);
+    return NULL;
+}
+
+/* Returns true if both addresses are on the same 64-byte cache line */
+static bool same_line(const void* a, const void* b)
+{
+    return (uintptr_t)a / 64 == (uintptr_t)b / 64;
+}
+
+char* test_cache_lines() {
+    print_test_details(__func__, "Testing the cache line layout and single allocation of channels");
+
+    channel_t* channels[] = {channel_create(0), channel_create(5), channel_create_spsc(5), channel_create_mpmc(5),
+                             channel_create_typed(24, 5), channel_create_bytes(100)};
+    for (size_t i = 0; i < sizeof(channels) / sizeof(channels[0]); i++) {
+        channel_t* channel = channels[i];
+        mu_assert("test_cache_lines: Create failed", channel != NULL);
+        mu_assert("test_cache_lines: Channel should start a cache line", (uintptr_t)channel % 64 == 0);
+        mu_assert("test_cache_lines: Channel should be in front of its buffer", buffer_prefix(channel->buffer) == channel && (char*)channel->buffer >= (char*)(channel + 1));
+        mu_assert("test_cache_lines: Mutex should not share a line with read-mostly fields", !same_line(&channel->mutex, &channel->closed));
+        mu_assert("test_cache_lines: Senders and receivers should park on different lines", !same_line(&channel->full, &channel->empty) && !same_line(&channel->send_waiting, &channel->recv_waiting));
+        mu_assert("test_cache_lines: Head and tail should be on different lines", !same_line(&channel->buffer->head, &channel->buffer->tail));
+        mu_assert("test_cache_lines: Slots should not share a line with the buffer", (size_t)((char*)(channel->buffer->data != NULL ? (void*)channel->buffer->data : (void*)channel->buffer->values) - (char*)channel->buffer) >= sizeof(buffer_t));
+    }
+    mu_assert("test_cache_lines: MPMC sequence numbers should follow the slots", channels[3]->buffer->seq != NULL && (char*)channels[3]->buffer->seq >= (char*)(channels[3]->buffer->data + 5));
+
+    /* Each channel still works, and frees its buffer and itself in one go on destroy */
+    void* data;
+    mu_assert("test_cache_lines: Send failed", channel_send(channels[2], "Message") == SUCCESS);
+    mu_assert("test_cache_lines: Receive failed", channel_receive(channels[2], &data) == SUCCESS && string_equal(data, "Message"));
+    mu_assert("test_cache_lines: Send failed", channel_send(channels[3], "Message") == SUCCESS);
+    mu_assert("test_cache_lines: Receive failed", channel_receive(channels[3], &data) == SUCCESS && string_equal(data, "Message"));
+    for (size_t i = 0; i < sizeof(channels) / sizeof(channels[0]); i++) {
+        mu_assert("test_cache_lines: Close failed", channel_close(channels[i]) == SUCCESS);
+        mu_assert("test_cache_lines: Destroy failed", channel_destroy(channels[i]) == SUCCESS);
+    }
+    return NULL;
+}
+
+char* test_ring_indexing() {
+    print_test_details(__func__, "Testing ring indices wrapping around power-of-two and other capacities");
+
+    /* Power-of-two capacities are indexed with a mask, the others with a modulo; every case laps its ring many times */
+    size_t capacities[] = {1, 4, 5, 8, 12};
+    for (size_t c = 0; c < sizeof(capacities) / sizeof(capacities[0]); c++) {
+        size_t capacity = capacities[c];
+        channel_t* channel = channel_create(capacity);
+        channel_t* typed = channel_create_typed(sizeof(size_t), capacity);
+        size_t sent = 0;
+        size_t received = 0;
+        for (size_t round = 0; round < 10 * capacity; round++) {
+            /* Fill to capacity from wherever the previous round left the indices, then drain most of it */
+            while (buffer_current_size(channel->buffer) < capacity) {
+                sent++;
+                mu_assert("test_ring_indexing: Send failed", channel_non_blocking_send(channel, (void*)sent) == SUCCESS);
+                mu_assert("test_ring_indexing: Typed send failed", channel_non_blocking_send_value(typed, &sent) == SUCCESS);
+            }
+            mu_assert("test_ring_indexing: Channel should be full", channel_non_blocking_send(channel, (void*)1) == CHANNEL_FULL);
+            mu_assert("test_ring_indexing: Typed channel should be full", channel_non_blocking_send_value(typed, &sent) == CHANNEL_FULL);
+            size_t keep = round % capacity;
+            while (buffer_current_size(channel->buffer) > keep) {
+                void* data;
+                size_t value;
+                received++;
+                mu_assert("test_ring_indexing: Receive failed", channel_non_blocking_receive(channel, &data) == SUCCESS && (size_t)data == received);
+                mu_assert("test_ring_indexing: Typed receive failed", channel_non_blocking_receive_value(typed, &value) == SUCCESS && value == received);
+            }
+        }
+
+        /* Batches split into the runs before and after the end of the ring */
+        void* items[3] = {(void*)(sent + 1), (void*)(sent + 2), (void*)(sent + 3)};
+        size_t room = capacity - buffer_current_size(channel->buffer);
+        size_t count = 0;
+        mu_assert("test_ring_indexing: Send many failed", channel_send_many(channel, items, room < 3 ? room : 3, &count) == SUCCESS);
+        sent += count;
+        while (received < sent) {
+            void* out[3];
+            size_t got = 0;
+            mu_assert("test_ring_indexing: Receive many failed", channel_receive_many(channel, out, 3, &got) == SUCCESS);
+            for (size_t i = 0; i < got; i++) {
+                mu_assert("test_ring_indexing: Messages out of order", (size_t)out[i] == ++received);
+            }
+        }
+        mu_assert("test_ring_indexing: Channel not drained", buffer_current_size(channel->buffer) == 0);
+        channel_close(channel);
+        channel_destroy(channel);
+        channel_close(typed);
+        channel_destroy(typed);
+    }
+    return NULL;
+}
+
+#define ELASTIC_PRODUCERS 4
+#define ELASTIC_MESSAGES 2000
+
+/* Sends ELASTIC_MESSAGES messages tagged with the producer's id in the high bits */
+void* elastic_producer(send_many_args* args) {
+    size_t id = args->n;
+    args->out = SUCCESS;
+    for (size_t i = 1; i <= ELASTIC_MESSAGES && args->out == SUCCESS; i++) {
+        args->out = channel_send(args->channel, (void*)(id << 32 | i));
+    }
+    return NULL;
+}
+
+char* test_elastic_channel() {
+    print_test_details(__func__, "Testing channels whose buffer grows and shrinks");
+
+    mu_assert("test_elastic_channel: Create should fail without a size", channel_create_elastic(0, 8) == NULL);
+    mu_assert("test_elastic_channel: Create should fail with max_size below size", channel_create_elastic(4, 2) == NULL);
+    channel_t* channel = channel_create_elastic(4, 64);
+    mu_assert("test_elastic_channel: Create failed", channel != NULL && buffer_capacity(channel->buffer) == 4);
+
+    /* A burst doubles the buffer instead of blocking, up to max_size */
+    for (size_t i = 1; i <= 64; i++) {
+        mu_assert("test_elastic_channel: Send should grow the buffer", channel_non_blocking_send(channel, (void*)i) == SUCCESS);
+    }
+    mu_assert("test_elastic_channel: Buffer should have grown to max_size", buffer_capacity(channel->buffer) == 64);
+    mu_assert("test_elastic_channel: Channel should be full at max_size", channel_non_blocking_send(channel, (void*)65) == CHANNEL_FULL);
+    void* data;
+    for (size_t i = 1; i <= 64; i++) {
+        mu_assert("test_elastic_channel: Messages out of order after growing", channel_non_blocking_receive(channel, &data) == SUCCESS && (size_t)data == i);
+    }
+    mu_assert("test_elastic_channel: Draining one burst should not shrink the buffer", buffer_capacity(channel->buffer) == 64);
+
+    /* Traffic that keeps the buffer mostly empty halves it step by step, but not below size */
+    size_t sent = 0;
+    size_t received = 0;
+    for (size_t round = 0; round < 200; round++) {
+        mu_assert("test_elastic_channel: Send failed", channel_non_blocking_send(channel, (void*)++sent) == SUCCESS);
+        mu_assert("test_elastic_channel: Receive failed", channel_non_blocking_receive(channel, &data) == SUCCESS && (size_t)data == ++received);
+    }
+    mu_assert("test_elastic_channel: Buffer should have shrunk back to size", buffer_capacity(channel->buffer) == 4);
+
+    /* Receives from a buffer that stays more than a quarter full do not count towards shrinking */
+    for (size_t i = 0; i < 32; i++) {
+        mu_assert("test_elastic_channel: Send failed", channel_non_blocking_send(channel, (void*)++sent) == SUCCESS);
+    }
+    for (size_t round = 0; round < 200; round++) {
+        mu_assert("test_elastic_channel: Send failed", channel_non_blocking_send(channel, (void*)++sent) == SUCCESS);
+        mu_assert("test_elastic_channel: Receive failed", channel_non_blocking_receive(channel, &data) == SUCCESS && (size_t)data == ++received);
+    }
+    mu_assert("test_elastic_channel: Busy buffer should keep its capacity", buffer_capacity(channel->buffer) == 64);
+
+    /* Batches grow the buffer too, and wrap around it */
+    void* items[24];
+    for (size_t i = 0; i < 24; i++) {
+        items[i] = (void*)(sent + 1 + i);
+    }
+    size_t count = 0;
+    mu_assert("test_elastic_channel: Send many failed", channel_send_many(channel, items, 24, &count) == SUCCESS && count == 24);
+    sent += count;
+    while (received < sent) {
+        void* out[10];
+        size_t got = 0;
+        mu_assert("test_elastic_channel: Receive many failed", channel_receive_many(channel, out, 10, &got) == SUCCESS);
+        for (size_t i = 0; i < got; i++) {
+            mu_assert("test_elastic_channel: Messages out of order", (size_t)out[i] == ++received);
+        }
+    }
+    mu_assert("test_elastic_channel: Close failed", channel_close(channel) == SUCCESS);
+    mu_assert("test_elastic_channel: Destroy failed", channel_destroy(channel) == SUCCESS);
+
+    /* Producers only block at max_size, and each one's messages stay in order through every resize */
+    channel = channel_create_elastic(2, 256);
+    pthread_t producers[ELASTIC_PRODUCERS];
+    send_many_args args[ELASTIC_PRODUCERS];
+    for (size_t p = 0; p < ELASTIC_PRODUCERS; p++) {
+        args[p] = (send_many_args){.channel = channel, .n = p, .out = GEN_ERROR};
+        pthread_create(&producers[p], NULL, (void*)elastic_producer, &args[p]);
+    }
+    size_t next[ELASTIC_PRODUCERS] = {0};
+    bool ordered = true;
+    for (size_t n = 0; n < ELASTIC_PRODUCERS * ELASTIC_MESSAGES; n++) {
+        mu_assert("test_elastic_channel: Receive failed", channel_receive(channel, &data) == SUCCESS);
+        size_t id = (size_t)data >> 32;
+        ordered = ordered && id < ELASTIC_PRODUCERS && ((size_t)data & 0xffffffff) == ++next[id];
+    }
+    for (size_t p = 0; p < ELASTIC_PRODUCERS; p++) {
+        pthread_join(producers[p], NULL);
+        mu_assert("test_elastic_channel: Producer failed", args[p].out == SUCCESS);
+    }
+    mu_assert("test_elastic_channel: Messages of a producer out of order", ordered);
+    mu_assert("test_elastic_channel: Buffer should stay within its bounds", buffer_capacity(channel->buffer) >= 2 && buffer_capacity(channel->buffer) <= 256);
+    mu_assert("test_elastic_channel: Close failed", channel_close(channel) == SUCCESS);
+    mu_assert("test_elastic_channel: Destroy failed", channel_destroy(channel) == SUCCESS);
+    return NULL;
+}
+
 typedef char* (*test_fn_t)();
 typedef struct {
     char* name;
@@ -2048,6 +3909,34 @@ test_t tests[] = {{"test_initialization", test_initialization},
                   {"test_select_mixed_buffered_unbuffered", test_select_mixed_buffered_unbuffered},
                   {"test_stress_unbuffered", test_stress_unbuffered},
                   {"test_stress_mixed_buffered_unbuffered", test_stress_mixed_buffered_unbuffered},
+                  {"test_spsc", test_spsc},
+                  {"test_mpmc", test_mpmc},
+                  {"test_wait_policy", test_wait_policy},
+                  {"test_wake_without_waiters", test_wake_without_waiters},
+                  {"test_handoff", test_handoff},
+                  {"test_rendezvous", test_rendezvous},
+                  {"test_send_receive_many", test_send_receive_many},
+                  {"test_for_too_many_select_wakeups", test_for_too_many_select_wakeups},
+                  {"test_select_direct_completion", test_select_direct_completion},
+                  {"test_select_fair", test_select_fair},
+                  {"test_try_select", test_try_select},
+                  {"test_timeout", test_timeout},
+                  {"test_select_set", test_select_set},
+                  {"test_channel_fd", test_channel_fd},
+                  {"test_coroutines", test_coroutines},
+                  {"test_coroutine_bytes", test_coroutine_bytes},
+                  {"test_stress_coroutines", test_stress_coroutines},
+                  {"test_pool", test_pool},
+                  {"test_stress_pool", test_stress_pool},
+                  {"test_sharded_channel", test_sharded_channel},
+                  {"test_sharded_wakeup", test_sharded_wakeup},
+                  {"test_broadcast", test_broadcast},
+                  {"test_stress_broadcast", test_stress_broadcast},
+                  {"test_typed_channel", test_typed_channel},
+                  {"test_zero_copy", test_zero_copy},
+                  {"test_cache_lines", test_cache_lines},
+                  {"test_ring_indexing", test_ring_indexing},
+                  {"test_elastic_channel", test_elastic_channel},
 };
 
 size_t num_tests = sizeof(tests)/sizeof(tests[0]);